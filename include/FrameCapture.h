@@ -0,0 +1,69 @@
+#pragma once
+#include "ThreadPool.h"
+#include "vma.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vulkan/vulkan_core.h>
+
+// Copies the final image of a frame into one of a ring of host visible buffers. The copy is recorded at the end of
+// the frame's command buffer and only read back once that frame's slot comes around again, so the frame loop never
+// waits on the GPU. Writing the image to disk happens on the thread pool, if every buffer is still in use the frame
+// is skipped rather than stalling.
+class FrameCapture
+{
+  public:
+    // must exceed the number of frames in flight so that workers can lag behind without dropping frames
+    static constexpr uint32_t NumSlots = 8;
+
+    FrameCapture(VmaAllocator allocator, ThreadPool &threadPool, const std::string &outputDir);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // records the copy of image, which must be in present src layout, and leaves it in the same layout
+    void record(VkCommandBuffer cmdBuf, uint32_t frameIdx, VkImage image, VkFormat format, uint32_t width, uint32_t height);
+    // hands the readback recorded for frameIdx to a worker, the frame must have completed on the GPU
+    void collect(uint32_t frameIdx);
+    // collects every recorded readback, the device must be idle
+    void collectAll();
+
+    [[nodiscard]] uint64_t numCaptured();
+    [[nodiscard]] uint64_t numDropped();
+
+  private:
+    struct Slot
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        uint8_t *data = nullptr;
+        VkDeviceSize size = 0;
+
+        uint32_t frameIdx = 0;
+        uint64_t frameNumber = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        // only touched by the render thread
+        bool pending = false;
+        // set by the render thread and cleared by the worker once the image is written
+        std::atomic<bool> encoding = false;
+    };
+
+    void ensureCapacity(Slot &slot, VkDeviceSize size);
+    void submitEncode(Slot &slot);
+    void encode(Slot &slot);
+
+    VmaAllocator m_allocator = VK_NULL_HANDLE;
+    ThreadPool &m_threadPool;
+    std::string m_outputDir;
+    std::array<Slot, NumSlots> m_slots;
+    uint32_t m_nextSlot = 0;
+    uint64_t m_frameNumber = 0;
+
+    uint64_t m_numCaptured = 0;
+    uint64_t m_numDropped = 0;
+};
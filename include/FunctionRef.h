@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template <typename Fn>
+class FunctionRef;
+
+// Non-owning reference to a callable. Unlike std::function it never allocates, so it is only valid for as long
+// as the callable it was created from, which makes it suitable for parameters that are invoked before returning.
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)>
+{
+  public:
+    template <typename Callable>
+        requires(!std::is_same_v<std::remove_cvref_t<Callable>, FunctionRef> && std::is_invocable_r_v<R, Callable &, Args...>)
+    FunctionRef(Callable &&callable)
+        : m_callable(const_cast<void *>(static_cast<const void *>(std::addressof(callable))))
+        , m_invoke(
+              [](void *callable, Args... args) -> R
+              {
+                  return (*static_cast<std::remove_reference_t<Callable> *>(callable))(std::forward<Args>(args)...);
+              })
+    {
+    }
+
+    R operator()(Args... args) const
+    {
+        return m_invoke(m_callable, std::forward<Args>(args)...);
+    }
+
+  private:
+    void *m_callable;
+    R (*m_invoke)(void *, Args...);
+};
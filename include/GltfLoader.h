@@ -0,0 +1,20 @@
+#pragma once
+#include "MappedFile.h"
+#include "MeshData.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// Native loader for binary glTF (.glb). Attributes are read straight out of the mapped file into the vertex layout and
+// embedded images are referenced in place, so the only copy of an image before staging is the decode itself. Files
+// using features the loader doesn't handle (sparse accessors, external buffers, required extensions, primitives other
+// than triangle lists, missing normals) are rejected so the caller can fall back to Assimp.
+struct GltfLoader
+{
+    // identifies meshes imported by this loader in the mesh cache key, Assimp imports always use non zero flags
+    static constexpr uint32_t ImportFlags = 0;
+
+    [[nodiscard]] static bool IsGlb(const std::span<const uint8_t> &file);
+    // the mapping is kept alive by data for as long as its spans are in use
+    [[nodiscard]] static bool Load(const std::shared_ptr<const MappedFile> &file, MeshData &data);
+};
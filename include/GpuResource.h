@@ -67,6 +67,7 @@ struct Image final : public BaseImage<Image>
     VmaAllocationInfo m_allocationInfo;
     uint32_t m_width;
     uint32_t m_height;
+    uint32_t m_mipLevels = 1;
     bool m_mutableFormat;
     bool m_preallocated = false;
 
@@ -83,6 +84,7 @@ struct Image::State
     const VkFormat &format;
     const std::span<QueueFamily> &families;
     VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    uint32_t mipLevels = 1;
     VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     VmaMemoryUsage vmaUsage = VMA_MEMORY_USAGE_AUTO;
     VmaAllocationCreateFlags vmaFlags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
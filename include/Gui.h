@@ -19,6 +19,7 @@ class Gui : public RenderPass
     void collectImGuiFrameData();
     void setImGuiStyles();
     void setImGuiDockspace();
+    void drawUploadStats();
 
   private:
     Gui();
@@ -0,0 +1,14 @@
+#pragma once
+#include "MeshData.h"
+#include <cstdint>
+
+// Narrows the indices of every submesh that reaches fewer than 65536 vertices from its vertexOffset to 16 bits, which
+// halves index memory and index fetch for most submeshes. packedIndices holds one block per submesh, its full detail
+// triangles followed by its LODs, each block in the submesh's indexSize and 4 byte aligned. The index offsets of the
+// submesh, its meshlets and its LODs then count indices of that size from the start of packedIndices, so a draw binds
+// the whole buffer with the submesh's index type and passes the offset as its first index.
+struct IndexPacking
+{
+    // fills packedIndices, rewrites the index offsets to point into it, then releases faces
+    static void Pack(MeshData &data);
+};
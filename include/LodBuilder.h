@@ -0,0 +1,24 @@
+#pragma once
+#include "MeshData.h"
+#include "ThreadPool.h"
+#include <cstdint>
+
+// Builds a chain of simplified index lists for every submesh by quadric error edge collapse (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics"). Vertices only collapse onto their neighbours, so every level
+// reuses the submesh's vertices and only adds indices, which are appended to faces. Vertices on open borders, and
+// those sharing their position with another vertex because of a uv or normal seam, never move, which keeps the
+// silhouette and the seams intact.
+//
+// Each level aims for half the triangles of the previous one and records the largest collapse error so far, which the
+// draw projects to screen space to pick a level. Also computes the submesh bounding spheres that projection uses.
+// Works on the full precision vertices, so it has to run before they are packed.
+struct LodBuilder
+{
+    static constexpr uint32_t MaxLods = 4;
+    // a level that removes fewer triangles than this from the previous one isn't worth the memory, ends the chain
+    static constexpr float MinReduction = 0.25f;
+    // submeshes this small are drawn at full detail at any distance
+    static constexpr uint32_t MinTriangles = 64;
+
+    static void Build(MeshData &data, ThreadPool &threadPool);
+};
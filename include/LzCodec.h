@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Byte oriented LZ compression of asset payloads for decompression on the GPU. The input is cut into blocks that are
+// compressed independently, so every block can be expanded by its own compute invocation. The mesh cache stores its
+// vertices and texels this way, see MeshCache.
+//
+// A compressed payload is an LzHeader, followed by numBlocks + 1 uint32_t offsets of the blocks relative to the start
+// of the block data, followed by the block data. Every block is a sequence of LZ4 style tokens: the high nibble holds
+// the number of literals and the low nibble the match length minus MinMatch, each continued with 255 valued bytes when
+// the nibble is 15, followed by the literals and a 2 byte little endian match offset. The last token of a block has no
+// match, which the decoder recognizes by reaching the end of the block after the literals.
+struct LzCodec
+{
+    static constexpr uint32_t Magic = 0x315a4c50; // "PLZ1"
+    static constexpr uint32_t MinMatch = 4;
+    // a block is the unit of parallelism on the GPU, small blocks give more invocations but a worse ratio
+    static constexpr uint32_t DefaultBlockSize = 16 * 1024;
+    // matches are limited to their block, so offsets always fit the 2 byte encoding
+    static constexpr uint32_t MaxBlockSize = 64 * 1024;
+
+    struct Header
+    {
+        uint32_t magic = Magic;
+        uint32_t uncompressedSize = 0;
+        // a multiple of 4, so the blocks never share a word of the decompressed output on the GPU
+        uint32_t blockSize = DefaultBlockSize;
+        uint32_t numBlocks = 0;
+    };
+
+    [[nodiscard]] static std::vector<uint8_t> Compress(const std::span<const uint8_t> &src, uint32_t blockSize = DefaultBlockSize);
+    // only checks the magic, tells payloads apart from other formats sharing a field
+    [[nodiscard]] static bool IsCompressed(const std::span<const uint8_t> &data);
+    // validates the header and the block offsets against the size of the payload
+    [[nodiscard]] static bool ReadHeader(const std::span<const uint8_t> &compressed, Header &header);
+    // offset of the block data from the start of the payload
+    [[nodiscard]] static size_t GetBlockDataOffset(const Header &header);
+    // CPU reference of the compute decompressor, dst must hold header.uncompressedSize bytes
+    [[nodiscard]] static bool Decompress(const std::span<const uint8_t> &compressed, const std::span<uint8_t> &dst);
+};
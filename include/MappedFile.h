@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Read only memory mapping of a whole file. Pages are only read from disk when touched, so large assets can be handed
+// to the upload path without reading them into heap memory first.
+class MappedFile
+{
+  public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // false if the file doesn't exist, is empty or couldn't be mapped
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] std::span<const uint8_t> data() const;
+
+  private:
+    void close();
+
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
@@ -1,36 +1,90 @@
 #pragma once
+#include "MeshData.h"
 #include "Pipeline.h"
 #include "ResourcePool.h"
 #include "Types.h"
+#include <memory>
+#include <span>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 
 struct Mesh
 {
+    // safe to call from several threads at once
     Mesh(const std::string &path, const GraphicsPipeline &pipeline);
+    // on the render thread only, it releases the mesh's textures and cancels its uploads
     ~Mesh();
 
-    VkSampler sampler;
+    // Constructs a mesh for every path in parallel on the renderer's thread pool and returns them in the order of
+    // paths once all of them are constructed. Like a single mesh, they are drawn once their uploads completed
+    [[nodiscard]] static std::vector<std::unique_ptr<Mesh>> LoadParallel(const std::span<const std::string> &paths,
+                                                                         const GraphicsPipeline &pipeline);
 
-    // Total Mesh Buffer
-    std::vector<Vertex> vertices;
-    std::vector<glm::u32vec3> faces;
-    Handle<Buffer> vkVertexBuffer;
-    Handle<Buffer> vkIndexBuffer;
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    // Ranges of the renderer's shared geometry buffers
+    GeometryAllocation vertexAllocation;
+    GeometryAllocation indexAllocation;
+
+    // Scheduled uploads, the mesh is only drawn once all of them have completed. They read straight from meshData,
+    // which is released once the mesh is resident
+    std::vector<UploadTicket> uploadTickets;
+    MeshData meshData;
 
     // Per Submesh
-    std::vector<VkDeviceSize> meshletVertexOffsets;
-    std::vector<VkDeviceSize> meshletIndexOffsets;
-    std::vector<VkDeviceSize> meshletIndexSizes;
+    // in vertices from the start of the shared vertex buffer
+    std::vector<VkDeviceSize> submeshVertexOffsets;
+    // where the mesh's indices start in the shared index buffer, in indices of the submesh's index size
+    std::vector<uint32_t> submeshIndexBases;
+    std::vector<VkDeviceSize> submeshIndexOffsets;
+    std::vector<VkDeviceSize> submeshIndexSizes;
+    // 16 bit where the submesh reaches fewer than 65536 vertices, see IndexPacking
+    std::vector<VkIndexType> submeshIndexTypes;
     std::vector<VkDeviceSize> matIndex;
+    // dequantization of the packed positions and the material color
+    std::vector<DrawPushConstants> submeshDrawConstants;
+    std::vector<uint32_t> submeshMeshletOffsets;
+    std::vector<uint32_t> submeshMeshletCounts;
+    // model space, for frustum culling and LOD selection
+    std::vector<glm::vec4> submeshBoundingSpheres;
+    std::vector<uint32_t> submeshLodOffsets;
+    std::vector<uint32_t> submeshLodCounts;
+
+    // Per Meshlet, culled on the CPU for every draw
+    std::vector<MeshData::Meshlet> meshlets;
+
+    // Per LOD, the simplified levels of each submesh from finest to coarsest
+    std::vector<MeshData::Lod> lods;
+
+    // Per Node, parents before children. Each node draws its submeshes with its world transform
+    std::vector<uint32_t> nodeParents;
+    std::vector<glm::mat4> nodeLocalTransforms;
+    std::vector<glm::mat4> nodeWorldTransforms;
+    std::vector<uint32_t> nodeSubmeshOffsets;
+    std::vector<uint32_t> nodeSubmeshCounts;
+    // submesh indices of all nodes, ranges of it belong to a node
+    std::vector<uint32_t> nodeSubmeshes;
 
-    // All Textures
-    std::unordered_map<std::string, Handle<Image>> textures;
+    // All Textures, indexed like meshData.textures. Owned by the renderer's texture cache, which they are released to
+    // by their content hash and the ticket they were acquired with
+    std::vector<Handle<Image>> textures;
+    std::vector<uint64_t> textureHashes;
+    std::vector<UploadTicket> textureTickets;
 
     // Per Material
     std::vector<VkDescriptorSet> matDescriptorSets;
 
     const GraphicsPipeline &m_parentPipeline;
 
-    void drawMesh(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout);
+    bool isResident();
+    // recomputes nodeWorldTransforms from nodeLocalTransforms in a single pass, call after changing a local transform
+    void updateNodeTransforms();
+    // Every submesh of every node is drawn with the node's world transform as the model matrix, at the coarsest LOD
+    // whose error stays below a pixel on screen. At full detail only the meshlets in the view frustum that aren't facing
+    // away from the camera are drawn, a LOD is culled as a whole. The caller binds the shared vertex buffer, the shared
+    // index buffer is only rebound when the index type differs from boundIndexType, which is updated, so consecutive
+    // meshes share the binds
+    void drawMesh(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout, const glm::mat4 &view, const glm::mat4 &projection,
+                  VkIndexType &boundIndexType);
 };
@@ -0,0 +1,37 @@
+#pragma once
+#include "MeshData.h"
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Cooked meshes in a binary format that is mapped rather than parsed. Every section is aligned so vertices, indices
+// and texels can be copied from the mapping straight into staging memory. Vertices and texels are stored compressed
+// with LzCodec: the vertices cross to the GPU compressed and are expanded there, the texels are expanded on the thread
+// pool straight into staging memory, which is far cheaper than the image decoding a warm load skips. Indices are
+// stored as they are, since loading checks every one of them against the vertex count.
+//
+// A cache file is only used while its key matches: the hash of the source file's contents, the import flags it was
+// imported with, the vertex format it was packed to and the format version, so editing an asset or changing the import
+// re-cooks it on the next load.
+struct MeshCache
+{
+    // bump whenever the layout of the file or of anything stored in it (Vertex, MeshData) changes
+    static constexpr uint32_t Version = 10;
+
+    struct Key
+    {
+        uint64_t sourceHash = 0;
+        uint32_t importFlags = 0;
+        MeshData::VertexFormat vertexFormat = MeshData::VERTEX_FORMAT_FLOAT;
+    };
+
+    [[nodiscard]] static uint64_t Hash(const std::span<const uint8_t> &data);
+    // next to the source file, or in PACEM_MESH_CACHE_DIR when it is set, named after the source file and a hash of its
+    // absolute path
+    [[nodiscard]] static std::string GetCachePath(const std::string &sourcePath);
+    // false if there is no cache file, it is stale or it is corrupt, in which case the mesh has to be imported again
+    [[nodiscard]] static bool Load(const std::string &cachePath, const Key &key, MeshData &data);
+    // every texture must already be decoded and the vertices and indices packed. Written to a temporary file first, so
+    // a concurrent or interrupted cook never leaves a partial cache file behind
+    static bool Store(const std::string &cachePath, const Key &key, const MeshData &data);
+};
@@ -0,0 +1,149 @@
+#pragma once
+#include "MappedFile.h"
+#include "Types.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Everything a Mesh is built from, as produced by an importer or read from the mesh cache. The spans point either into
+// the storage vectors below or into a mapped file kept alive by `mapping`, which lets cooked meshes go from disk to
+// staging memory without an intermediate copy. Moving a MeshData keeps the spans valid.
+struct MeshData
+{
+    static constexpr uint32_t NoTexture = UINT32_MAX;
+    static constexpr uint32_t NoParent = UINT32_MAX;
+
+    // layouts of packedVertices, see VertexPacking
+    enum VertexFormat : uint32_t
+    {
+        VERTEX_FORMAT_FLOAT,
+        VERTEX_FORMAT_HALF,
+        VERTEX_FORMAT_SNORM16,
+
+        VERTEX_FORMAT_COUNT,
+    };
+
+    // bindings of the per material descriptor set
+    enum TextureSlot : uint32_t
+    {
+        TEXTURE_SLOT_DIFFUSE,
+        TEXTURE_SLOT_AMBIENT_OCCLUSION,
+        TEXTURE_SLOT_EMISSIVE,
+        TEXTURE_SLOT_NORMAL,
+
+        TEXTURE_SLOT_COUNT,
+    };
+
+    struct Submesh
+    {
+        uint32_t vertexOffset = 0;
+        // into faces, or once the indices are packed, in indices of indexSize into packedIndices
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        uint32_t matIndex = 0;
+        // bytes per packed index, 2 or 4, see IndexPacking
+        uint32_t indexSize = sizeof(uint32_t);
+        // packed positions are relative to the bounds of the submesh, position = packed * positionScale + positionOffset
+        glm::vec3 positionScale = glm::vec3(1.0f);
+        glm::vec3 positionOffset = glm::vec3(0.0f);
+        uint32_t meshletOffset = 0;
+        uint32_t meshletCount = 0;
+        // simplified versions of the submesh, coarsest last
+        uint32_t lodOffset = 0;
+        uint32_t lodCount = 0;
+        // xyz center, w radius, in model space
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+    };
+
+    // A simplified version of a submesh, drawn with the submesh's vertices and material, see LodBuilder
+    struct Lod
+    {
+        // absolute, like Submesh::indexOffset
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        // in model space, an upper bound of how far the simplified surface is from the full detail one
+        float error = 0.0f;
+    };
+
+    // A run of the submesh's full detail triangles, contiguous in the indices, see MeshletBuilder. Culled on the CPU
+    // for every draw
+    struct Meshlet
+    {
+        // xyz center, w radius, in model space
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        // xyz apex, w unused. Every triangle faces away from a camera at cameraPosition if
+        // dot(normalize(coneApex - cameraPosition), coneAxis) > coneCutoff, which never holds for a cutoff of 1
+        glm::vec4 coneApex = glm::vec4(0.0f);
+        glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        float coneCutoff = 1.0f;
+        // absolute, like Submesh::indexOffset
+        uint32_t indexOffset = 0;
+        uint32_t indexCount = 0;
+        uint32_t submeshIndex = 0;
+        uint32_t padding = 0;
+    };
+
+    // A node of the scene hierarchy. Nodes are stored parents first, so their world transforms are computed in a single
+    // pass front to back
+    struct Node
+    {
+        // relative to the parent
+        glm::mat4 localTransform = glm::mat4(1.0f);
+        // NoParent for roots
+        uint32_t parentIndex = NoParent;
+        // range of nodeSubmeshes drawn with the node's world transform
+        uint32_t submeshOffset = 0;
+        uint32_t submeshCount = 0;
+    };
+
+    struct Material
+    {
+        // indices into textures, NoTexture for unused slots
+        std::array<uint32_t, TEXTURE_SLOT_COUNT> textures = {NoTexture, NoTexture, NoTexture, NoTexture};
+        // alpha is unused
+        glm::vec4 diffuseColor = glm::vec4(1.0f);
+    };
+
+    // Either RGBA8 texels or a compressed image (png, jpg, ..., or LzCodec compressed texels from the mesh cache) that
+    // is decoded during the upload
+    struct Texture
+    {
+        std::span<const uint8_t> texels = {};
+        std::span<const uint8_t> encoded = {};
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // of the compressed image, or the texels of an uncompressed one, and the dimensions. Identical images share one
+        // GPU texture across meshes
+        uint64_t contentHash = 0;
+    };
+
+    // full precision vertices as imported, released once they are packed
+    std::span<const Vertex> vertices;
+    // vertices in vertexFormat, which is what is cooked and uploaded
+    std::span<const uint8_t> packedVertices;
+    VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+    // packedVertices compressed with LzCodec as they are read from the mesh cache, in which case packedVertices is
+    // empty. They are uploaded as they are and expanded on the GPU
+    std::span<const uint8_t> compressedVertices;
+    // full precision indices as imported, released once they are packed
+    std::span<const glm::u32vec3> faces;
+    // indices in the indexSize of their submesh, which is what is cooked and uploaded
+    std::span<const uint8_t> packedIndices;
+    std::vector<Submesh> submeshes;
+    std::vector<Meshlet> meshlets;
+    std::vector<Lod> lods;
+    std::vector<Node> nodes;
+    // submesh indices of every node, a submesh several nodes refer to is instanced
+    std::vector<uint32_t> nodeSubmeshes;
+    std::vector<Material> materials;
+    std::vector<Texture> textures;
+
+    std::vector<Vertex> vertexStorage;
+    std::vector<uint8_t> packedVertexStorage;
+    std::vector<glm::u32vec3> faceStorage;
+    std::vector<uint8_t> packedIndexStorage;
+    std::vector<std::vector<uint8_t>> textureStorage;
+    std::shared_ptr<const MappedFile> mapping;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include "MeshData.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <span>
+
+// Import time reordering of every submesh for the vertex stage, in three steps following Sander et al., "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw":
+//  - Tipsify orders triangles for the post transform vertex cache
+//  - the resulting clusters are split where that costs little cache efficiency and sorted so outward facing clusters,
+//    which are likely to occlude the rest, are drawn first
+//  - vertices are renumbered in the order the triangles first use them, so vertex fetch walks memory linearly
+// It works on the full precision vertices, so it has to run before they are packed.
+struct MeshOptimizer
+{
+    // entries of the simulated FIFO cache, a conservative size for current GPUs
+    static constexpr uint32_t CacheSize = 16;
+
+    struct Stats
+    {
+        uint64_t numTriangles = 0;
+        uint64_t numVertices = 0;
+        uint64_t cacheMisses = 0;
+
+        // average cache miss ratio, transformed vertices per triangle. 0.5 is the bound for large regular meshes
+        [[nodiscard]] double getAcmr() const;
+        // average transform to vertex ratio, transformed vertices per referenced vertex. 1 is optimal
+        [[nodiscard]] double getAtvr() const;
+    };
+
+    [[nodiscard]] static Stats Analyze(const MeshData &data);
+    static void Optimize(MeshData &data, ThreadPool &threadPool);
+    // only the Tipsify step, for index lists that aren't a submesh. indices are below numVertices
+    static void OptimizeVertexCache(const std::span<uint32_t> &indices, uint32_t numVertices);
+};
@@ -0,0 +1,18 @@
+#pragma once
+#include "MeshData.h"
+#include "ThreadPool.h"
+#include <cstdint>
+
+// Splits every submesh into meshlets: runs of consecutive triangles that reference at most MaxVertices vertices and
+// hold at most MaxTriangles triangles. Since MeshOptimizer already ordered the triangles for the vertex cache, cutting
+// that order greedily gives compact meshlets without reordering the indices again. Each meshlet gets a bounding sphere
+// and a normal cone, so whole meshlets can be culled when they are outside the frustum or facing away from the camera.
+// Works on the full precision vertices, so it has to run before they are packed.
+struct MeshletBuilder
+{
+    // limits commonly used for mesh shaders, which keeps the meshlets usable for them later
+    static constexpr uint32_t MaxVertices = 64;
+    static constexpr uint32_t MaxTriangles = 124;
+
+    static void Build(MeshData &data, ThreadPool &threadPool);
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include "MappedFile.h"
+#include "MeshData.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <string>
+
+// Native loader for Wavefront .obj files. The mapped file is cut into line aligned chunks that are parsed on the
+// thread pool: a first pass counts the attributes of every chunk so that the second can place them and resolve
+// relative indices without waiting on its neighbours, then vertices are deduplicated per chunk and stitched together.
+// Every usemtl starts a submesh, materials only carry their diffuse color since the renderer only uses embedded
+// textures, and normals missing from the file are generated by averaging the face normals around each position.
+struct ObjLoader
+{
+    // identifies meshes imported by this loader in the mesh cache key, Assimp imports always use non zero flags
+    static constexpr uint32_t ImportFlags = 0;
+
+    [[nodiscard]] static bool IsObj(const std::string &path);
+    // path is used to find the material library next to the file
+    [[nodiscard]] static bool Load(const std::string &path, const MappedFile &file, ThreadPool &threadPool, MeshData &data);
+};
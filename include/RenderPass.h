@@ -17,6 +17,8 @@ class RenderPass
     virtual void resize(uint32_t width, uint32_t height){};
     virtual void draw(VkCommandBuffer buffer, uint32_t frameIdx) = 0;
     void addMesh(Mesh *mesh);
+    // the join step of Mesh::LoadParallel, the meshes have to stay alive while the pass draws
+    void addMeshes(const std::span<const std::unique_ptr<Mesh>> &meshes);
     void fulfillRenderPassDependencies(VkCommandBuffer cmd, uint32_t frameIdx);
 
   public:
@@ -1,12 +1,20 @@
 #pragma once
-#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
 #include <vulkan/vulkan_core.h>
 
+#include "FrameCapture.h"
+#include "FunctionRef.h"
 #include "GpuResource.h"
 #include "Mesh.h"
 #include "PerFrameResource.h"
 #include "Pipeline.h"
 #include "ResourcePool.h"
+#include "StagingRing.h"
+#include "ThreadPool.h"
 #include "Types.h"
 #include "backends/imgui_impl_vulkan.h"
 
@@ -14,13 +22,23 @@ class Renderer
 {
   public:
     static constexpr uint32_t MaxFramesInFlight = 3;
+    static constexpr VkDeviceSize StagingRingSize = 128 * 1024 * 1024;
+    static constexpr VkDeviceSize StagingAlignment = 16;
+    static constexpr VkFormat TextureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    static constexpr VkDeviceSize MaxUploadChunkSize = 4 * 1024 * 1024;
+    static constexpr VkDeviceSize MaxDecodingBytes = 256 * 1024 * 1024;
+    static constexpr UploadToken PendingUploadToken = {std::numeric_limits<uint64_t>::max()};
+    static constexpr uint32_t MaxTimedSubmissions = 64;
+    static constexpr uint32_t NoTimestampQuery = std::numeric_limits<uint32_t>::max();
+    static constexpr VkDeviceSize VertexBufferSize = 256 * 1024 * 1024;
+    static constexpr VkDeviceSize IndexBufferSize = 128 * 1024 * 1024;
 
   public:
     static Renderer &Get();
     VkDevice getDevice();
     VmaAllocator getAllocator();
     PerFrameImage getSwapchainImages();
-    VkDescriptorPool getDescriptorPool();
+    ThreadPool &getThreadPool();
 
     void initImGuiGlfwVulkan(VkRenderPass renderPass);
     void shutdownImGuiGlfwVulkan();
@@ -33,7 +51,9 @@ class Renderer
     uint32_t curFrame();
     uint32_t frameCount();
 
+    // both safe to call from several threads at once
     VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout);
+    void freeDescriptorSets(const std::span<const VkDescriptorSet> &descriptorSets);
     const SwapchainInfo &getSwapchainInfo();
     void addRenderPass(RenderPass *renderPass);
 
@@ -41,7 +61,7 @@ class Renderer
     ~Renderer();
 
     Handle<Buffer> uploadBufferToGpu(VkBuffer src, const Buffer::State &&dstState);
-    Handle<Image> uploadImageToGpu(VkBuffer src, const Image::State &&dstState);
+    Handle<Image> uploadImageToGpu(VkBuffer src, const Image::State &&dstState, VkDeviceSize srcOffset = 0);
 
     struct DescriptorUpdateState
     {
@@ -67,11 +87,91 @@ class Renderer
     };
     void writeDescriptor(const DescriptorWriteState &descriptorUpdateState);
 
-    void transferImmediate(std::function<void(VkCommandBuffer cmd)> &&function);
-    void graphicsImmediate(std::function<void(VkCommandBuffer cmd)> &&function);
+    struct UploadInfo
+    {
+        VkBuffer src;
+        VkImage dst;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels = 1;
+        VkDeviceSize srcOffset = 0;
+    };
+
+    // Immediate submissions may be issued from any thread. The blocking variants wait for the GPU before returning,
+    // submitImmediate returns as soon as the work is queued and its token is waited on with waitImmediate.
+    void transferImmediate(FunctionRef<void(VkCommandBuffer cmd)> function);
+    void graphicsImmediate(FunctionRef<void(VkCommandBuffer cmd)> function);
+    [[nodiscard]] ImmediateToken submitImmediate(QueueFamily family, FunctionRef<void(VkCommandBuffer cmd)> function);
+    bool isImmediateComplete(ImmediateToken token);
+    void waitImmediate(ImmediateToken token);
     Handle<Image> uploadTextureToGpu(const std::span<uint8_t> &buf, uint32_t width, uint32_t height);
+
+    // Either raw RGBA8 texels in `data` or a compressed image in `encoded`, which is decoded directly into staging memory.
+    // Texels that were already decoded are passed in `staging`, a held region of the staging ring that the upload claims
+    // or a dedicated buffer that it frees.
+    struct TextureUpload
+    {
+        std::span<const uint8_t> data = {};
+        std::span<const uint8_t> encoded = {};
+        uint32_t width = 0;
+        uint32_t height = 0;
+        StagingAllocation staging = {};
+    };
+    // Uploads every texture with a single transfer submission and a single ownership acquire on the graphics
+    // queue, waiting once for the whole set rather than once per image. Compressed textures are decoded in parallel
+    // on the thread pool.
+    std::vector<Handle<Image>> uploadTexturesToGpu(const std::span<TextureUpload> &textures);
     Handle<Buffer> uploadCpuBufferToGpu(const std::span<uint8_t> &buf, VkBufferUsageFlags usage);
 
+    // Asynchronous uploads return as soon as the copy is submitted to the transfer queue. The destination
+    // must not be read by the GPU until isUploadComplete returns true for the returned token.
+    UploadToken uploadToBufferAsync(const std::span<const uint8_t> &buf, Handle<Buffer> dst, VkDeviceSize dstOffset = 0);
+    Handle<Buffer> uploadCpuBufferToGpuAsync(const std::span<uint8_t> &buf, VkBufferUsageFlags usage, UploadToken &token);
+    bool isUploadComplete(UploadToken token);
+    void waitForUpload(UploadToken token);
+    void retireUploads();
+
+    // Scheduled uploads are spread over frames by processUploads, which runs at the start of every draw and issues
+    // at most the configured budget of work. Lower priority values are uploaded first, e.g. distance to the camera.
+    // Waiting on a ticket that hasn't been scheduled yet uploads it immediately, cancelling it drops it instead and
+    // only waits for copies already submitted. Buffers and textures can be created and their uploads requested from
+    // any thread, everything else about them is left to the render thread.
+    Handle<Buffer> createGpuBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+    UploadTicket requestBufferUpload(const std::span<const uint8_t> &src, Handle<Buffer> dst, VkDeviceSize dstOffset = 0,
+                                     float priority = 0.0f);
+    UploadTicket requestTextureUpload(const TextureUpload &texture, Handle<Image> &dst, float priority = 0.0f);
+    // The LzCodec payload crosses to the GPU as it is and is expanded into dst by a compute shader on the graphics queue.
+    // That takes a geometry buffer and a dstOffset that is a multiple of 4. Other destinations, host visible ones,
+    // payloads larger than the staging ring and requests waited on before they were scheduled are expanded on the CPU
+    UploadTicket requestCompressedBufferUpload(const std::span<const uint8_t> &compressed, Handle<Buffer> dst,
+                                               VkDeviceSize dstOffset = 0, float priority = 0.0f);
+    // Textures shared by every mesh, keyed by the hash of their contents so an image used by several assets is uploaded
+    // and resident once. Every acquire takes a reference and returns the ticket of the image's upload, which only the
+    // first one requests, so its source has to outlive the ticket. Releasing a reference waits for a pending upload
+    // while the image is still used by others, the last release cancels it and destroys the image. A texture whose size
+    // differs from the cached image of its hash gets an image of its own instead, the ticket passed on release tells the
+    // two apart. Acquiring is safe from several threads at once, releasing waits on and cancels uploads, which is left
+    // to the render thread like the rest of the transfer state
+    UploadTicket acquireTexture(uint64_t contentHash, const TextureUpload &texture, Handle<Image> &dst, float priority = 0.0f);
+    void releaseTexture(uint64_t contentHash, UploadTicket ticket);
+    // The vertices and indices of every mesh live in two shared buffers addressed by offsets, so the draws of different
+    // meshes don't rebind them. The alignment doesn't have to be a power of two, a vertex stride works too. Fails when
+    // the buffer is full. Safe to call from several threads at once
+    [[nodiscard]] bool allocateGeometry(GeometryBuffer buffer, VkDeviceSize size, VkDeviceSize alignment, GeometryAllocation &allocation);
+    void freeGeometry(const GeometryAllocation &allocation);
+    Handle<Buffer> getGeometryBuffer(GeometryBuffer buffer);
+    void setUploadPriority(UploadTicket ticket, float priority);
+    void setUploadBudget(const UploadBudget &budget);
+    bool isUploadComplete(UploadTicket ticket);
+    void waitForUpload(UploadTicket ticket);
+    void cancelUpload(UploadTicket ticket);
+    void processUploads();
+
+    // Cumulative counters of every upload path, split into bytes moved, cpu time spent copying and decoding, time
+    // blocked waiting for the GPU and GPU time of the copies measured with timestamp queries.
+    UploadStats getUploadStats();
+    void resetUploadStats();
+
     Handle<Image> create(const Image::State &&state);
     Image *get(Handle<Image> handle);
     void destroy(Handle<Image> handle);
@@ -112,6 +212,40 @@ class Renderer
     PerFrameImage m_swapchainImages;
     RenderContext m_renderContext = {};
     TransferQueue m_transferQueue = {};
+    StagingRing m_stagingRing = {};
+    UploadBudget m_uploadBudget = {};
+    // guards m_uploadStats and the timestamp query slots of m_transferQueue, which any uploading thread touches
+    UploadStats m_uploadStats = {};
+    std::mutex m_uploadStatsMutex;
+    ThreadPool m_threadPool;
+    // only created when PACEM_CAPTURE_DIR is set
+    std::unique_ptr<FrameCapture> m_frameCapture;
+    std::mutex m_immediateMutex;
+    std::mutex m_queueSubmitMutex;
+    // guards the resource pools, so meshes can be created on several threads
+    std::mutex m_resourceMutex;
+    std::mutex m_descriptorMutex;
+    // the pool every allocated descriptor set came from, guarded by m_descriptorMutex
+    std::unordered_map<VkDescriptorSet, VkDescriptorPool> m_descriptorSetPools;
+    std::mutex m_uploadRequestMutex;
+    struct CachedTexture
+    {
+        Handle<Image> image;
+        UploadTicket ticket;
+        uint32_t refCount = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+    std::unordered_map<uint64_t, CachedTexture> m_textureCache;
+    // images of textures that collided with a cached one of a different size, by the id of their upload's ticket
+    std::unordered_map<uint64_t, Handle<Image>> m_privateTextures;
+    std::mutex m_textureCacheMutex;
+    GeometryBuffers m_geometryBuffers = {};
+    std::mutex m_geometryMutex;
+    // Expands compressed payloads from the staging ring into the geometry buffers. Created on first use by the render
+    // thread, with a descriptor set per geometry buffer since both buffers live as long as the renderer
+    ComputePipeline m_decompressPipeline = {};
+    std::array<VkDescriptorSet, static_cast<size_t>(GeometryBuffer::Size)> m_decompressDescriptorSets = {};
     std::vector<RenderPass *> m_renderPasses = {};
     VkDescriptorPool m_imguiDescriptorPool = VK_NULL_HANDLE;
     uint64_t m_frameCount;
@@ -131,17 +265,51 @@ class Renderer
     void destroyDescriptorPools();
     RenderContext createRenderContext();
     TransferQueue createTransferQueue();
+    StagingRing createStagingRing();
+    void createGeometryBuffers();
+    std::unique_ptr<FrameCapture> createFrameCapture();
+    void createDecompressPipeline();
 
     void handleResize();
 
-    struct UploadInfo
-    {
-        VkBuffer &src;
-        Image &dst;
-    };
-    void transferImageImmediate(UploadInfo &info);
+    UploadToken submitImageTransfers(const std::span<UploadInfo> &infos, std::vector<AllocatedBuffer> &&staging);
+    void transferImagesImmediate(const std::span<UploadInfo> &infos);
+    Handle<Image> createTexture(uint32_t width, uint32_t height);
+    UploadToken uploadTexturesToImages(const std::span<TextureUpload> &textures, const std::span<Handle<Image>> &images);
+    VkDeviceSize getTextureStagingSize(const TextureUpload &texture);
+    uint8_t *getHostPointer(const Buffer &buffer);
+
+    StagingAllocation createStagingBuffer(VkDeviceSize size,
+                                          VmaAllocationCreateFlags hostAccess = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+    void startTextureDecodes();
+    TextureUpload takeDecodedTexture(UploadableTexture &transfer);
+    StagingAllocation allocateStaging(VkDeviceSize size);
+    void takeRequestedUploads();
+    VkCommandBuffer beginTransferCommands();
+    UploadToken submitTransferCommands(VkCommandBuffer cmdBuf, const AllocatedBuffer &staging);
+    UploadToken submitGraphicsHandoff(VkCommandBuffer transferCmdBuf, VkPipelineStageFlags waitStageFlags, UploadCategory category,
+                                      FunctionRef<void(VkCommandBuffer cmd)> recordGraphics, std::vector<AllocatedBuffer> &&staging);
+    VkDescriptorSet getDecompressDescriptorSet(VkBuffer dst);
+    bool stageCompressedUpload(const UploadableBuffer &transfer, VkCommandBuffer &cmdBuf, std::vector<DecompressDispatch> &dispatches,
+                               UploadCounters &counters);
+    UploadToken submitDecompression(VkCommandBuffer cmdBuf, const std::span<const DecompressDispatch> &dispatches);
+    UploadToken expandToBufferAsync(const std::span<const uint8_t> &compressed, Handle<Buffer> dst, VkDeviceSize dstOffset);
+    VkFence acquireUploadFence();
+
+    ImmediateContext *acquireImmediateContext(QueueFamily family);
+    VkQueue getQueue(QueueFamily family);
+    VkSemaphore &getTimeline(QueueFamily family);
+    bool hasTimestamps(QueueFamily family);
+    double getTimestampMs(VkQueryPool queryPool, uint32_t firstQuery, QueueFamily family);
+    uint32_t beginTimestamp(VkCommandBuffer cmdBuf);
+    void endTimestamp(VkCommandBuffer cmdBuf, uint32_t query);
+    void retireTimestamp(uint32_t query, UploadCategory category);
+    void addUploadCounters(UploadCategory category, const UploadCounters &counters);
+    uint64_t getTimelineValue(VkSemaphore timeline);
+    void waitTimeline(VkSemaphore timeline, uint64_t value);
 
     void destroyTransferQueue();
+    void destroyGeometryBuffers();
     void destroyRenderContext();
     void freeSwapchainImages();
     void destroyDepthBuffers();
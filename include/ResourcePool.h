@@ -2,6 +2,7 @@
 
 #include "RingBuffer.h"
 #include <cstdint>
+#include <deque>
 #include <limits>
 #include <type_traits>
 #include <vector>
@@ -56,7 +57,8 @@ class Pool
     }
 
   private:
-    std::vector<T> m_data;
+    // a deque so that pointers returned by get stay valid while other resources are created
+    std::deque<T> m_data;
     std::vector<IdxType> m_generations;
     RingBuffer<IdxType, IdxType> m_freeList;
 };
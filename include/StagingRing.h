@@ -0,0 +1,54 @@
+#pragma once
+#include "Types.h"
+#include "vma.h"
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vulkan/vulkan_core.h>
+
+// One persistently mapped upload buffer handed out front to back. Regions are tagged with the value of the
+// submission that reads them and are reclaimed once that submission has completed, so an upload costs a
+// memcpy and a copy command instead of a buffer allocation. Besides being copied from, the buffer is read as a storage
+// buffer, by the decompression of compressed uploads.
+class StagingRing
+{
+  public:
+    StagingRing() = default;
+    // shared concurrently when given more than one queue family
+    StagingRing(VmaAllocator allocator, VkDeviceSize capacity, const std::span<const uint32_t> &queueFamilyIndices);
+
+    [[nodiscard]] bool allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation &allocation);
+    // For staging that is filled ahead of the submission reading it. The region is left out of release until it has
+    // been claimed, and holds back the reclaiming of everything allocated after it until then
+    [[nodiscard]] bool allocateHeld(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation &allocation);
+    // hands a held region to the next release, like a region that was just allocated
+    void claim(const StagingAllocation &allocation);
+    void flush(const StagingAllocation &allocation);
+    void release(uint64_t submissionValue);
+    void retire(uint64_t completedValue);
+    [[nodiscard]] VkDeviceSize capacity();
+    [[nodiscard]] VkBuffer buffer();
+    void destroy();
+
+  private:
+    struct Region
+    {
+        uint64_t submissionValue;
+        uint64_t end;
+    };
+    // submission values of regions that haven't been released yet, neither is ever reached by completed values
+    static constexpr uint64_t Unreleased = UINT64_MAX;
+    static constexpr uint64_t Held = UINT64_MAX - 1;
+
+    VmaAllocator m_allocator = VK_NULL_HANDLE;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    VmaAllocation m_allocation = VK_NULL_HANDLE;
+    uint8_t *m_mappedData = nullptr;
+    VkDeviceSize m_capacity = 0;
+
+    // head and tail only ever grow, the physical offset is the position modulo the capacity
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+    uint64_t m_releasedHead = 0;
+    std::deque<Region> m_regions;
+};
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Decodes compressed images (png, jpg, ...) and RGBA8 texels compressed with LzCodec to RGBA8 texels written into
+// caller provided memory, typically a staging allocation, so the decoded image is never copied through an intermediate
+// heap buffer.
+struct TextureDecoder
+{
+    static constexpr uint32_t NumComponents = 4;
+
+    [[nodiscard]] static bool ReadInfo(const std::span<const uint8_t> &encoded, uint32_t &width, uint32_t &height);
+    // stb_image asks for one byte of slack past the texels for some formats, the destination must be at least this large
+    [[nodiscard]] static size_t GetDecodeSize(uint32_t width, uint32_t height);
+    [[nodiscard]] static bool DecodeRgba8(const std::span<const uint8_t> &encoded, const std::span<uint8_t> &dst);
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads executing jobs in submission order. Jobs must not throw and must not wait on other
+// jobs of the same pool, other than through parallelFor.
+class ThreadPool
+{
+  public:
+    ThreadPool();
+    explicit ThreadPool(uint32_t numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> job);
+    // blocks until every job submitted so far has finished
+    void wait();
+    // runs function for every index in [0, count), the calling thread takes part and returns once all of them are
+    // done. Can be nested in a job of the same pool: the caller works through whatever items no helper has started, so
+    // it only ever waits for items that are already running.
+    void parallelFor(size_t count, const std::function<void(size_t)> &function);
+    [[nodiscard]] uint32_t numThreads();
+
+  private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_jobsDone;
+    uint32_t m_activeJobs = 0;
+    bool m_stopping = false;
+};
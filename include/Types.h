@@ -1,10 +1,16 @@
 #pragma once
 #include "GLFW/glfw3.h"
+#include "ResourcePool.h"
 #include "glm/fwd.hpp"
 #include "vma.h"
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <deque>
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
+#include <memory>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -56,6 +62,7 @@ struct SwapchainInfo
     uint32_t numImages;
     uint32_t height;
     uint32_t width;
+    VkFormat format;
 };
 
 struct AllocatedBuffer
@@ -64,11 +71,11 @@ struct AllocatedBuffer
     VmaAllocation allocation;
 };
 
+// Full precision vertex produced by the importers, the GPU reads one of the packed formats of VertexPacking
 struct Vertex
 {
     glm::vec3 position;
     glm::vec3 normal;
-    glm::vec3 color;
     glm::vec2 textureCoordinate;
 };
 
@@ -79,6 +86,14 @@ struct PushConstants
     glm::mat4 P;
 };
 
+// Pushed for every submesh drawn by the main pass, right after PushConstants
+struct DrawPushConstants
+{
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    glm::vec4 diffuseColor;
+};
+
 struct DepthBuffer
 {
     VkImage depthBuf;
@@ -86,16 +101,187 @@ struct DepthBuffer
     VkImageView depthView;
 };
 
+// Uploads waiting on the upload scheduler. The source memory is owned by the requester and has to stay alive
+// until the request's ticket completes.
 struct UploadableBuffer
 {
-    VkBuffer src;
-    VkBuffer dst;
+    std::span<const uint8_t> src;
+    Handle<Buffer> dst;
+    VkDeviceSize dstOffset = 0;
+    VkDeviceSize uploaded = 0;
+    float priority = 0.0f;
+    uint64_t ticket = 0;
+    // src is an LzCodec payload that expands into dst, it is uploaded whole rather than in chunks
+    bool compressed = false;
 };
 
+struct TextureDecodeJob;
+
 struct UploadableTexture
 {
-    VkBuffer src;
-    VkImage dst;
+    std::span<const uint8_t> data;
+    std::span<const uint8_t> encoded;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    Handle<Image> dst;
+    float priority = 0.0f;
+    uint64_t ticket = 0;
+    bool scheduled = false;
+    // compressed textures are decoded on the thread pool ahead of their upload
+    std::shared_ptr<TextureDecodeJob> decodeJob;
+};
+
+enum class QueueFamily
+{
+    Transfer,
+    Graphics,
+
+    Size
+};
+
+// Returned by asynchronous uploads, a value of 0 refers to work that has already completed
+struct UploadToken
+{
+    uint64_t value = 0;
+};
+
+// Returned by the upload scheduler, complete once every byte of the request has reached the GPU
+struct UploadTicket
+{
+    uint64_t id = 0;
+};
+
+// Upload work the scheduler may issue each frame, a single texture larger than the budget is still uploaded whole
+struct UploadBudget
+{
+    VkDeviceSize maxBytesPerFrame = 32 * 1024 * 1024;
+    float maxMillisecondsPerFrame = 2.0f;
+};
+
+enum class UploadCategory
+{
+    Buffer,
+    Texture,
+    Immediate,
+
+    Size
+};
+
+// Running totals of one kind of upload, all times are in milliseconds. Immediate submissions run arbitrary commands,
+// so only their wait and GPU time are known.
+struct UploadCounters
+{
+    uint64_t submissions = 0;
+    uint64_t bytes = 0;
+    double memcpyMs = 0.0;
+    double decodeMs = 0.0;
+    double waitMs = 0.0;
+    double gpuMs = 0.0;
+};
+
+struct UploadStats
+{
+    std::array<UploadCounters, static_cast<size_t>(UploadCategory::Size)> counters = {};
+    // GPU times stay at zero when the transfer queue doesn't support timestamps
+    bool gpuTimestamps = false;
+};
+
+// A region of host visible memory that uploads are copied from. `dedicated` is only set when the
+// request didn't fit in the staging ring and a buffer had to be created for it.
+struct StagingAllocation
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint8_t *data = nullptr;
+    AllocatedBuffer dedicated = {};
+};
+
+// Decode of a scheduled texture running on the thread pool, straight into a held region of the staging ring or a
+// staging buffer of its own. The worker sets done once the texels have been written and flushed.
+struct TextureDecodeJob
+{
+    StagingAllocation staging = {};
+    double decodeMs = 0.0;
+    std::atomic<bool> done = false;
+};
+
+// A transfer submission that has not been observed as complete yet. Submissions on a queue complete in order,
+// so retiring them front to back gives a monotonically increasing completed value.
+struct InFlightUpload
+{
+    uint64_t value = 0;
+    VkFence fence = VK_NULL_HANDLE;
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    // dedicated staging buffers, destroyed once the upload has completed
+    std::vector<AllocatedBuffer> staging;
+    // pair of timestamp queries around the submission's commands, NoTimestampQuery if it isn't timed
+    uint32_t timestampQuery = UINT32_MAX;
+    UploadCategory category = UploadCategory::Buffer;
+
+    // Texture uploads are finished by a second submission on the graphics queue that acquires the images and builds
+    // their mip chains, compressed buffers by one that expands them. It waits on the copies through the transfer timeline
+    // or the binary semaphore, and completes the upload at graphicsValue on the graphics timeline or by signalling the
+    // fence.
+    VkCommandBuffer graphicsCmdBuf = VK_NULL_HANDLE;
+    uint64_t graphicsValue = 0;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+};
+
+// see lzDecompress.comp, offsets and sizes are in bytes
+struct DecompressPushConstants
+{
+    uint32_t numBlocks;
+    uint32_t blockSize;
+    uint32_t uncompressedSize;
+    uint32_t blockDataOffset;
+    uint32_t srcOffset;
+    uint32_t dstOffset;
+};
+
+// A compressed payload in the staging ring and where it expands to, descriptorSet binds the ring and the destination
+struct DecompressDispatch
+{
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    DecompressPushConstants pushConstants = {};
+};
+
+// Every immediate context owns its command pool so that several threads can record at the same time.
+struct ImmediateContext
+{
+    QueueFamily family;
+    VkCommandPool commandPool;
+    VkCommandBuffer cmdBuf;
+    VkFence fence;
+    uint64_t timelineValue;
+    // two timestamps around the recorded commands, null if the queue doesn't support timestamps
+    VkQueryPool queryPool;
+};
+
+enum class GeometryBuffer
+{
+    Vertex,
+    Index,
+
+    Size
+};
+
+// A range of one of the geometry buffers shared by every mesh, see Renderer::allocateGeometry
+struct GeometryAllocation
+{
+    GeometryBuffer buffer = GeometryBuffer::Vertex;
+    // null for empty ranges
+    VmaVirtualAllocation allocation = VK_NULL_HANDLE;
+    // in bytes from the start of the buffer
+    VkDeviceSize offset = 0;
+};
+
+// The vertex and index buffers every mesh is sub allocated from, VMA virtual blocks track which of their ranges are
+// in use. Created on first use and guarded by Renderer::m_geometryMutex
+struct GeometryBuffers
+{
+    std::array<Handle<Buffer>, static_cast<size_t>(GeometryBuffer::Size)> buffers;
+    std::array<VmaVirtualBlock, static_cast<size_t>(GeometryBuffer::Size)> blocks = {};
 };
 
 struct TransferQueue
@@ -104,10 +290,40 @@ struct TransferQueue
     VkQueue graphicsQueue;
     VkCommandPool transferCommandPool;
     VkCommandPool graphicsCommandPool;
-    VkCommandBuffer immCmdBuf;
-    VkCommandBuffer eofCmdBuf;
-    VkCommandBuffer graphicsCmdBuf;
     std::vector<UploadableBuffer> transfers;
+    std::vector<UploadableTexture> textureTransfers;
+    // Requests can be made from any thread, they wait here under Renderer::m_uploadRequestMutex until the render thread
+    // takes them into transfers and textureTransfers, which only it touches
+    std::vector<UploadableBuffer> requestedTransfers;
+    std::vector<UploadableTexture> requestedTextureTransfers;
+    uint64_t lastTicket = 0;
+    // tickets that haven't completed yet, mapped to the submission that finishes them once they have been scheduled
+    std::unordered_map<uint64_t, UploadToken> ticketTokens;
+    // staging memory held by decode jobs whose texture hasn't been uploaded yet
+    VkDeviceSize decodingBytes = 0;
+
+    // contexts live in a deque so that pointers to them stay valid as the pool grows
+    std::deque<ImmediateContext> immediateContexts;
+    std::array<std::vector<ImmediateContext *>, static_cast<size_t>(QueueFamily::Size)> freeImmediateContexts;
+
+    // With timeline semaphores every submission to a queue signals the next value of that queue's timeline, so the
+    // transfer timeline's value is submittedValue and the fences of in flight uploads are left null.
+    VkSemaphore transferTimeline = VK_NULL_HANDLE;
+    VkSemaphore graphicsTimeline = VK_NULL_HANDLE;
+    uint64_t graphicsSubmittedValue = 0;
+
+    uint64_t submittedValue = 0;
+    uint64_t completedValue = 0;
+    std::deque<InFlightUpload> inFlight;
+    std::vector<VkFence> freeFences;
+    std::vector<VkCommandBuffer> freeCmdBufs;
+    std::vector<VkCommandBuffer> freeGraphicsCmdBufs;
+
+    // timestamp query pairs for transfer submissions, the pair of the command buffer being recorded is held in
+    // recordingTimestampQuery until it is submitted
+    VkQueryPool timestampPool = VK_NULL_HANDLE;
+    std::vector<uint32_t> freeTimestampQueries;
+    uint32_t recordingTimestampQuery = UINT32_MAX;
 };
 
 struct QueueInfo
@@ -125,6 +341,10 @@ struct DeviceInfo
     uint32_t presentQueueFamily;
     uint32_t graphicsQueueFamily;
     uint32_t transferQueueFamily;
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    bool timelineSemaphores = false;
+    // queries are reset on the host, which transfer only queues can't do with vkCmdResetQueryPool
+    bool hostQueryReset = false;
 };
 
 struct RenderContext
@@ -132,16 +352,16 @@ struct RenderContext
     std::vector<VkSemaphore> imgAvailableSem;
     std::vector<VkSemaphore> renderDoneSem;
     std::vector<VkFence> fences;
+    // graphics timeline value signalled by each frame's submission, replaces the fences when timelines are in use
+    std::vector<uint64_t> frameTimelineValues;
     std::vector<VkCommandPool> commandPools;
     std::vector<VkCommandBuffer> commandBuffers;
 };
 
-enum class QueueFamily
+// Returned by non-blocking immediate submissions, must be passed to Renderer::waitImmediate exactly once
+struct ImmediateToken
 {
-    Transfer,
-    Graphics,
-
-    Size
+    ImmediateContext *context = nullptr;
 };
 
 struct VmaAllocationState
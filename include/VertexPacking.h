@@ -0,0 +1,22 @@
+#pragma once
+#include "MeshData.h"
+#include "VkTypes.h"
+#include <cstdint>
+#include <span>
+
+// Converts the full precision vertices of the importers into the layout the main pass reads. Every format drops the
+// per vertex color, which comes from the material, and stores normals octahedral encoded in two components:
+//  - VERTEX_FORMAT_FLOAT: fp32 position, normal and uv, 28 bytes
+//  - VERTEX_FORMAT_HALF: fp16 position and uv, snorm16 normal, 16 bytes
+//  - VERTEX_FORMAT_SNORM16: snorm16 position and normal, fp16 uv, 16 bytes
+// The compact formats store positions relative to the bounds of their submesh, which the vertex shader undoes with
+// the submesh's positionScale and positionOffset.
+struct VertexPacking
+{
+    // PACEM_VERTEX_FORMAT selects float, half or snorm16, the default
+    [[nodiscard]] static MeshData::VertexFormat GetSelectedFormat();
+    [[nodiscard]] static uint32_t GetStride(MeshData::VertexFormat format);
+    [[nodiscard]] static std::span<const VertexInputAttributeDescription> GetAttributeDescs(MeshData::VertexFormat format);
+    // fills packedVertices and the dequantization transform of every submesh, then releases the full precision vertices
+    static void Pack(MeshData::VertexFormat format, MeshData &data);
+};
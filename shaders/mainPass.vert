@@ -1,16 +1,20 @@
 // we will be using glsl version 4.5 syntax
 #version 450
 
+// layout selected by VertexPacking, every format is read as the same types
 layout(location = 0) in vec3 vertPosition;
-layout(location = 1) in vec3 vertNormal;
-layout(location = 2) in vec3 vertColor;
-layout(location = 3) in vec2 texCoord;
+layout(location = 1) in vec2 vertNormalOctahedral;
+layout(location = 2) in vec2 texCoord;
 
 layout(push_constant) uniform constants
 {
     mat4 model;
     mat4 view;
     mat4 projection;
+    // per submesh
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 diffuseColor;
 }
 PushConstants;
 
@@ -19,14 +23,24 @@ layout(location = 1) out vec3 vertNormalOut;
 layout(location = 2) out vec2 texCoordOut;
 layout(location = 3) out vec3 vertPositionOut;
 
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -fold : fold;
+    normal.y += normal.y >= 0.0f ? -fold : fold;
+    return normalize(normal);
+}
+
 void main()
 {
+    vec3 position = vertPosition * PushConstants.positionScale.xyz + PushConstants.positionOffset.xyz;
 
     // output the position of each vertex
     mat4 MVP = PushConstants.projection * PushConstants.view * PushConstants.model;
-    gl_Position = MVP * vec4(vertPosition, 1.0f);
-    vertColorOut = vertColor;
-    vertNormalOut = vertNormal;
+    gl_Position = MVP * vec4(position, 1.0f);
+    vertColorOut = PushConstants.diffuseColor.rgb;
+    vertNormalOut = decodeOctahedral(vertNormalOctahedral);
     texCoordOut = texCoord;
-    vertPositionOut = vertPosition;
+    vertPositionOut = position;
 }
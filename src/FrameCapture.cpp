@@ -0,0 +1,202 @@
+#include "FrameCapture.h"
+#include "Common.h"
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+FrameCapture::FrameCapture(VmaAllocator allocator, ThreadPool &threadPool, const std::string &outputDir)
+    : m_allocator(allocator)
+    , m_threadPool(threadPool)
+    , m_outputDir(outputDir)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_outputDir, error);
+    if (error)
+    {
+        std::cerr << "Failed to create capture directory " << m_outputDir << ": " << error.message() << std::endl;
+    }
+    std::cout << "Capturing frames to " << m_outputDir << std::endl;
+}
+
+FrameCapture::~FrameCapture()
+{
+    m_threadPool.wait();
+    for (Slot &slot : m_slots)
+    {
+        if (slot.buffer != VK_NULL_HANDLE)
+        {
+            vmaDestroyBuffer(m_allocator, slot.buffer, slot.allocation);
+        }
+    }
+    std::cout << "Captured " << m_numCaptured << " frames, dropped " << m_numDropped << std::endl;
+}
+
+void FrameCapture::ensureCapacity(Slot &slot, VkDeviceSize size)
+{
+    if (slot.size >= size)
+    {
+        return;
+    }
+
+    if (slot.buffer != VK_NULL_HANDLE)
+    {
+        vmaDestroyBuffer(m_allocator, slot.buffer, slot.allocation);
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // the cpu reads every texel back, which needs cached memory to be fast
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocationInfo = {};
+    VK_LOG_ERR_FATAL(
+        vmaCreateBuffer(m_allocator, &bufferCreateInfo, &allocationCreateInfo, &slot.buffer, &slot.allocation, &allocationInfo));
+    slot.data = static_cast<uint8_t *>(allocationInfo.pMappedData);
+    slot.size = size;
+}
+
+void FrameCapture::record(VkCommandBuffer cmdBuf, uint32_t frameIdx, VkImage image, VkFormat format, uint32_t width, uint32_t height)
+{
+    // dropped frames still use up a number, so gaps in the file names show where frames were skipped
+    uint64_t frameNumber = m_frameNumber++;
+
+    Slot *freeSlot = nullptr;
+    for (uint32_t i = 0; i < NumSlots && !freeSlot; i++)
+    {
+        Slot &slot = m_slots[(m_nextSlot + i) % NumSlots];
+        if (!slot.pending && !slot.encoding.load(std::memory_order_acquire))
+        {
+            freeSlot = &slot;
+            m_nextSlot = (m_nextSlot + i + 1) % NumSlots;
+        }
+    }
+    if (!freeSlot)
+    {
+        m_numDropped++;
+        return;
+    }
+
+    Slot &slot = *freeSlot;
+    ensureCapacity(slot, static_cast<VkDeviceSize>(width) * height * 4);
+    slot.pending = true;
+    slot.frameIdx = frameIdx;
+    slot.frameNumber = frameNumber;
+    slot.format = format;
+    slot.width = width;
+    slot.height = height;
+
+    VkImageMemoryBarrier imageBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    imageBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &imageBarrier);
+
+    VkBufferImageCopy bufferImageCopy = {};
+    bufferImageCopy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    bufferImageCopy.imageExtent = {width, height, 1};
+    vkCmdCopyImageToBuffer(cmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &bufferImageCopy);
+
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = 0;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkBufferMemoryBarrier bufferBarrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = slot.buffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                         nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+}
+
+void FrameCapture::collect(uint32_t frameIdx)
+{
+    for (Slot &slot : m_slots)
+    {
+        if (slot.pending && slot.frameIdx == frameIdx)
+        {
+            submitEncode(slot);
+        }
+    }
+}
+
+void FrameCapture::collectAll()
+{
+    for (Slot &slot : m_slots)
+    {
+        if (slot.pending)
+        {
+            submitEncode(slot);
+        }
+    }
+}
+
+void FrameCapture::submitEncode(Slot &slot)
+{
+    VK_LOG_ERR(vmaInvalidateAllocation(m_allocator, slot.allocation, 0, VK_WHOLE_SIZE));
+    slot.pending = false;
+    slot.encoding.store(true, std::memory_order_relaxed);
+    m_numCaptured++;
+    m_threadPool.submit(
+        [this, &slot]()
+        {
+            encode(slot);
+            slot.encoding.store(false, std::memory_order_release);
+        });
+}
+
+uint64_t FrameCapture::numCaptured()
+{
+    return m_numCaptured;
+}
+
+uint64_t FrameCapture::numDropped()
+{
+    return m_numDropped;
+}
+
+void FrameCapture::encode(Slot &slot)
+{
+    // binary ppm, which is just a header followed by rgb texels, keeps the per frame cpu cost to a swizzle
+    thread_local std::vector<uint8_t> rgb;
+    size_t numTexels = static_cast<size_t>(slot.width) * slot.height;
+    rgb.resize(numTexels * 3);
+
+    bool bgra = slot.format == VK_FORMAT_B8G8R8A8_UNORM || slot.format == VK_FORMAT_B8G8R8A8_SRGB;
+    const uint8_t *src = slot.data;
+    for (size_t i = 0; i < numTexels; i++)
+    {
+        rgb[i * 3 + 0] = src[i * 4 + (bgra ? 2 : 0)];
+        rgb[i * 3 + 1] = src[i * 4 + 1];
+        rgb[i * 3 + 2] = src[i * 4 + (bgra ? 0 : 2)];
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "frame_%06llu.ppm", static_cast<unsigned long long>(slot.frameNumber));
+    std::filesystem::path path = std::filesystem::path(m_outputDir) / fileName;
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", slot.width, slot.height);
+    fwrite(rgb.data(), 1, rgb.size(), file);
+    fclose(file);
+}
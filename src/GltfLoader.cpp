@@ -0,0 +1,935 @@
+#include "GltfLoader.h"
+#include "TextureDecoder.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t GlbMagic = 0x46546c67; // "glTF"
+    constexpr uint32_t GlbVersion = 2;
+    constexpr uint32_t ChunkJson = 0x4e4f534a; // "JSON"
+    constexpr uint32_t ChunkBin = 0x004e4942;  // "BIN\0"
+
+    constexpr uint32_t ComponentByte = 5120;
+    constexpr uint32_t ComponentUnsignedByte = 5121;
+    constexpr uint32_t ComponentShort = 5122;
+    constexpr uint32_t ComponentUnsignedShort = 5123;
+    constexpr uint32_t ComponentUnsignedInt = 5125;
+    constexpr uint32_t ComponentFloat = 5126;
+
+    constexpr uint32_t ModeTriangles = 4;
+    // the largest stride the glTF spec allows for a vertex buffer view
+    constexpr uint64_t MaxByteStride = 252;
+
+    // Just enough of a JSON DOM for the glTF header, which is small next to the binary chunk so the parser favors
+    // simplicity over speed
+    struct JsonValue
+    {
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string string = {};
+        // elements of arrays, values of objects
+        std::vector<JsonValue> values = {};
+        std::vector<std::string> keys = {};
+
+        [[nodiscard]] const JsonValue *find(std::string_view key) const
+        {
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                if (keys[i] == key)
+                {
+                    return &values[i];
+                }
+            }
+            return nullptr;
+        }
+
+        [[nodiscard]] const JsonValue *at(size_t idx) const
+        {
+            return type == Type::Array && idx < values.size() ? &values[idx] : nullptr;
+        }
+
+        [[nodiscard]] double getNumber(std::string_view key, double fallback) const
+        {
+            const JsonValue *value = find(key);
+            return value && value->type == Type::Number ? value->number : fallback;
+        }
+
+        // Indices, counts and byte sizes arrive as doubles, which hold every integer up to 2^53 exactly. Anything that
+        // isn't a whole number in [0, max] fails, NaN and infinities included, so the result can be cast safely.
+        [[nodiscard]] bool getUint(uint64_t max, uint64_t &result) const
+        {
+            constexpr double MaxExactInteger = 9007199254740992.0;
+            double limit = std::min(static_cast<double>(max), MaxExactInteger);
+            if (type != Type::Number || !(number >= 0.0) || number > limit || number != std::floor(number))
+            {
+                return false;
+            }
+            result = static_cast<uint64_t>(number);
+            return true;
+        }
+
+        // an absent key yields the fallback, a present one has to pass getUint
+        [[nodiscard]] bool getUint(std::string_view key, uint64_t fallback, uint64_t max, uint64_t &result) const
+        {
+            const JsonValue *value = find(key);
+            if (!value)
+            {
+                result = fallback;
+                return true;
+            }
+            return value->getUint(max, result);
+        }
+
+        [[nodiscard]] std::string_view getString(std::string_view key) const
+        {
+            const JsonValue *value = find(key);
+            return value && value->type == Type::String ? std::string_view(value->string) : std::string_view();
+        }
+
+        [[nodiscard]] const JsonValue &getArray(std::string_view key) const
+        {
+            static const JsonValue empty = {.type = Type::Array};
+            const JsonValue *value = find(key);
+            return value && value->type == Type::Array ? *value : empty;
+        }
+    };
+
+    class JsonParser
+    {
+      public:
+        explicit JsonParser(std::string_view text)
+            : m_text(text)
+        {
+        }
+
+        [[nodiscard]] bool parse(JsonValue &value)
+        {
+            if (!parseValue(value, 0))
+            {
+                return false;
+            }
+            skipWhitespace();
+            return m_pos == m_text.size();
+        }
+
+      private:
+        // glTF nests a handful of levels deep, the limit only guards the stack against malicious files
+        static constexpr uint32_t MaxDepth = 64;
+
+        void skipWhitespace()
+        {
+            for (; m_pos < m_text.size(); m_pos++)
+            {
+                char c = m_text[m_pos];
+                if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                {
+                    return;
+                }
+            }
+        }
+
+        [[nodiscard]] bool consume(char c)
+        {
+            skipWhitespace();
+            if (m_pos < m_text.size() && m_text[m_pos] == c)
+            {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool consumeLiteral(std::string_view literal)
+        {
+            if (m_text.substr(m_pos, literal.size()) != literal)
+            {
+                return false;
+            }
+            m_pos += literal.size();
+            return true;
+        }
+
+        [[nodiscard]] bool parseHex(uint32_t &codePoint)
+        {
+            if (m_text.size() - m_pos < 4)
+            {
+                return false;
+            }
+            auto result = std::from_chars(m_text.data() + m_pos, m_text.data() + m_pos + 4, codePoint, 16);
+            m_pos += 4;
+            return result.ec == std::errc() && result.ptr == m_text.data() + m_pos;
+        }
+
+        static void appendUtf8(std::string &dst, uint32_t codePoint)
+        {
+            if (codePoint < 0x80)
+            {
+                dst.push_back(static_cast<char>(codePoint));
+            }
+            else if (codePoint < 0x800)
+            {
+                dst.push_back(static_cast<char>(0xc0 | codePoint >> 6));
+                dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+            else if (codePoint < 0x10000)
+            {
+                dst.push_back(static_cast<char>(0xe0 | codePoint >> 12));
+                dst.push_back(static_cast<char>(0x80 | (codePoint >> 6 & 0x3f)));
+                dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+            else
+            {
+                dst.push_back(static_cast<char>(0xf0 | codePoint >> 18));
+                dst.push_back(static_cast<char>(0x80 | (codePoint >> 12 & 0x3f)));
+                dst.push_back(static_cast<char>(0x80 | (codePoint >> 6 & 0x3f)));
+                dst.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+            }
+        }
+
+        [[nodiscard]] bool parseString(std::string &dst)
+        {
+            if (!consume('"'))
+            {
+                return false;
+            }
+            while (m_pos < m_text.size())
+            {
+                char c = m_text[m_pos++];
+                if (c == '"')
+                {
+                    return true;
+                }
+                if (c != '\\')
+                {
+                    dst.push_back(c);
+                    continue;
+                }
+                if (m_pos == m_text.size())
+                {
+                    return false;
+                }
+
+                char escaped = m_text[m_pos++];
+                uint32_t codePoint = 0;
+                switch (escaped)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    dst.push_back(escaped);
+                    break;
+                case 'b':
+                    dst.push_back('\b');
+                    break;
+                case 'f':
+                    dst.push_back('\f');
+                    break;
+                case 'n':
+                    dst.push_back('\n');
+                    break;
+                case 'r':
+                    dst.push_back('\r');
+                    break;
+                case 't':
+                    dst.push_back('\t');
+                    break;
+                case 'u':
+                    if (!parseHex(codePoint))
+                    {
+                        return false;
+                    }
+                    // surrogate pairs encode code points outside the basic plane
+                    if (codePoint >= 0xd800 && codePoint < 0xdc00)
+                    {
+                        uint32_t low = 0;
+                        if (!consumeLiteral("\\u") || !parseHex(low) || low < 0xdc00 || low >= 0xe000)
+                        {
+                            return false;
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(dst, codePoint);
+                    break;
+                default:
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool parseValue(JsonValue &value, uint32_t depth)
+        {
+            if (depth > MaxDepth)
+            {
+                return false;
+            }
+
+            skipWhitespace();
+            if (m_pos == m_text.size())
+            {
+                return false;
+            }
+
+            switch (m_text[m_pos])
+            {
+            case '{':
+                m_pos++;
+                value.type = JsonValue::Type::Object;
+                if (consume('}'))
+                {
+                    return true;
+                }
+                do
+                {
+                    std::string &key = value.keys.emplace_back();
+                    if (!parseString(key) || !consume(':') || !parseValue(value.values.emplace_back(), depth + 1))
+                    {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume('}');
+            case '[':
+                m_pos++;
+                value.type = JsonValue::Type::Array;
+                if (consume(']'))
+                {
+                    return true;
+                }
+                do
+                {
+                    if (!parseValue(value.values.emplace_back(), depth + 1))
+                    {
+                        return false;
+                    }
+                } while (consume(','));
+                return consume(']');
+            case '"':
+                value.type = JsonValue::Type::String;
+                return parseString(value.string);
+            case 't':
+                value.type = JsonValue::Type::Bool;
+                value.boolean = true;
+                return consumeLiteral("true");
+            case 'f':
+                value.type = JsonValue::Type::Bool;
+                return consumeLiteral("false");
+            case 'n':
+                return consumeLiteral("null");
+            default:
+            {
+                value.type = JsonValue::Type::Number;
+                auto result = std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), value.number);
+                if (result.ec != std::errc())
+                {
+                    return false;
+                }
+                m_pos = result.ptr - m_text.data();
+                return true;
+            }
+            }
+        }
+
+        std::string_view m_text;
+        size_t m_pos = 0;
+    };
+
+    [[nodiscard]] uint32_t readU32(const uint8_t *src)
+    {
+        uint32_t value;
+        std::memcpy(&value, src, sizeof(value));
+        return value;
+    }
+
+    [[nodiscard]] uint32_t getComponentSize(uint32_t componentType)
+    {
+        switch (componentType)
+        {
+        case ComponentByte:
+        case ComponentUnsignedByte:
+            return 1;
+        case ComponentShort:
+        case ComponentUnsignedShort:
+            return 2;
+        case ComponentUnsignedInt:
+        case ComponentFloat:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    [[nodiscard]] uint32_t getNumComponents(std::string_view type)
+    {
+        if (type == "SCALAR")
+        {
+            return 1;
+        }
+        if (type == "VEC2")
+        {
+            return 2;
+        }
+        if (type == "VEC3")
+        {
+            return 3;
+        }
+        if (type == "VEC4")
+        {
+            return 4;
+        }
+        return 0;
+    }
+
+    // A typed view of an accessor's elements inside the binary chunk
+    struct Accessor
+    {
+        const uint8_t *data = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        uint32_t componentType = 0;
+        uint32_t numComponents = 0;
+        bool normalized = false;
+
+        [[nodiscard]] float readFloat(size_t elem, uint32_t component) const
+        {
+            const uint8_t *src = data + elem * stride + component * getComponentSize(componentType);
+            switch (componentType)
+            {
+            case ComponentFloat:
+            {
+                float value;
+                std::memcpy(&value, src, sizeof(value));
+                return value;
+            }
+            case ComponentUnsignedByte:
+                return normalized ? *src / 255.0f : *src;
+            case ComponentByte:
+            {
+                int8_t value = static_cast<int8_t>(*src);
+                return normalized ? std::max(value / 127.0f, -1.0f) : value;
+            }
+            case ComponentUnsignedShort:
+            {
+                uint16_t value;
+                std::memcpy(&value, src, sizeof(value));
+                return normalized ? value / 65535.0f : value;
+            }
+            case ComponentShort:
+            {
+                int16_t value;
+                std::memcpy(&value, src, sizeof(value));
+                return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+            }
+            default:
+                return 0.0f;
+            }
+        }
+
+        [[nodiscard]] uint32_t readIndex(size_t elem) const
+        {
+            const uint8_t *src = data + elem * stride;
+            switch (componentType)
+            {
+            case ComponentUnsignedByte:
+                return *src;
+            case ComponentUnsignedShort:
+            {
+                uint16_t value;
+                std::memcpy(&value, src, sizeof(value));
+                return value;
+            }
+            default:
+                return readU32(src);
+            }
+        }
+    };
+
+    struct GltfFile
+    {
+        JsonValue json;
+        std::span<const uint8_t> bin;
+    };
+
+    [[nodiscard]] bool getBufferView(const GltfFile &gltf, const JsonValue *index, std::span<const uint8_t> &view, size_t &stride)
+    {
+        const JsonValue &bufferViews = gltf.json.getArray("bufferViews");
+        uint64_t viewIndex = 0;
+        if (!index || !index->getUint(bufferViews.values.size(), viewIndex))
+        {
+            return false;
+        }
+        const JsonValue *bufferView = bufferViews.at(viewIndex);
+        // only the binary chunk is supported, which is always buffer 0
+        if (!bufferView || bufferView->getNumber("buffer", -1) != 0)
+        {
+            return false;
+        }
+
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        uint64_t viewStride = 0;
+        if (!bufferView->getUint("byteOffset", 0, gltf.bin.size(), offset) || !bufferView->find("byteLength")
+            || !bufferView->getUint("byteLength", 0, gltf.bin.size() - offset, length)
+            || !bufferView->getUint("byteStride", 0, MaxByteStride, viewStride))
+        {
+            return false;
+        }
+        view = gltf.bin.subspan(offset, length);
+        stride = viewStride;
+        return true;
+    }
+
+    [[nodiscard]] bool getAccessor(const GltfFile &gltf, const JsonValue *index, uint32_t numComponents, Accessor &accessor)
+    {
+        const JsonValue &accessors = gltf.json.getArray("accessors");
+        uint64_t accessorIndex = 0;
+        if (!index || !index->getUint(accessors.values.size(), accessorIndex))
+        {
+            return false;
+        }
+        const JsonValue *json = accessors.at(accessorIndex);
+        if (!json || json->find("sparse"))
+        {
+            return false;
+        }
+
+        uint64_t componentType = 0;
+        uint64_t count = 0;
+        if (!json->getUint("componentType", 0, UINT32_MAX, componentType) || !json->getUint("count", 0, UINT32_MAX, count))
+        {
+            return false;
+        }
+        accessor.componentType = static_cast<uint32_t>(componentType);
+        accessor.numComponents = getNumComponents(json->getString("type"));
+        accessor.count = count;
+        accessor.normalized = json->find("normalized") && json->find("normalized")->boolean;
+        uint32_t componentSize = getComponentSize(accessor.componentType);
+        if (componentSize == 0 || accessor.numComponents != numComponents)
+        {
+            return false;
+        }
+
+        std::span<const uint8_t> view;
+        size_t stride = 0;
+        if (!getBufferView(gltf, json->find("bufferView"), view, stride))
+        {
+            return false;
+        }
+        size_t elemSize = componentSize * accessor.numComponents;
+        accessor.stride = stride ? stride : elemSize;
+        uint64_t offset = 0;
+        if (!json->getUint("byteOffset", 0, view.size(), offset) || accessor.stride < elemSize)
+        {
+            return false;
+        }
+
+        // (count - 1) * stride + elemSize <= size, rearranged so that nothing can overflow
+        view = view.subspan(offset);
+        if (accessor.count > 0
+            && (view.size() < elemSize || static_cast<uint64_t>(accessor.count - 1) > (view.size() - elemSize) / accessor.stride))
+        {
+            return false;
+        }
+        accessor.data = view.data();
+        return true;
+    }
+
+    [[nodiscard]] bool parseGlb(const std::span<const uint8_t> &file, GltfFile &gltf)
+    {
+        if (!GltfLoader::IsGlb(file) || readU32(file.data() + 8) < 12 || readU32(file.data() + 8) > file.size())
+        {
+            return false;
+        }
+
+        // chunks follow the 12 byte header, JSON first and the optional binary chunk second
+        std::span<const uint8_t> chunks = file.subspan(12, readU32(file.data() + 8) - 12);
+        std::span<const uint8_t> jsonChunk;
+        while (chunks.size() >= 8)
+        {
+            uint32_t length = readU32(chunks.data());
+            uint32_t type = readU32(chunks.data() + 4);
+            if (length > chunks.size() - 8)
+            {
+                return false;
+            }
+            if (type == ChunkJson && jsonChunk.empty())
+            {
+                jsonChunk = chunks.subspan(8, length);
+            }
+            else if (type == ChunkBin && gltf.bin.empty())
+            {
+                gltf.bin = chunks.subspan(8, length);
+            }
+            chunks = chunks.subspan(8 + length);
+        }
+
+        std::string_view jsonText(reinterpret_cast<const char *>(jsonChunk.data()), jsonChunk.size());
+        return !jsonChunk.empty() && JsonParser(jsonText).parse(gltf.json) && gltf.json.type == JsonValue::Type::Object;
+    }
+
+    [[nodiscard]] bool loadTextures(const GltfFile &gltf, MeshData &data, std::vector<uint32_t> &textureIndices)
+    {
+        // glTF textures reference images, several textures may share one image with different samplers
+        const JsonValue &images = gltf.json.getArray("images");
+        std::vector<uint32_t> imageIndices(images.values.size(), MeshData::NoTexture);
+        for (size_t i = 0; i < images.values.size(); i++)
+        {
+            std::span<const uint8_t> encoded;
+            size_t stride = 0;
+            // images referenced by uri live outside the file, they aren't embedded textures so they are skipped
+            uint32_t width = 0;
+            uint32_t height = 0;
+            if (!getBufferView(gltf, images.values[i].find("bufferView"), encoded, stride)
+                || !TextureDecoder::ReadInfo(encoded, width, height))
+            {
+                continue;
+            }
+            printf("image %zu: [%u, %u, %u]\n", i, width, height, TextureDecoder::NumComponents);
+
+            imageIndices[i] = static_cast<uint32_t>(data.textures.size());
+            data.textures.push_back({.encoded = encoded, .width = width, .height = height});
+        }
+
+        const JsonValue &textures = gltf.json.getArray("textures");
+        textureIndices.assign(textures.values.size(), MeshData::NoTexture);
+        for (size_t i = 0; i < textures.values.size(); i++)
+        {
+            double source = textures.values[i].getNumber("source", -1);
+            if (source >= 0 && source < imageIndices.size())
+            {
+                textureIndices[i] = imageIndices[static_cast<size_t>(source)];
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] uint32_t getTextureIndex(const JsonValue *textureInfo, const std::vector<uint32_t> &textureIndices)
+    {
+        double index = textureInfo ? textureInfo->getNumber("index", -1) : -1;
+        return index >= 0 && index < textureIndices.size() ? textureIndices[static_cast<size_t>(index)] : MeshData::NoTexture;
+    }
+
+    void loadMaterials(const GltfFile &gltf, const std::vector<uint32_t> &textureIndices, MeshData &data)
+    {
+        // same slots Assimp maps glTF materials to
+        for (const JsonValue &json : gltf.json.getArray("materials").values)
+        {
+            MeshData::Material &material = data.materials.emplace_back();
+
+            if (const JsonValue *pbr = json.find("pbrMetallicRoughness"))
+            {
+                material.textures[MeshData::TEXTURE_SLOT_DIFFUSE] = getTextureIndex(pbr->find("baseColorTexture"), textureIndices);
+                const JsonValue &factor = pbr->getArray("baseColorFactor");
+                for (size_t i = 0; i < 3 && i < factor.values.size(); i++)
+                {
+                    material.diffuseColor[i] = static_cast<float>(factor.values[i].number);
+                }
+            }
+            material.textures[MeshData::TEXTURE_SLOT_AMBIENT_OCCLUSION] = getTextureIndex(json.find("occlusionTexture"), textureIndices);
+            material.textures[MeshData::TEXTURE_SLOT_EMISSIVE] = getTextureIndex(json.find("emissiveTexture"), textureIndices);
+            material.textures[MeshData::TEXTURE_SLOT_NORMAL] = getTextureIndex(json.find("normalTexture"), textureIndices);
+        }
+    }
+
+    [[nodiscard]] bool loadPrimitive(const GltfFile &gltf, const JsonValue &primitive, uint32_t defaultMaterial, MeshData &data)
+    {
+        if (primitive.getNumber("mode", ModeTriangles) != ModeTriangles || primitive.find("targets"))
+        {
+            return false;
+        }
+
+        const JsonValue *attributes = primitive.find("attributes");
+        Accessor positions;
+        Accessor normals;
+        Accessor texCoords;
+        if (!attributes || !getAccessor(gltf, attributes->find("POSITION"), 3, positions)
+            || !getAccessor(gltf, attributes->find("NORMAL"), 3, normals) || normals.count != positions.count)
+        {
+            return false;
+        }
+        bool hasTexCoords = attributes->find("TEXCOORD_0") != nullptr;
+        if (hasTexCoords && (!getAccessor(gltf, attributes->find("TEXCOORD_0"), 2, texCoords) || texCoords.count != positions.count))
+        {
+            return false;
+        }
+
+        double material = primitive.getNumber("material", -1);
+        uint32_t matIndex = material >= 0 && material < defaultMaterial ? static_cast<uint32_t>(material) : defaultMaterial;
+
+        MeshData::Submesh &submesh = data.submeshes.emplace_back();
+        submesh.vertexOffset = static_cast<uint32_t>(data.vertexStorage.size());
+        submesh.indexOffset = static_cast<uint32_t>(data.faceStorage.size() * 3);
+        submesh.matIndex = matIndex;
+
+        // The attribute streams are interleaved into the vertex layout in one pass over the mapped file
+        for (size_t i = 0; i < positions.count; i++)
+        {
+            Vertex &vertex = data.vertexStorage.emplace_back();
+            vertex.position = glm::vec3(positions.readFloat(i, 0), positions.readFloat(i, 1), positions.readFloat(i, 2));
+            vertex.normal = glm::vec3(normals.readFloat(i, 0), normals.readFloat(i, 1), normals.readFloat(i, 2));
+            // matches the Assimp path, which flips v on import and once more when converting to glm
+            if (hasTexCoords)
+            {
+                vertex.textureCoordinate = glm::vec2(texCoords.readFloat(i, 0), texCoords.readFloat(i, 1) - 1.0f);
+            }
+        }
+
+        if (const JsonValue *indicesIndex = primitive.find("indices"))
+        {
+            Accessor indices;
+            if (!getAccessor(gltf, indicesIndex, 1, indices) || indices.componentType == ComponentFloat || indices.count % 3 != 0)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < indices.count; i += 3)
+            {
+                glm::u32vec3 face(indices.readIndex(i), indices.readIndex(i + 1), indices.readIndex(i + 2));
+                // the draw offsets indices by the submesh's first vertex, they must not reach past its vertices
+                if (face.x >= positions.count || face.y >= positions.count || face.z >= positions.count)
+                {
+                    return false;
+                }
+                data.faceStorage.push_back(face);
+            }
+            submesh.indexCount = static_cast<uint32_t>(indices.count);
+        }
+        else
+        {
+            if (positions.count % 3 != 0)
+            {
+                return false;
+            }
+            for (uint32_t i = 0; i < positions.count; i += 3)
+            {
+                data.faceStorage.emplace_back(i, i + 1, i + 2);
+            }
+            submesh.indexCount = static_cast<uint32_t>(positions.count);
+        }
+        return true;
+    }
+
+    // -1 for anything that isn't a whole non negative number, so it fails the range checks of the caller
+    [[nodiscard]] double getIndex(const JsonValue &value)
+    {
+        uint64_t index = 0;
+        return value.getUint(UINT32_MAX, index) ? static_cast<double>(index) : -1;
+    }
+
+    [[nodiscard]] glm::mat4 getLocalTransform(const JsonValue &node)
+    {
+        // column major, like glm
+        const JsonValue &matrix = node.getArray("matrix");
+        if (matrix.values.size() == 16)
+        {
+            glm::mat4 transform(1.0f);
+            for (size_t i = 0; i < 16; i++)
+            {
+                transform[i / 4][i % 4] = static_cast<float>(matrix.values[i].number);
+            }
+            return transform;
+        }
+
+        glm::vec3 translation(0.0f);
+        glm::vec3 scale(1.0f);
+        // xyzw
+        glm::vec4 rotation(0.0f, 0.0f, 0.0f, 1.0f);
+        const JsonValue &translationJson = node.getArray("translation");
+        const JsonValue &scaleJson = node.getArray("scale");
+        const JsonValue &rotationJson = node.getArray("rotation");
+        for (size_t i = 0; i < 3 && translationJson.values.size() == 3; i++)
+        {
+            translation[i] = static_cast<float>(translationJson.values[i].number);
+        }
+        for (size_t i = 0; i < 3 && scaleJson.values.size() == 3; i++)
+        {
+            scale[i] = static_cast<float>(scaleJson.values[i].number);
+        }
+        for (size_t i = 0; i < 4 && rotationJson.values.size() == 4; i++)
+        {
+            rotation[i] = static_cast<float>(rotationJson.values[i].number);
+        }
+        glm::quat orientation(rotation.w, rotation.x, rotation.y, rotation.z);
+        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(orientation) * glm::scale(glm::mat4(1.0f), scale);
+    }
+
+    // Flattens the nodes of the default scene breadth first, so parents come before their children. meshSubmeshes holds
+    // the first submesh and the number of submeshes of every glTF mesh
+    [[nodiscard]] bool loadNodes(const GltfFile &gltf, const std::vector<std::pair<uint32_t, uint32_t>> &meshSubmeshes, MeshData &data)
+    {
+        const JsonValue &nodes = gltf.json.getArray("nodes");
+        std::vector<bool> visited(nodes.values.size(), false);
+        std::vector<std::pair<size_t, uint32_t>> nodeQueue;
+        // a node reached twice would be part of a cycle or have several parents
+        auto enqueue = [&](double index, uint32_t parentIndex)
+        {
+            if (index < 0 || index >= nodes.values.size() || visited[static_cast<size_t>(index)])
+            {
+                return false;
+            }
+            visited[static_cast<size_t>(index)] = true;
+            nodeQueue.push_back({static_cast<size_t>(index), parentIndex});
+            return true;
+        };
+
+        const JsonValue &scenes = gltf.json.getArray("scenes");
+        if (!scenes.values.empty())
+        {
+            double sceneIndex = gltf.json.getNumber("scene", 0);
+            const JsonValue *scene = sceneIndex >= 0 ? scenes.at(static_cast<size_t>(sceneIndex)) : nullptr;
+            if (!scene)
+            {
+                return false;
+            }
+            for (const JsonValue &root : scene->getArray("nodes").values)
+            {
+                if (!enqueue(getIndex(root), MeshData::NoParent))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            // without scenes every node that isn't a child is a root
+            std::vector<bool> isChild(nodes.values.size(), false);
+            for (const JsonValue &node : nodes.values)
+            {
+                for (const JsonValue &child : node.getArray("children").values)
+                {
+                    double childIndex = getIndex(child);
+                    if (childIndex >= 0 && childIndex < nodes.values.size())
+                    {
+                        isChild[static_cast<size_t>(childIndex)] = true;
+                    }
+                }
+            }
+            for (size_t i = 0; i < nodes.values.size(); i++)
+            {
+                if (!isChild[i] && !enqueue(static_cast<double>(i), MeshData::NoParent))
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (size_t head = 0; head < nodeQueue.size(); head++)
+        {
+            auto [nodeIndex, parentIndex] = nodeQueue[head];
+            const JsonValue &json = nodes.values[nodeIndex];
+
+            MeshData::Node &node = data.nodes.emplace_back();
+            node.localTransform = getLocalTransform(json);
+            node.parentIndex = parentIndex;
+            node.submeshOffset = static_cast<uint32_t>(data.nodeSubmeshes.size());
+            if (json.find("mesh"))
+            {
+                double mesh = getIndex(*json.find("mesh"));
+                if (mesh < 0 || mesh >= meshSubmeshes.size())
+                {
+                    return false;
+                }
+                auto [submeshOffset, submeshCount] = meshSubmeshes[static_cast<size_t>(mesh)];
+                for (uint32_t i = 0; i < submeshCount; i++)
+                {
+                    data.nodeSubmeshes.push_back(submeshOffset + i);
+                }
+                node.submeshCount = submeshCount;
+            }
+
+            for (const JsonValue &child : json.getArray("children").values)
+            {
+                if (!enqueue(getIndex(child), static_cast<uint32_t>(head)))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+} // namespace
+
+bool GltfLoader::IsGlb(const std::span<const uint8_t> &file)
+{
+    return file.size() >= 12 && readU32(file.data()) == GlbMagic && readU32(file.data() + 4) == GlbVersion;
+}
+
+bool GltfLoader::Load(const std::shared_ptr<const MappedFile> &file, MeshData &data)
+{
+    GltfFile gltf;
+    if (!parseGlb(file->data(), gltf))
+    {
+        std::cerr << "Invalid glb file" << std::endl;
+        return false;
+    }
+
+    for (const JsonValue &extension : gltf.json.getArray("extensionsRequired").values)
+    {
+        std::cout << "glb requires unsupported extension " << extension.string << std::endl;
+        return false;
+    }
+
+    MeshData gltfData;
+    std::vector<uint32_t> textureIndices;
+    if (!loadTextures(gltf, gltfData, textureIndices))
+    {
+        return false;
+    }
+    loadMaterials(gltf, textureIndices, gltfData);
+
+    // primitives without a material use a default one, which is only added when needed
+    uint32_t defaultMaterial = static_cast<uint32_t>(gltfData.materials.size());
+    const JsonValue &meshes = gltf.json.getArray("meshes");
+    std::vector<std::pair<uint32_t, uint32_t>> meshSubmeshes;
+    for (const JsonValue &mesh : meshes.values)
+    {
+        uint32_t submeshOffset = static_cast<uint32_t>(gltfData.submeshes.size());
+        for (const JsonValue &primitive : mesh.getArray("primitives").values)
+        {
+            if (!loadPrimitive(gltf, primitive, defaultMaterial, gltfData))
+            {
+                std::cout << "glb uses features the native loader doesn't support" << std::endl;
+                return false;
+            }
+        }
+        meshSubmeshes.push_back({submeshOffset, static_cast<uint32_t>(gltfData.submeshes.size()) - submeshOffset});
+    }
+    if (!loadNodes(gltf, meshSubmeshes, gltfData))
+    {
+        std::cout << "glb has an invalid node hierarchy" << std::endl;
+        return false;
+    }
+    for (const MeshData::Submesh &submesh : gltfData.submeshes)
+    {
+        if (submesh.matIndex == defaultMaterial)
+        {
+            gltfData.materials.emplace_back();
+            break;
+        }
+    }
+
+    gltfData.vertices = gltfData.vertexStorage;
+    gltfData.faces = gltfData.faceStorage;
+    gltfData.mapping = file;
+    data = std::move(gltfData);
+    return true;
+}
@@ -12,15 +12,24 @@ Buffer::Buffer(const State &&state)
 {
     Renderer &renderer = Renderer::Get();
 
+    // buffers shared between distinct queue families are concurrent so that asynchronous transfers
+    // don't need an ownership transfer before the graphics queue can read them
     std::array<uint32_t, static_cast<uint32_t>(QueueFamily::Size)> queueFamilyIndices;
+    uint32_t numQueueFamilyIndices = 0;
     for (uint32_t i = 0; i < state.families.size(); i++)
     {
-        queueFamilyIndices[i] = renderer.getQueueFamilyIdx(state.families[i]);
+        uint32_t queueFamilyIdx = renderer.getQueueFamilyIdx(state.families[i]);
+        auto queueFamilyIndicesEnd = queueFamilyIndices.begin() + numQueueFamilyIndices;
+        if (std::find(queueFamilyIndices.begin(), queueFamilyIndicesEnd, queueFamilyIdx) == queueFamilyIndicesEnd)
+        {
+            queueFamilyIndices[numQueueFamilyIndices++] = queueFamilyIdx;
+        }
     }
     VmaBuffer output = VkInit::CreateVkBuffer({
         .size = state.size,
         .usage = state.usage,
-        .queueFamilyIndices = queueFamilyIndices,
+        .sharingMode = numQueueFamilyIndices > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndices = std::span(queueFamilyIndices.data(), numQueueFamilyIndices),
         .allocation{
             .flags = state.vmaFlags,
             .usage = state.vmaUsage,
@@ -41,6 +50,7 @@ void Buffer::destroy()
 Image::Image(const State &&state)
     : m_width(state.width)
     , m_height(state.height)
+    , m_mipLevels(state.mipLevels)
     , m_aspectMask(state.aspectMask)
     , m_mutableFormat(state.mutableFormat)
     , m_preallocated(state.preAllocatedImage)
@@ -58,6 +68,7 @@ Image::Image(const State &&state)
             .format = state.format,
             .width = state.width,
             .height = state.height,
+            .mipLevels = state.mipLevels,
             .samples = state.samples,
             .usage = state.usage,
             .queueFamilyIndices = queueFamilyIndices,
@@ -100,6 +111,7 @@ void Image::addImageViewFormat(VkFormat format)
             .image = m_image,
             .format = format,
             .aspectMask = m_aspectMask,
+            .levelCount = m_mipLevels,
         }),
     };
 }
@@ -173,6 +173,7 @@ void Gui::collectImGuiFrameData()
     ImGui::NewFrame();
 
     setImGuiDockspace();
+    drawUploadStats();
     ImGui::ShowDemoWindow();
     ImGui::Render();
 }
@@ -233,4 +234,51 @@ void Gui::setImGuiDockspace()
     ImGui::DockSpace(dockspace_id, ImVec2(0.0f, 0.0f), dockspace_flags);
     ImGui::PopStyleVar(3);
     ImGui::End();
-}
\ No newline at end of file
+}
+
+void Gui::drawUploadStats()
+{
+    UploadStats stats = Renderer::Get().getUploadStats();
+    constexpr auto categoryNames = std::to_array({"Buffer", "Texture", "Immediate"});
+    static_assert(categoryNames.size() == static_cast<size_t>(UploadCategory::Size));
+
+    ImGui::Begin("Uploads");
+    if (!stats.gpuTimestamps)
+    {
+        ImGui::TextUnformatted("Transfer queue has no timestamp support, GPU times are unavailable");
+    }
+    if (ImGui::BeginTable("UploadStats", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        for (const char *column : {"", "Submits", "MiB", "memcpy ms", "Decode ms", "Wait ms", "GPU ms"})
+        {
+            ImGui::TableSetupColumn(column);
+        }
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < categoryNames.size(); i++)
+        {
+            const UploadCounters &counters = stats.counters[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(categoryNames[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(counters.submissions));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.bytes / (1024.0 * 1024.0));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.memcpyMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.decodeMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.waitMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", counters.gpuMs);
+        }
+        ImGui::EndTable();
+    }
+    if (ImGui::Button("Reset"))
+    {
+        Renderer::Get().resetUploadStats();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,74 @@
+#include "IndexPacking.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // both index sizes divide the block alignment, so every block starts at a whole index of either size
+    constexpr size_t BlockAlignment = sizeof(uint32_t);
+
+    [[nodiscard]] uint32_t getMaxIndex(const uint32_t *indices, uint32_t indexOffset, uint32_t indexCount)
+    {
+        uint32_t maxIndex = 0;
+        for (uint32_t i = indexOffset; i < indexOffset + indexCount; i++)
+        {
+            maxIndex = std::max(maxIndex, indices[i]);
+        }
+        return maxIndex;
+    }
+} // namespace
+
+void IndexPacking::Pack(MeshData &data)
+{
+    const uint32_t *indices = &data.faces.data()->x;
+    std::vector<uint8_t> &packed = data.packedIndexStorage;
+    packed.clear();
+    packed.reserve(data.faces.size_bytes());
+    for (MeshData::Submesh &submesh : data.submeshes)
+    {
+        std::span<MeshData::Lod> lods = std::span(data.lods).subspan(submesh.lodOffset, submesh.lodCount);
+        uint32_t maxIndex = getMaxIndex(indices, submesh.indexOffset, submesh.indexCount);
+        for (const MeshData::Lod &lod : lods)
+        {
+            maxIndex = std::max(maxIndex, getMaxIndex(indices, lod.indexOffset, lod.indexCount));
+        }
+        submesh.indexSize = maxIndex <= UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+        packed.resize((packed.size() + BlockAlignment - 1) & ~(BlockAlignment - 1));
+
+        // returns the offset of the range in packed, in indices of the submesh's size
+        auto appendRange = [&](uint32_t indexOffset, uint32_t indexCount)
+        {
+            size_t start = packed.size();
+            packed.resize(start + static_cast<size_t>(indexCount) * submesh.indexSize);
+            if (submesh.indexSize == sizeof(uint32_t))
+            {
+                std::memcpy(packed.data() + start, indices + indexOffset, static_cast<size_t>(indexCount) * sizeof(uint32_t));
+            }
+            else
+            {
+                for (uint32_t i = 0; i < indexCount; i++)
+                {
+                    auto index = static_cast<uint16_t>(indices[indexOffset + i]);
+                    std::memcpy(packed.data() + start + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+                }
+            }
+            return static_cast<uint32_t>(start / submesh.indexSize);
+        };
+
+        // meshlets are runs of the full detail triangles and keep their place relative to the submesh
+        uint32_t indexOffset = appendRange(submesh.indexOffset, submesh.indexCount);
+        for (uint32_t i = submesh.meshletOffset; i < submesh.meshletOffset + submesh.meshletCount; i++)
+        {
+            data.meshlets[i].indexOffset = data.meshlets[i].indexOffset - submesh.indexOffset + indexOffset;
+        }
+        submesh.indexOffset = indexOffset;
+        for (MeshData::Lod &lod : lods)
+        {
+            lod.indexOffset = appendRange(lod.indexOffset, lod.indexCount);
+        }
+    }
+
+    data.packedIndices = data.packedIndexStorage;
+    data.faces = {};
+    data.faceStorage = {};
+}
@@ -0,0 +1,399 @@
+#include "LodBuilder.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <span>
+#include <vector>
+
+namespace
+{
+    // a collapse may turn a triangle by at most about 75 degrees, so a series of them can't fold the surface over
+    constexpr float MinNormalDot = 0.25f;
+
+    // Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of the plane equations' outer products
+    struct Quadric
+    {
+        double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+        double yy = 0.0, yz = 0.0, yw = 0.0;
+        double zz = 0.0, zw = 0.0;
+        double ww = 0.0;
+
+        [[nodiscard]] static Quadric FromPlane(const glm::vec3 &normal, float distance)
+        {
+            double a = normal.x, b = normal.y, c = normal.z, d = distance;
+            return {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+        }
+
+        Quadric &operator+=(const Quadric &other)
+        {
+            xx += other.xx, xy += other.xy, xz += other.xz, xw += other.xw;
+            yy += other.yy, yz += other.yz, yw += other.yw;
+            zz += other.zz, zw += other.zw;
+            ww += other.ww;
+            return *this;
+        }
+
+        [[nodiscard]] double evaluate(const glm::vec3 &position) const
+        {
+            double x = position.x, y = position.y, z = position.z;
+            return xx * x * x + yy * y * y + zz * z * z + ww + 2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z);
+        }
+    };
+
+    class Simplifier
+    {
+      public:
+        Simplifier(const std::span<const Vertex> &vertices, const std::span<const uint32_t> &indices)
+            : m_vertices(vertices)
+            , m_quadrics(vertices.size())
+            , m_locked(vertices.size(), false)
+            , m_touched(vertices.size(), false)
+        {
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                if (indices[i] != indices[i + 1] && indices[i] != indices[i + 2] && indices[i + 1] != indices[i + 2])
+                {
+                    m_indices.insert(m_indices.end(), indices.begin() + i, indices.begin() + i + 3);
+                }
+            }
+            lockSeamsAndBorders();
+
+            for (size_t i = 0; i < m_indices.size(); i += 3)
+            {
+                const glm::vec3 &p0 = m_vertices[m_indices[i]].position;
+                glm::vec3 normal = glm::cross(m_vertices[m_indices[i + 1]].position - p0, m_vertices[m_indices[i + 2]].position - p0);
+                float length = glm::length(normal);
+                if (length == 0.0f)
+                {
+                    continue;
+                }
+                normal = normal / length;
+                Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, p0));
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    m_quadrics[m_indices[i + corner]] += plane;
+                }
+            }
+        }
+
+        // collapses edges until at most targetTriangles are left or no edge can collapse any more
+        void simplify(size_t targetTriangles)
+        {
+            while (getNumTriangles() > targetTriangles && collapsePass(targetTriangles))
+            {
+            }
+        }
+
+        [[nodiscard]] size_t getNumTriangles() const
+        {
+            return m_indices.size() / 3;
+        }
+
+        [[nodiscard]] const std::vector<uint32_t> &getIndices() const
+        {
+            return m_indices;
+        }
+
+        // the largest collapse error so far, as a distance
+        [[nodiscard]] float getError() const
+        {
+            return m_error;
+        }
+
+      private:
+        struct Collapse
+        {
+            uint32_t from;
+            uint32_t to;
+            double cost;
+        };
+
+        // Vertices sharing a position are the sides of a seam, and moving one of them would tear it open. Border edges
+        // are found on the welded positions, so a seam isn't mistaken for a border
+        void lockSeamsAndBorders()
+        {
+            std::vector<uint32_t> order(m_vertices.size());
+            std::iota(order.begin(), order.end(), 0);
+            auto positionLess = [&](uint32_t a, uint32_t b)
+            {
+                const glm::vec3 &pa = m_vertices[a].position;
+                const glm::vec3 &pb = m_vertices[b].position;
+                return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+            };
+            std::sort(order.begin(), order.end(), positionLess);
+
+            std::vector<uint32_t> welded(m_vertices.size());
+            for (size_t i = 0; i < order.size();)
+            {
+                size_t end = i + 1;
+                for (; end < order.size() && !positionLess(order[i], order[end]); end++)
+                {
+                }
+                for (size_t j = i; j < end; j++)
+                {
+                    welded[order[j]] = order[i];
+                    m_locked[order[j]] = end - i > 1;
+                }
+                i = end;
+            }
+
+            std::vector<uint64_t> edges;
+            edges.reserve(m_indices.size());
+            for (size_t i = 0; i < m_indices.size(); i += 3)
+            {
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    uint32_t a = welded[m_indices[i + corner]];
+                    uint32_t b = welded[m_indices[i + (corner + 1) % 3]];
+                    edges.push_back(static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t end = i + 1;
+                for (; end < edges.size() && edges[end] == edges[i]; end++)
+                {
+                }
+                // borders and non manifold edges
+                if (end - i != 2)
+                {
+                    m_locked[edges[i] >> 32] = true;
+                    m_locked[edges[i] & UINT32_MAX] = true;
+                }
+                i = end;
+            }
+        }
+
+        [[nodiscard]] double getCost(uint32_t from, uint32_t to) const
+        {
+            Quadric quadric = m_quadrics[from];
+            quadric += m_quadrics[to];
+            return std::max(quadric.evaluate(m_vertices[to].position), 0.0);
+        }
+
+        // a collapse must not turn any of the remaining triangles around
+        [[nodiscard]] bool flipsTriangle(const Collapse &collapse, const std::span<const uint32_t> &triangles) const
+        {
+            for (uint32_t triangle : triangles)
+            {
+                const uint32_t *corners = &m_indices[triangle * 3];
+                if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to)
+                {
+                    continue;
+                }
+                std::array<glm::vec3, 3> before;
+                std::array<glm::vec3, 3> after;
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    before[corner] = m_vertices[corners[corner]].position;
+                    after[corner] = m_vertices[corners[corner] == collapse.from ? collapse.to : corners[corner]].position;
+                }
+                glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(normalBefore, normalAfter) <= MinNormalDot * glm::length(normalBefore) * glm::length(normalAfter))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Applies the cheapest collapses that don't interfere with each other: once a vertex collapsed, no triangle
+        // around it changes again in the same pass, which keeps the flip checks valid. False if nothing collapsed
+        bool collapsePass(size_t targetTriangles)
+        {
+            size_t numTriangles = getNumTriangles();
+            std::vector<uint32_t> adjacencyOffsets(m_vertices.size() + 1, 0);
+            for (uint32_t index : m_indices)
+            {
+                adjacencyOffsets[index + 1]++;
+            }
+            std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+            std::vector<uint32_t> adjacency(m_indices.size());
+            {
+                std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+                for (size_t i = 0; i < m_indices.size(); i++)
+                {
+                    adjacency[cursors[m_indices[i]]++] = static_cast<uint32_t>(i / 3);
+                }
+            }
+            auto getTriangles = [&](uint32_t vertex)
+            {
+                uint32_t begin = adjacencyOffsets[vertex];
+                return std::span<const uint32_t>(adjacency).subspan(begin, adjacencyOffsets[vertex + 1] - begin);
+            };
+
+            std::vector<Collapse> collapses;
+            collapses.reserve(m_indices.size() * 2);
+            for (size_t i = 0; i < m_indices.size(); i += 3)
+            {
+                for (size_t corner = 0; corner < 3; corner++)
+                {
+                    uint32_t a = m_indices[i + corner];
+                    uint32_t b = m_indices[i + (corner + 1) % 3];
+                    if (!m_locked[a])
+                    {
+                        collapses.push_back({a, b, getCost(a, b)});
+                    }
+                    if (!m_locked[b])
+                    {
+                        collapses.push_back({b, a, getCost(b, a)});
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse &a, const Collapse &b)
+                      {
+                          return a.cost < b.cost;
+                      });
+
+            std::fill(m_touched.begin(), m_touched.end(), false);
+            std::vector<uint32_t> remap(m_vertices.size());
+            std::iota(remap.begin(), remap.end(), 0);
+            size_t removed = 0;
+            bool collapsed = false;
+            for (const Collapse &collapse : collapses)
+            {
+                if (numTriangles - removed <= targetTriangles)
+                {
+                    break;
+                }
+                std::span<const uint32_t> triangles = getTriangles(collapse.from);
+                if (m_touched[collapse.from] || m_touched[collapse.to] || flipsTriangle(collapse, triangles))
+                {
+                    continue;
+                }
+
+                for (uint32_t triangle : triangles)
+                {
+                    const uint32_t *corners = &m_indices[triangle * 3];
+                    removed += corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to;
+                    m_touched[corners[0]] = m_touched[corners[1]] = m_touched[corners[2]] = true;
+                }
+                remap[collapse.from] = collapse.to;
+                m_quadrics[collapse.to] += m_quadrics[collapse.from];
+                m_error = std::max(m_error, static_cast<float>(std::sqrt(collapse.cost)));
+                collapsed = true;
+            }
+
+            std::vector<uint32_t> indices;
+            indices.reserve(m_indices.size());
+            for (size_t i = 0; i < m_indices.size(); i += 3)
+            {
+                uint32_t a = remap[m_indices[i]];
+                uint32_t b = remap[m_indices[i + 1]];
+                uint32_t c = remap[m_indices[i + 2]];
+                if (a != b && a != c && b != c)
+                {
+                    indices.insert(indices.end(), {a, b, c});
+                }
+            }
+            m_indices = std::move(indices);
+            return collapsed;
+        }
+
+        std::span<const Vertex> m_vertices;
+        std::vector<uint32_t> m_indices;
+        std::vector<Quadric> m_quadrics;
+        std::vector<bool> m_locked;
+        std::vector<bool> m_touched;
+        float m_error = 0.0f;
+    };
+
+    struct SubmeshLods
+    {
+        std::vector<std::vector<uint32_t>> indices;
+        std::vector<float> errors;
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+    };
+
+    [[nodiscard]] SubmeshLods buildLods(const MeshData &data, const MeshData::Submesh &submesh)
+    {
+        SubmeshLods lods;
+        std::span<const uint32_t> indices(&data.faces.data()->x + submesh.indexOffset, submesh.indexCount);
+        if (indices.empty())
+        {
+            return lods;
+        }
+        uint32_t numVertices = *std::max_element(indices.begin(), indices.end()) + 1;
+        std::span<const Vertex> vertices = data.vertices.subspan(submesh.vertexOffset, numVertices);
+
+        glm::vec3 minPosition = vertices[indices[0]].position;
+        glm::vec3 maxPosition = minPosition;
+        for (uint32_t index : indices)
+        {
+            minPosition = glm::min(minPosition, vertices[index].position);
+            maxPosition = glm::max(maxPosition, vertices[index].position);
+        }
+        glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t index : indices)
+        {
+            radius = std::max(radius, glm::length(vertices[index].position - center));
+        }
+        lods.boundingSphere = glm::vec4(center, radius);
+
+        size_t numTriangles = indices.size() / 3;
+        if (numTriangles < LodBuilder::MinTriangles)
+        {
+            return lods;
+        }
+        Simplifier simplifier(vertices, indices);
+        for (uint32_t level = 0; level < LodBuilder::MaxLods && numTriangles >= LodBuilder::MinTriangles; level++)
+        {
+            simplifier.simplify(numTriangles / 2);
+            if (simplifier.getNumTriangles() > numTriangles * (1.0f - LodBuilder::MinReduction))
+            {
+                break;
+            }
+            std::vector<uint32_t> &levelIndices = lods.indices.emplace_back(simplifier.getIndices());
+            MeshOptimizer::OptimizeVertexCache(levelIndices, numVertices);
+            lods.errors.push_back(simplifier.getError());
+            numTriangles = simplifier.getNumTriangles();
+        }
+        return lods;
+    }
+} // namespace
+
+void LodBuilder::Build(MeshData &data, ThreadPool &threadPool)
+{
+    // levels are appended to the faces
+    if (data.faces.data() != data.faceStorage.data())
+    {
+        data.faceStorage.assign(data.faces.begin(), data.faces.end());
+        data.faces = data.faceStorage;
+    }
+
+    std::vector<SubmeshLods> submeshLods(data.submeshes.size());
+    threadPool.parallelFor(data.submeshes.size(),
+                           [&](size_t i)
+                           {
+                               submeshLods[i] = buildLods(data, data.submeshes[i]);
+                           });
+
+    data.lods.clear();
+    for (size_t i = 0; i < data.submeshes.size(); i++)
+    {
+        MeshData::Submesh &submesh = data.submeshes[i];
+        submesh.boundingSphere = submeshLods[i].boundingSphere;
+        submesh.lodOffset = static_cast<uint32_t>(data.lods.size());
+        submesh.lodCount = static_cast<uint32_t>(submeshLods[i].indices.size());
+        for (size_t level = 0; level < submeshLods[i].indices.size(); level++)
+        {
+            const std::vector<uint32_t> &indices = submeshLods[i].indices[level];
+            data.lods.push_back({
+                .indexOffset = static_cast<uint32_t>(data.faceStorage.size() * 3),
+                .indexCount = static_cast<uint32_t>(indices.size()),
+                .error = submeshLods[i].errors[level],
+            });
+            for (size_t j = 0; j < indices.size(); j += 3)
+            {
+                data.faceStorage.emplace_back(indices[j], indices[j + 1], indices[j + 2]);
+            }
+        }
+    }
+    data.faces = data.faceStorage;
+}
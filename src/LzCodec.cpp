@@ -0,0 +1,269 @@
+#include "LzCodec.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    constexpr uint32_t HashBits = 14;
+    constexpr uint32_t NoPosition = UINT32_MAX;
+    constexpr uint32_t MaxNibble = 15;
+
+    [[nodiscard]] uint32_t hashSequence(const uint8_t *src)
+    {
+        uint32_t sequence;
+        std::memcpy(&sequence, src, sizeof(sequence));
+        return (sequence * 2654435761u) >> (32 - HashBits);
+    }
+
+    [[nodiscard]] uint32_t readU32(const std::span<const uint8_t> &src, size_t offset)
+    {
+        uint32_t value;
+        std::memcpy(&value, src.data() + offset, sizeof(value));
+        return value;
+    }
+
+    void writeU32(std::vector<uint8_t> &dst, size_t offset, uint32_t value)
+    {
+        std::memcpy(dst.data() + offset, &value, sizeof(value));
+    }
+
+    // the part of a length that didn't fit its nibble
+    void writeLength(std::vector<uint8_t> &dst, uint32_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            dst.push_back(255);
+        }
+        dst.push_back(static_cast<uint8_t>(length));
+    }
+
+    // a match length of 0 ends the block
+    void writeSequence(std::vector<uint8_t> &dst, const uint8_t *literals, uint32_t numLiterals, uint32_t matchOffset,
+                       uint32_t matchLength)
+    {
+        uint32_t literalNibble = std::min(numLiterals, MaxNibble);
+        uint32_t matchNibble = matchLength ? std::min(matchLength - LzCodec::MinMatch, MaxNibble) : 0;
+        dst.push_back(static_cast<uint8_t>(literalNibble << 4 | matchNibble));
+        if (literalNibble == MaxNibble)
+        {
+            writeLength(dst, numLiterals - MaxNibble);
+        }
+        dst.insert(dst.end(), literals, literals + numLiterals);
+
+        if (matchLength == 0)
+        {
+            return;
+        }
+        dst.push_back(static_cast<uint8_t>(matchOffset & 0xff));
+        dst.push_back(static_cast<uint8_t>(matchOffset >> 8));
+        if (matchNibble == MaxNibble)
+        {
+            writeLength(dst, matchLength - LzCodec::MinMatch - MaxNibble);
+        }
+    }
+
+    // Greedy matching against the most recent position with the same hash, which keeps compression fast enough to run
+    // when assets are cooked. Matches never reach into a previous block, so blocks decompress independently.
+    void compressBlock(const uint8_t *src, uint32_t size, std::vector<uint32_t> &hashTable, std::vector<uint8_t> &dst)
+    {
+        std::fill(hashTable.begin(), hashTable.end(), NoPosition);
+
+        uint32_t anchor = 0;
+        uint32_t pos = 0;
+        while (pos + LzCodec::MinMatch <= size)
+        {
+            uint32_t &entry = hashTable[hashSequence(src + pos)];
+            uint32_t candidate = entry;
+            entry = pos;
+            if (candidate == NoPosition || std::memcmp(src + candidate, src + pos, LzCodec::MinMatch) != 0)
+            {
+                pos++;
+                continue;
+            }
+
+            uint32_t length = LzCodec::MinMatch;
+            while (pos + length < size && src[candidate + length] == src[pos + length])
+            {
+                length++;
+            }
+            writeSequence(dst, src + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+        writeSequence(dst, src + anchor, size - anchor, 0, 0);
+    }
+
+    [[nodiscard]] bool readLength(const uint8_t *&src, const uint8_t *end, uint32_t &length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (src == end)
+            {
+                return false;
+            }
+            byte = *src++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    [[nodiscard]] bool decompressBlock(const uint8_t *src, const uint8_t *srcEnd, uint8_t *dst, uint8_t *dstEnd)
+    {
+        uint8_t *dstBegin = dst;
+        while (src < srcEnd)
+        {
+            uint8_t token = *src++;
+            uint32_t numLiterals = token >> 4;
+            if (numLiterals == MaxNibble && !readLength(src, srcEnd, numLiterals))
+            {
+                return false;
+            }
+            if (numLiterals > srcEnd - src || numLiterals > dstEnd - dst)
+            {
+                return false;
+            }
+            std::memcpy(dst, src, numLiterals);
+            src += numLiterals;
+            dst += numLiterals;
+
+            if (src == srcEnd)
+            {
+                break;
+            }
+            if (srcEnd - src < 2)
+            {
+                return false;
+            }
+            uint32_t matchOffset = src[0] | src[1] << 8;
+            src += 2;
+            uint32_t matchLength = token & MaxNibble;
+            if (matchLength == MaxNibble && !readLength(src, srcEnd, matchLength))
+            {
+                return false;
+            }
+            matchLength += LzCodec::MinMatch;
+            if (matchOffset == 0 || matchOffset > dst - dstBegin || matchLength > dstEnd - dst)
+            {
+                return false;
+            }
+            // matches may overlap their own output, so this has to go byte by byte
+            for (uint32_t i = 0; i < matchLength; i++, dst++)
+            {
+                *dst = *(dst - matchOffset);
+            }
+        }
+        return dst == dstEnd;
+    }
+} // namespace
+
+std::vector<uint8_t> LzCodec::Compress(const std::span<const uint8_t> &src, uint32_t blockSize)
+{
+    assert(blockSize > 0 && blockSize <= MaxBlockSize && blockSize % 4 == 0);
+    assert(src.size() <= UINT32_MAX);
+
+    Header header = {
+        .uncompressedSize = static_cast<uint32_t>(src.size()),
+        .blockSize = blockSize,
+        .numBlocks = static_cast<uint32_t>((src.size() + blockSize - 1) / blockSize),
+    };
+    size_t blockDataOffset = GetBlockDataOffset(header);
+
+    std::vector<uint8_t> dst(blockDataOffset);
+    // incompressible data grows by a token and its length bytes per block
+    dst.reserve(blockDataOffset + src.size() + src.size() / 255 + header.numBlocks * 16);
+    std::memcpy(dst.data(), &header, sizeof(header));
+
+    std::vector<uint32_t> hashTable(1 << HashBits);
+    for (uint32_t block = 0; block < header.numBlocks; block++)
+    {
+        writeU32(dst, sizeof(Header) + block * sizeof(uint32_t), static_cast<uint32_t>(dst.size() - blockDataOffset));
+        size_t begin = static_cast<size_t>(block) * blockSize;
+        uint32_t size = static_cast<uint32_t>(std::min<size_t>(blockSize, src.size() - begin));
+        compressBlock(src.data() + begin, size, hashTable, dst);
+    }
+    writeU32(dst, sizeof(Header) + header.numBlocks * sizeof(uint32_t), static_cast<uint32_t>(dst.size() - blockDataOffset));
+    return dst;
+}
+
+bool LzCodec::IsCompressed(const std::span<const uint8_t> &data)
+{
+    return data.size() >= sizeof(Header) && readU32(data, offsetof(Header, magic)) == Magic;
+}
+
+size_t LzCodec::GetBlockDataOffset(const Header &header)
+{
+    return sizeof(Header) + (static_cast<size_t>(header.numBlocks) + 1) * sizeof(uint32_t);
+}
+
+bool LzCodec::ReadHeader(const std::span<const uint8_t> &compressed, Header &header)
+{
+    if (compressed.size() < sizeof(Header))
+    {
+        std::cerr << "Compressed payload is too small to hold a header" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, compressed.data(), sizeof(Header));
+
+    if (header.magic != Magic)
+    {
+        std::cerr << "Compressed payload has an unknown format" << std::endl;
+        return false;
+    }
+    if (header.blockSize == 0 || header.blockSize > MaxBlockSize || header.blockSize % 4 != 0
+        || header.numBlocks != (static_cast<uint64_t>(header.uncompressedSize) + header.blockSize - 1) / header.blockSize)
+    {
+        std::cerr << "Compressed payload has an invalid block layout" << std::endl;
+        return false;
+    }
+
+    size_t blockDataOffset = GetBlockDataOffset(header);
+    if (compressed.size() < blockDataOffset)
+    {
+        std::cerr << "Compressed payload is too small to hold its block offsets" << std::endl;
+        return false;
+    }
+    uint32_t prevOffset = 0;
+    for (uint32_t block = 0; block <= header.numBlocks; block++)
+    {
+        uint32_t offset = readU32(compressed, sizeof(Header) + block * sizeof(uint32_t));
+        if (offset < prevOffset || offset > compressed.size() - blockDataOffset)
+        {
+            std::cerr << "Compressed payload has invalid block offsets" << std::endl;
+            return false;
+        }
+        prevOffset = offset;
+    }
+    return true;
+}
+
+bool LzCodec::Decompress(const std::span<const uint8_t> &compressed, const std::span<uint8_t> &dst)
+{
+    Header header;
+    if (!ReadHeader(compressed, header))
+    {
+        return false;
+    }
+    if (dst.size() < header.uncompressedSize)
+    {
+        std::cerr << "Decompression target is too small" << std::endl;
+        return false;
+    }
+
+    const uint8_t *blockData = compressed.data() + GetBlockDataOffset(header);
+    for (uint32_t block = 0; block < header.numBlocks; block++)
+    {
+        uint32_t begin = readU32(compressed, sizeof(Header) + block * sizeof(uint32_t));
+        uint32_t end = readU32(compressed, sizeof(Header) + (block + 1) * sizeof(uint32_t));
+        size_t dstBegin = static_cast<size_t>(block) * header.blockSize;
+        size_t dstEnd = std::min<size_t>(dstBegin + header.blockSize, header.uncompressedSize);
+        if (!decompressBlock(blockData + begin, blockData + end, dst.data() + dstBegin, dst.data() + dstEnd))
+        {
+            std::cerr << "Compressed payload is corrupt in block " << block << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
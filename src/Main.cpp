@@ -57,7 +57,8 @@ int main()
     ShadingRenderPass shadingRenderPass(lightCullShader, lightShadeShader, mainCamera);
     Gui &gui = Gui::Get();
 
-    Mesh suzanneMesh(CONCAT(ASSET_PATH, "DamagedHelmet.glb"), mainRenderPass.m_pipeline);
+    auto meshPaths = std::to_array<std::string>({CONCAT(ASSET_PATH, "DamagedHelmet.glb")});
+    std::vector<std::unique_ptr<Mesh>> meshes = Mesh::LoadParallel(meshPaths, mainRenderPass.m_pipeline);
 
     renderer.addRenderPass(&editorRenderPass);
 
@@ -68,7 +69,7 @@ int main()
     shadingRenderPass.declareGBufferDependency(mainRenderPass.m_gBuffer);
 
     renderer.addRenderPass(&gui);
-    mainRenderPass.addMesh(&suzanneMesh);
+    mainRenderPass.addMeshes(meshes);
 
     double lastTime = glfwGetTime();
     int nbFrames = 0;
@@ -1,24 +1,38 @@
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <numeric>
 #include <vulkan/vulkan_core.h>
 
 #include "Common.h"
 #include "assimp/Importer.hpp"
 #include "assimp/postprocess.h"
 #include "assimp/scene.h"
+#include "glm/gtc/type_ptr.hpp"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
+#include "GltfLoader.h"
 #include "GpuResource.h"
+#include "IndexPacking.h"
+#include "LodBuilder.h"
+#include "LzCodec.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include "ObjLoader.h"
 #include "Renderer.h"
+#include "TextureDecoder.h"
+#include "VertexPacking.h"
 #include "VkInit.h"
 
 namespace
 {
-    static Assimp::Importer g_importer;
+    // part of the mesh cache key, so changing them re-cooks every mesh
+    constexpr uint32_t ImportFlags = aiProcessPreset_TargetRealtime_Quality | aiProcess_FindInstances | aiProcess_ValidateDataStructure
+                                     | aiProcess_OptimizeMeshes | aiProcess_Debone;
 
     template <typename T>
     [[nodiscard]] inline glm::vec3 toGlmVec3(const T &elem)
@@ -37,187 +51,604 @@ namespace
     {
         return glm::u32vec3(elem[0], elem[1], elem[2]);
     }
-}; // namespace
 
-Mesh::Mesh(const std::string &path, const GraphicsPipeline &pipeline)
-    : m_parentPipeline(pipeline)
-{
-    Renderer &renderer = Renderer::Get();
-    std::cout << "Loading mesh: " << path << std::endl;
-    const aiScene *scene = g_importer.ReadFile(path, aiProcessPreset_TargetRealtime_Quality | aiProcess_FindInstances
-                                                         | aiProcess_ValidateDataStructure | aiProcess_OptimizeMeshes | aiProcess_Debone);
+    // a LOD is only drawn while its simplification error covers at most this much of the screen
+    constexpr float MaxLodErrorPixels = 1.0f;
+    // a submesh whose visible meshlets would take more draws than this is drawn whole in a single one, past some point
+    // the draw overhead costs more than the culled triangles save
+    constexpr size_t MaxMeshletDraws = 16;
 
-    if (!scene)
+    // The view frustum and the camera position in the model space of a mesh, in which its meshlet bounds are
+    class MeshletCuller
     {
-        std::cout << "Import Failed: " << g_importer.GetErrorString() << std::endl;
-    }
+      public:
+        MeshletCuller(const glm::mat4 &modelView, const glm::mat4 &projection)
+        {
+            // planes of the Vulkan clip volume, -w <= x <= w, -w <= y <= w and 0 <= z <= w, pulled back into model space
+            glm::mat4 clip = projection * modelView;
+            auto row = [&](int i)
+            {
+                return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+            };
+            m_planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2)};
+            for (glm::vec4 &plane : m_planes)
+            {
+                plane /= glm::length(glm::vec3(plane));
+            }
+            m_cameraPosition = glm::vec3(glm::inverse(modelView)[3]);
+        }
 
-    size_t totalVertexCount = 0;
-    size_t totalFaceCount = 0;
-    size_t meshletVertexOffset = 0;
-    size_t meshletIndexOffset = 0;
+        [[nodiscard]] bool isInFrustum(const glm::vec4 &boundingSphere) const
+        {
+            for (const glm::vec4 &plane : m_planes)
+            {
+                if (glm::dot(glm::vec3(plane), glm::vec3(boundingSphere)) + plane.w < -boundingSphere.w)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
 
-    for (size_t i = 0; i < scene->mNumMeshes; i++)
+        // the cone test is scaled by the distance to the apex instead of normalizing, a camera right at the apex has no
+        // direction to it and keeps the meshlet
+        [[nodiscard]] bool isVisible(const MeshData::Meshlet &meshlet) const
+        {
+            glm::vec3 toApex = glm::vec3(meshlet.coneApex) - m_cameraPosition;
+            return isInFrustum(meshlet.boundingSphere) && glm::dot(toApex, meshlet.coneAxis) <= meshlet.coneCutoff * glm::length(toApex);
+        }
+
+      private:
+        std::array<glm::vec4, 6> m_planes;
+        glm::vec3 m_cameraPosition;
+    };
+
+    [[nodiscard]] double getElapsedMs(std::chrono::steady_clock::time_point start)
     {
-        aiMesh *mesh = scene->mMeshes[i];
-        totalVertexCount += mesh->mNumVertices;
-        totalFaceCount += mesh->mNumFaces;
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
-    for (size_t i = 0; i < scene->mNumTextures; i++)
+    [[nodiscard]] bool importMesh(const std::string &path, MeshData &data)
     {
-        aiTexture *texture = scene->mTextures[i];
+        // an importer holds the scene it read, so meshes loaded in parallel need one per thread
+        thread_local Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, ImportFlags);
+        if (!scene)
+        {
+            std::cout << "Import Failed: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        size_t totalVertexCount = 0;
+        size_t totalFaceCount = 0;
+        for (size_t i = 0; i < scene->mNumMeshes; i++)
+        {
+            aiMesh *mesh = scene->mMeshes[i];
+            totalVertexCount += mesh->mNumVertices;
+            totalFaceCount += mesh->mNumFaces;
+        }
+
+        // materials refer to embedded textures by file name, or by "*index" for compressed ones
+        std::unordered_map<std::string, uint32_t> textureIndices;
+        for (size_t i = 0; i < scene->mNumTextures; i++)
+        {
+            aiTexture *texture = scene->mTextures[i];
+
+            uint32_t width = texture->mWidth;
+            uint32_t height = texture->mHeight;
+
+            std::string path = texture->mFilename.length ? texture->mFilename.C_Str() : "";
+            MeshData::Texture &meshTexture = data.textures.emplace_back();
+
+            // if image is compressed the height will be 0 and width will be the number of bytes
+            if (!height)
+            {
+                std::span<const uint8_t> encoded((const uint8_t *)texture->pcData, texture->mWidth);
+                if (!TextureDecoder::ReadInfo(encoded, width, height))
+                {
+                    data.textures.pop_back();
+                    continue;
+                }
+                meshTexture.encoded = data.textureStorage.emplace_back(encoded.begin(), encoded.end());
+                path = std::string("*" + std::to_string(i));
+            }
+            else
+            {
+                const uint8_t *texels = (const uint8_t *)texture->pcData;
+                meshTexture.texels = data.textureStorage.emplace_back(texels, texels + width * height * TextureDecoder::NumComponents);
+            }
+            printf("%s: [%u, %u, %u]\n", texture->mFilename.C_Str(), width, height, TextureDecoder::NumComponents);
+
+            meshTexture.width = width;
+            meshTexture.height = height;
+            textureIndices.insert({path, static_cast<uint32_t>(data.textures.size() - 1)});
+        }
 
-        int width = texture->mWidth;
-        int height = texture->mHeight;
-        int numComponents = 0;
+        constexpr auto slotTypes = std::to_array<aiTextureType>({
+            aiTextureType_DIFFUSE,
+            aiTextureType_LIGHTMAP,
+            aiTextureType_EMISSIVE,
+            aiTextureType_NORMALS,
+        });
+        static_assert(slotTypes.size() == MeshData::TEXTURE_SLOT_COUNT);
 
-        std::string path = scene->mTextures[i]->mFilename.length ? scene->mTextures[i]->mFilename.C_Str() : "";
-        void *texelBuffer = scene->mTextures[i]->pcData;
+        data.materials.resize(scene->mNumMaterials);
+        for (size_t i = 0; i < scene->mNumMaterials; i++)
+        {
+            aiMaterial *mat = scene->mMaterials[i];
+            aiColor3D matColor;
+            mat->Get(AI_MATKEY_COLOR_DIFFUSE, matColor);
+            data.materials[i].diffuseColor = glm::vec4(toGlmVec3(matColor), 1.0f);
+            for (size_t slot = 0; slot < slotTypes.size(); slot++)
+            {
+                aiString texturePath;
+                mat->GetTexture(slotTypes[slot], 0, &texturePath);
+                auto textureIt = textureIndices.find(std::string(texturePath.C_Str()));
+                if (textureIt != textureIndices.end())
+                {
+                    data.materials[i].textures[slot] = textureIt->second;
+                }
+            }
+        }
+
+        data.submeshes.reserve(scene->mNumMeshes);
+        data.vertexStorage.reserve(totalVertexCount);
+        data.faceStorage.reserve(totalFaceCount);
 
-        // if image is compressed the height will be 0 and width will be the number of bytes
-        if (!height)
+        for (size_t i = 0; i < scene->mNumMeshes; i++)
         {
-            texelBuffer = (aiTexel *)stbi_load_from_memory((stbi_uc *)scene->mTextures[i]->pcData, texture->mWidth, &width, &height,
-                                                           &numComponents, STBI_rgb_alpha);
-            path = std::string("*" + std::to_string(i));
+            const aiMesh *mesh = scene->mMeshes[i];
+
+            data.submeshes.push_back({
+                .vertexOffset = static_cast<uint32_t>(data.vertexStorage.size()),
+                .indexOffset = static_cast<uint32_t>(data.faceStorage.size() * 3),
+                .indexCount = mesh->mNumFaces * 3,
+                .matIndex = mesh->mMaterialIndex,
+            });
+
+            for (size_t j = 0; j < mesh->mNumVertices; j++)
+            {
+                data.vertexStorage.emplace_back();
+                Vertex &backVertex = data.vertexStorage.back();
+                if (mesh->HasPositions())
+                {
+                    const aiVector3D &vertex = mesh->mVertices[j];
+                    backVertex.position = toGlmVec3(vertex);
+                }
+
+                if (mesh->HasNormals())
+                {
+                    const aiVector3D &normal = mesh->mNormals[j];
+                    backVertex.normal = toGlmVec3(normal);
+                }
+
+                if (mesh->HasTextureCoords(0))
+                {
+                    backVertex.textureCoordinate = toGlmVec2(mesh->mTextureCoords[0][j]);
+                }
+            }
+
+            for (size_t j = 0; j < mesh->mNumFaces; j++)
+            {
+                data.faceStorage.emplace_back(toU32GlmVec3(mesh->mFaces[j].mIndices));
+            }
         }
-        printf("%s: [%d, %d, %d]\n", texture->mFilename.C_Str(), width, height, STBI_rgb_alpha);
 
-        uint32_t bufferSize = width * height * STBI_rgb_alpha;
-        textures.insert({path, renderer.uploadTextureToGpu(std::span((uint8_t *)texelBuffer, bufferSize), width, height)});
-    }
+        // flattened breadth first, so every parent comes before its children
+        std::vector<std::pair<const aiNode *, uint32_t>> nodeQueue = {{scene->mRootNode, MeshData::NoParent}};
+        for (size_t head = 0; head < nodeQueue.size(); head++)
+        {
+            auto [node, parentIndex] = nodeQueue[head];
+            data.nodes.push_back({
+                // Assimp matrices are row major
+                .localTransform = glm::transpose(glm::make_mat4(&node->mTransformation.a1)),
+                .parentIndex = parentIndex,
+                .submeshOffset = static_cast<uint32_t>(data.nodeSubmeshes.size()),
+                .submeshCount = node->mNumMeshes,
+            });
+            data.nodeSubmeshes.insert(data.nodeSubmeshes.end(), node->mMeshes, node->mMeshes + node->mNumMeshes);
+            for (uint32_t i = 0; i < node->mNumChildren; i++)
+            {
+                nodeQueue.push_back({node->mChildren[i], static_cast<uint32_t>(head)});
+            }
+        }
 
-    // default sampler
-    sampler = VkInit::CreateVkSampler({});
+        // everything was copied out of the scene
+        importer.FreeScene();
+        data.vertices = data.vertexStorage;
+        data.faces = data.faceStorage;
+        return true;
+    }
 
-    for (size_t i = 0; i < scene->mNumMaterials; i++)
+    // The content hashes cover what the importer produced, the compressed image where there is one, so they are taken
+    // without decoding and carried over into the cache
+    void hashTextures(MeshData &data, ThreadPool &threadPool)
     {
-        aiString diffusePath;
-        aiString aoPath;
-        aiString emissivePath;
-        aiString normalPath;
+        threadPool.parallelFor(data.textures.size(),
+                               [&](size_t i)
+                               {
+                                   MeshData::Texture &texture = data.textures[i];
+                                   // the texels alone would match images of the same size in another shape
+                                   uint64_t dimensions = static_cast<uint64_t>(texture.width) << 32 | texture.height;
+                                   texture.contentHash =
+                                       MeshCache::Hash(texture.encoded.empty() ? texture.texels : texture.encoded) ^ dimensions;
+                               });
+    }
 
-        aiMaterial *mat = scene->mMaterials[i];
-        mat->GetTexture(aiTextureType_DIFFUSE, 0, &diffusePath);
-        mat->GetTexture(aiTextureType_LIGHTMAP, 0, &aoPath);
-        mat->GetTexture(aiTextureType_EMISSIVE, 0, &emissivePath);
-        mat->GetTexture(aiTextureType_NORMALS, 0, &normalPath);
+    // The cache stores decoded texels, so images are decoded once when the mesh is cooked rather than on every load.
+    // The mesh being cooked keeps its compressed textures, they are decoded by the upload scheduler straight into
+    // staging memory, so these copies only serve the cache. texelStorage backs the returned textures
+    [[nodiscard]] std::vector<MeshData::Texture> decodeTextures(const MeshData &data, std::vector<std::vector<uint8_t>> &texelStorage,
+                                                                ThreadPool &threadPool)
+    {
+        std::vector<MeshData::Texture> decoded = data.textures;
+        texelStorage.resize(decoded.size());
+        threadPool.parallelFor(decoded.size(),
+                               [&](size_t i)
+                               {
+                                   MeshData::Texture &texture = decoded[i];
+                                   if (texture.encoded.empty())
+                                   {
+                                       return;
+                                   }
+                                   std::vector<uint8_t> &texels = texelStorage[i];
+                                   texels.resize(TextureDecoder::GetDecodeSize(texture.width, texture.height));
+                                   // a texture that fails to decode is cooked white, like one that fails during the upload
+                                   if (!TextureDecoder::DecodeRgba8(texture.encoded, texels))
+                                   {
+                                       std::fill(texels.begin(), texels.end(), 0xff);
+                                   }
+                                   size_t texelSize = static_cast<size_t>(texture.width) * texture.height * TextureDecoder::NumComponents;
+                                   texture.texels = std::span(texels).first(texelSize);
+                                   texture.encoded = {};
+                               });
+        return decoded;
+    }
 
-        matDescriptorSets.push_back(renderer.allocateDescriptorSet(m_parentPipeline.m_descriptorSetLayouts[DSL_FREQ_PER_MAT]));
-        Renderer::DescriptorUpdateState descriptorImageInfo = {
-            .descriptorSet = matDescriptorSets.back(),
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            .imageSampler = sampler,
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    // Loads the cooked mesh when the cache is up to date, otherwise imports the source and cooks it for the next load.
+    // Binary glTF and obj files go through the native loaders, everything else and files they can't handle through
+    // Assimp. Submeshes are reordered for the vertex cache, split into meshlets and simplified into LODs, vertices cooked
+    // in the selected vertex format, so changing it re-cooks the mesh, and indices narrowed to 16 bits where they fit
+    [[nodiscard]] MeshData loadMeshData(const std::string &path)
+    {
+        auto loadStart = std::chrono::steady_clock::now();
+        ThreadPool &threadPool = Renderer::Get().getThreadPool();
+        MeshData data;
+        auto source = std::make_shared<const MappedFile>(path);
+        bool isGlb = GltfLoader::IsGlb(source->data());
+        bool isObj = !isGlb && ObjLoader::IsObj(path);
+        MeshCache::Key key = {
+            .sourceHash = MeshCache::Hash(source->data()),
+            .importFlags = isGlb ? GltfLoader::ImportFlags : isObj ? ObjLoader::ImportFlags : ImportFlags,
+            .vertexFormat = VertexPacking::GetSelectedFormat(),
         };
 
-        if (textures.count(std::string(diffusePath.C_Str())))
+        std::string cachePath = MeshCache::GetCachePath(path);
+        if (MeshCache::Load(cachePath, key, data))
         {
-            printf("Found diffuse texture: %s in texture map!\n", diffusePath.C_Str());
-            Handle<Image> &diffuseTexture = textures.at(std::string(diffusePath.C_Str()));
-            descriptorImageInfo.imageView = renderer.get(diffuseTexture)->getImageViewByFormat();
-            descriptorImageInfo.binding = 0;
-            renderer.updateDescriptor(descriptorImageInfo);
+            std::cout << "Loaded cooked mesh " << cachePath << " in " << getElapsedMs(loadStart) << " ms" << std::endl;
+            return data;
         }
-        if (textures.count(std::string(aoPath.C_Str())))
+
+        bool imported = (isGlb && GltfLoader::Load(source, data)) || (isObj && ObjLoader::Load(path, *source, threadPool, data))
+                        || importMesh(path, data);
+        // a loader that gave up may have left part of the file behind
+        if (!imported)
         {
-            printf("Found ambient occlusion texture: %s in texture map!\n", aoPath.C_Str());
-            Handle<Image> &aoTexture = textures.at(std::string(aoPath.C_Str()));
-            descriptorImageInfo.imageView = renderer.get(aoTexture)->getImageViewByFormat();
-            descriptorImageInfo.binding = 1;
-            renderer.updateDescriptor(descriptorImageInfo);
+            std::cerr << "Failed to import " << path << std::endl;
+            return {};
         }
-        if (textures.count(std::string(emissivePath.C_Str())))
+
+        // files without a hierarchy draw every submesh once, untransformed
+        if (data.nodes.empty())
         {
-            printf("Found emissive texture: %s in texture map!\n", emissivePath.C_Str());
-            Handle<Image> &emissiveTexture = textures.at(std::string(emissivePath.C_Str()));
-            descriptorImageInfo.imageView = renderer.get(emissiveTexture)->getImageViewByFormat();
-            descriptorImageInfo.binding = 2;
-            renderer.updateDescriptor(descriptorImageInfo);
+            data.nodes.push_back({.submeshCount = static_cast<uint32_t>(data.submeshes.size())});
+            data.nodeSubmeshes.resize(data.submeshes.size());
+            std::iota(data.nodeSubmeshes.begin(), data.nodeSubmeshes.end(), 0);
         }
-        if (textures.count(std::string(normalPath.C_Str())))
+        MeshOptimizer::Stats importedStats = MeshOptimizer::Analyze(data);
+        MeshOptimizer::Optimize(data, threadPool);
+        MeshOptimizer::Stats optimizedStats = MeshOptimizer::Analyze(data);
+        std::cout << "Vertex cache ACMR " << importedStats.getAcmr() << " -> " << optimizedStats.getAcmr() << ", ATVR "
+                  << importedStats.getAtvr() << " -> " << optimizedStats.getAtvr() << std::endl;
+        MeshletBuilder::Build(data, threadPool);
+        LodBuilder::Build(data, threadPool);
+        VertexPacking::Pack(key.vertexFormat, data);
+        IndexPacking::Pack(data);
+        hashTextures(data, threadPool);
+        std::vector<std::vector<uint8_t>> cookedTexels;
+        std::vector<MeshData::Texture> cookedTextures = decodeTextures(data, cookedTexels, threadPool);
+        std::swap(data.textures, cookedTextures);
+        // a failed write only costs the next load another import
+        bool stored = MeshCache::Store(cachePath, key, data);
+        std::swap(data.textures, cookedTextures);
+        if (stored)
         {
-            printf("Found normal map: %s in texture map!\n", normalPath.C_Str());
-            Handle<Image> &normalTexture = textures.at(std::string(normalPath.C_Str()));
-            descriptorImageInfo.imageView = renderer.get(normalTexture)->getImageViewByFormat();
-            descriptorImageInfo.binding = 3;
-            renderer.updateDescriptor(descriptorImageInfo);
+            std::cout << "Cooked mesh to " << cachePath << std::endl;
         }
+        std::cout << "Imported mesh in " << getElapsedMs(loadStart) << " ms" << std::endl;
+        return data;
     }
+}; // namespace
 
-    meshletVertexOffsets.reserve(scene->mNumMeshes);
-    meshletIndexOffsets.reserve(scene->mNumMeshes);
-    meshletIndexSizes.reserve(scene->mNumMeshes);
-    matIndex.reserve(scene->mNumMeshes);
-    vertices.reserve(totalVertexCount);
-    faces.reserve(totalFaceCount);
-
-    for (size_t i = 0; i < scene->mNumMeshes; i++)
+Mesh::Mesh(const std::string &path, const GraphicsPipeline &pipeline)
+    : m_parentPipeline(pipeline)
+{
+    Renderer &renderer = Renderer::Get();
+    std::cout << "Loading mesh: " << path << std::endl;
+    meshData = loadMeshData(path);
+    if (meshData.submeshes.empty())
     {
-        const aiMesh *mesh = scene->mMeshes[i];
-        const uint32_t matIdx = mesh->mMaterialIndex;
-        const aiMaterial *mat = scene->mMaterials[matIdx];
+        std::cerr << "Mesh " << path << " has no geometry and is not drawn" << std::endl;
+        return;
+    }
 
-        meshletVertexOffsets.push_back(meshletVertexOffset);
-        meshletIndexOffsets.push_back(meshletIndexOffset);
-        meshletIndexSizes.push_back(mesh->mNumFaces * 3);
-        matIndex.push_back(mesh->mMaterialIndex);
+    // textures are shared with every other mesh using the same image and handed to the upload scheduler by the first
+    // one, which may get to them frames later. The spans stay valid since meshData is kept until the mesh is resident,
+    // and a mesh destroyed before then settles its tickets first
+    textures.reserve(meshData.textures.size());
+    textureHashes.reserve(meshData.textures.size());
+    textureTickets.reserve(meshData.textures.size());
+    for (const MeshData::Texture &texture : meshData.textures)
+    {
+        Renderer::TextureUpload textureUpload = {
+            .data = texture.texels,
+            .encoded = texture.encoded,
+            .width = texture.width,
+            .height = texture.height,
+        };
+        UploadTicket ticket = renderer.acquireTexture(texture.contentHash, textureUpload, textures.emplace_back());
+        uploadTickets.push_back(ticket);
+        textureHashes.push_back(texture.contentHash);
+        textureTickets.push_back(ticket);
+    }
 
-        meshletIndexOffset += mesh->mNumFaces * 3;
-        meshletVertexOffset += mesh->mNumVertices;
+    // default sampler
+    sampler = VkInit::CreateVkSampler({
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    });
 
-        aiColor3D matColor;
-        mat->Get(AI_MATKEY_COLOR_DIFFUSE, matColor);
-        glm::vec3 diffuseColor = toGlmVec3(matColor);
+    for (const MeshData::Material &material : meshData.materials)
+    {
+        matDescriptorSets.push_back(renderer.allocateDescriptorSet(m_parentPipeline.m_descriptorSetLayouts[DSL_FREQ_PER_MAT]));
+        Renderer::DescriptorUpdateState descriptorImageInfo = {
+            .descriptorSet = matDescriptorSets.back(),
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .imageSampler = sampler,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        };
 
-        for (size_t j = 0; j < mesh->mNumVertices; j++)
+        for (uint32_t slot = 0; slot < MeshData::TEXTURE_SLOT_COUNT; slot++)
         {
-            vertices.emplace_back();
-            Vertex &backVertex = vertices.back();
-            backVertex.color = diffuseColor;
-            if (mesh->HasPositions())
+            if (material.textures[slot] != MeshData::NoTexture)
             {
-                const aiVector3D &vertex = mesh->mVertices[j];
-                backVertex.position = toGlmVec3(vertex);
+                descriptorImageInfo.imageView = renderer.get(textures[material.textures[slot]])->getImageViewByFormat();
+                descriptorImageInfo.binding = slot;
+                renderer.updateDescriptor(descriptorImageInfo);
             }
+        }
+    }
 
-            if (mesh->HasNormals())
-            {
-                const aiVector3D &normal = mesh->mNormals[j];
-                backVertex.normal = toGlmVec3(normal);
-            }
+    // the vertices and indices go into the renderer's shared buffers, so the draws offset into them. A mesh that doesn't
+    // fit is left out rather than given buffers of its own. Cooked vertices are compressed and only expanded on the GPU
+    std::span<const uint8_t> vertexData = meshData.packedVertices;
+    std::span<const uint8_t> indexData = meshData.packedIndices;
+    VkDeviceSize vertexSize = vertexData.size();
+    LzCodec::Header compressedHeader;
+    if (!meshData.compressedVertices.empty() && LzCodec::ReadHeader(meshData.compressedVertices, compressedHeader))
+    {
+        vertexSize = compressedHeader.uncompressedSize;
+    }
+    uint32_t vertexStride = VertexPacking::GetStride(meshData.vertexFormat);
+    bool allocated = renderer.allocateGeometry(GeometryBuffer::Vertex, vertexSize, vertexStride, vertexAllocation)
+                     && renderer.allocateGeometry(GeometryBuffer::Index, indexData.size(), sizeof(uint32_t), indexAllocation);
+    if (allocated)
+    {
+        Handle<Buffer> vertexBuffer = renderer.getGeometryBuffer(GeometryBuffer::Vertex);
+        Handle<Buffer> indexBuffer = renderer.getGeometryBuffer(GeometryBuffer::Index);
+        uploadTickets.push_back(
+            meshData.compressedVertices.empty()
+                ? renderer.requestBufferUpload(vertexData, vertexBuffer, vertexAllocation.offset)
+                : renderer.requestCompressedBufferUpload(meshData.compressedVertices, vertexBuffer, vertexAllocation.offset));
+        uploadTickets.push_back(renderer.requestBufferUpload(indexData, indexBuffer, indexAllocation.offset));
+    }
+    else
+    {
+        std::cerr << "Geometry buffers are full, " << path << " is not drawn" << std::endl;
+    }
+    VkDeviceSize baseVertex = vertexAllocation.offset / vertexStride;
+
+    submeshVertexOffsets.reserve(meshData.submeshes.size());
+    submeshIndexBases.reserve(meshData.submeshes.size());
+    submeshIndexOffsets.reserve(meshData.submeshes.size());
+    submeshIndexSizes.reserve(meshData.submeshes.size());
+    submeshIndexTypes.reserve(meshData.submeshes.size());
+    matIndex.reserve(meshData.submeshes.size());
+    submeshDrawConstants.reserve(meshData.submeshes.size());
+    for (const MeshData::Submesh &submesh : meshData.submeshes)
+    {
+        submeshVertexOffsets.push_back(baseVertex + submesh.vertexOffset);
+        // the index allocation is aligned to both index sizes
+        submeshIndexBases.push_back(static_cast<uint32_t>(indexAllocation.offset / submesh.indexSize));
+        submeshIndexOffsets.push_back(submesh.indexOffset);
+        submeshIndexSizes.push_back(submesh.indexCount);
+        submeshIndexTypes.push_back(submesh.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+        submeshMeshletOffsets.push_back(submesh.meshletOffset);
+        submeshMeshletCounts.push_back(submesh.meshletCount);
+        submeshBoundingSpheres.push_back(submesh.boundingSphere);
+        submeshLodOffsets.push_back(submesh.lodOffset);
+        submeshLodCounts.push_back(submesh.lodCount);
+        matIndex.push_back(submesh.matIndex);
+        submeshDrawConstants.push_back({
+            .positionScale = glm::vec4(submesh.positionScale, 0.0f),
+            .positionOffset = glm::vec4(submesh.positionOffset, 0.0f),
+            .diffuseColor = meshData.materials[submesh.matIndex].diffuseColor,
+        });
+    }
 
-            if (mesh->HasTextureCoords(0))
-            {
-                backVertex.textureCoordinate = toGlmVec2(mesh->mTextureCoords[0][j]);
-            }
-        }
+    nodeParents.reserve(meshData.nodes.size());
+    nodeLocalTransforms.reserve(meshData.nodes.size());
+    nodeSubmeshOffsets.reserve(meshData.nodes.size());
+    nodeSubmeshCounts.reserve(meshData.nodes.size());
+    for (const MeshData::Node &node : meshData.nodes)
+    {
+        nodeParents.push_back(node.parentIndex);
+        nodeLocalTransforms.push_back(node.localTransform);
+        nodeSubmeshOffsets.push_back(node.submeshOffset);
+        nodeSubmeshCounts.push_back(allocated ? node.submeshCount : 0);
+    }
+    nodeWorldTransforms.resize(nodeLocalTransforms.size());
+    nodeSubmeshes = meshData.nodeSubmeshes;
+    updateNodeTransforms();
+
+    // meshlets and LODs are only read by the culling on the CPU, they never go to the GPU
+    meshlets = meshData.meshlets;
+    lods = meshData.lods;
+}
 
-        for (size_t j = 0; j < mesh->mNumFaces; j++)
+std::vector<std::unique_ptr<Mesh>> Mesh::LoadParallel(const std::span<const std::string> &paths, const GraphicsPipeline &pipeline)
+{
+    // the import steps of every mesh run their own parallel loops on the same pool, nested in the per mesh items
+    std::vector<std::unique_ptr<Mesh>> meshes(paths.size());
+    Renderer::Get().getThreadPool().parallelFor(paths.size(),
+                                                [&](size_t i)
+                                                {
+                                                    meshes[i] = std::make_unique<Mesh>(paths[i], pipeline);
+                                                });
+    return meshes;
+}
+
+bool Mesh::isResident()
+{
+    Renderer &renderer = Renderer::Get();
+    for (UploadTicket ticket : uploadTickets)
+    {
+        if (!renderer.isUploadComplete(ticket))
         {
-            faces.emplace_back(toU32GlmVec3(mesh->mFaces[j].mIndices));
+            return false;
         }
     }
 
-    vkVertexBuffer = renderer.uploadCpuBufferToGpu(std::span((uint8_t *)vertices.data(), vertices.size() * sizeof(vertices[0])),
-                                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    vkIndexBuffer = renderer.uploadCpuBufferToGpu(std::span((uint8_t *)faces.data(), faces.size() * sizeof(faces[0])),
-                                                  VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    uploadTickets.clear();
+    meshData = {};
+    return true;
+}
+
+void Mesh::updateNodeTransforms()
+{
+    // parents come first, so their world transform is final by the time a child reads it
+    for (size_t i = 0; i < nodeParents.size(); i++)
+    {
+        uint32_t parent = nodeParents[i];
+        nodeWorldTransforms[i] = nodeLocalTransforms[i];
+        if (parent != MeshData::NoParent)
+        {
+            nodeWorldTransforms[i] = nodeWorldTransforms[parent] * nodeLocalTransforms[i];
+        }
+    }
 }
 
-void Mesh::drawMesh(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout)
+void Mesh::drawMesh(VkCommandBuffer cmdBuf, VkPipelineLayout pipelineLayout, const glm::mat4 &view, const glm::mat4 &projection,
+                    VkIndexType &boundIndexType)
 {
-    VkDeviceSize offset = 0;
-    vkCmdBindIndexBuffer(cmdBuf, Renderer::Get().get(vkIndexBuffer)->m_buffer, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdBindVertexBuffers(cmdBuf, 0, 1, &Renderer::Get().get(vkVertexBuffer)->m_buffer, &offset);
+    if (!isResident())
+    {
+        return;
+    }
+
+    Renderer &renderer = Renderer::Get();
+    VkBuffer indexBuffer = renderer.get(renderer.getGeometryBuffer(GeometryBuffer::Index))->m_buffer;
+
+    // A LOD error of e at distance d covers e / d * projection[1][1] half screen heights
+    float pixelsPerUnitError = std::abs(projection[1][1]) * static_cast<float>(renderer.getDrawAreaExtent().height) * 0.5f;
 
-    for (uint32_t i = 0; i < meshletVertexOffsets.size(); i++)
+    // visible meshlets that are next to each other in the index buffer are drawn together
+    std::vector<std::pair<uint32_t, uint32_t>> indexRuns;
+    for (size_t nodeIdx = 0; nodeIdx < nodeParents.size(); nodeIdx++)
     {
-        VkDescriptorSet descriptorSet = matDescriptorSets[matIndex[i]];
+        if (nodeSubmeshCounts[nodeIdx] == 0)
+        {
+            continue;
+        }
+
+        const glm::mat4 &model = nodeWorldTransforms[nodeIdx];
+        glm::mat4 modelView = view * model;
+        MeshletCuller culler(modelView, projection);
+        // the model view may scale the mesh, its largest axis scale keeps the estimate conservative
+        float modelScale = std::max({glm::length(glm::vec3(modelView[0])), glm::length(glm::vec3(modelView[1])),
+                                     glm::length(glm::vec3(modelView[2]))});
+        float pixelsPerError = modelScale * pixelsPerUnitError;
+        vkCmdPushConstants(cmdBuf, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(PushConstants, M), sizeof(glm::mat4), &model);
+
+        uint32_t nodeSubmeshEnd = nodeSubmeshOffsets[nodeIdx] + nodeSubmeshCounts[nodeIdx];
+        for (uint32_t nodeSubmeshIdx = nodeSubmeshOffsets[nodeIdx]; nodeSubmeshIdx < nodeSubmeshEnd; nodeSubmeshIdx++)
+        {
+            uint32_t i = nodeSubmeshes[nodeSubmeshIdx];
+            indexRuns.clear();
+            const glm::vec4 &boundingSphere = submeshBoundingSpheres[i];
+            // the distance to the nearest point of the bounding sphere, where the error would be largest
+            float distance = glm::length(glm::vec3(modelView * glm::vec4(glm::vec3(boundingSphere), 1.0f))) - boundingSphere.w * modelScale;
+            const MeshData::Lod *selectedLod = nullptr;
+            for (uint32_t lodIdx = submeshLodOffsets[i]; lodIdx < submeshLodOffsets[i] + submeshLodCounts[i] && distance > 0.0f; lodIdx++)
+            {
+                if (lods[lodIdx].error * pixelsPerError > MaxLodErrorPixels * distance)
+                {
+                    break;
+                }
+                selectedLod = &lods[lodIdx];
+            }
+            if (selectedLod)
+            {
+                if (culler.isInFrustum(boundingSphere))
+                {
+                    indexRuns.push_back({selectedLod->indexOffset, selectedLod->indexCount});
+                }
+            }
+            else
+            {
+                uint32_t meshletEnd = submeshMeshletOffsets[i] + submeshMeshletCounts[i];
+                for (uint32_t meshletIdx = submeshMeshletOffsets[i]; meshletIdx < meshletEnd; meshletIdx++)
+                {
+                    const MeshData::Meshlet &meshlet = meshlets[meshletIdx];
+                    if (!culler.isVisible(meshlet))
+                    {
+                        continue;
+                    }
+                    if (!indexRuns.empty() && indexRuns.back().first + indexRuns.back().second == meshlet.indexOffset)
+                    {
+                        indexRuns.back().second += meshlet.indexCount;
+                    }
+                    else
+                    {
+                        indexRuns.push_back({meshlet.indexOffset, meshlet.indexCount});
+                    }
+                }
+                if (indexRuns.size() > MaxMeshletDraws)
+                {
+                    indexRuns.assign(1, {submeshIndexOffsets[i], submeshIndexSizes[i]});
+                }
+            }
+            if (indexRuns.empty())
+            {
+                continue;
+            }
+
+            if (submeshIndexTypes[i] != boundIndexType)
+            {
+                boundIndexType = submeshIndexTypes[i];
+                vkCmdBindIndexBuffer(cmdBuf, indexBuffer, 0, boundIndexType);
+            }
+            VkDescriptorSet descriptorSet = matDescriptorSets[matIndex[i]];
 
-        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DSL_FREQ_PER_MAT, 1, &descriptorSet, 0, nullptr);
-        vkCmdDrawIndexed(cmdBuf, meshletIndexSizes[i], 1, meshletIndexOffsets[i], meshletVertexOffsets[i], 0);
+            vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DSL_FREQ_PER_MAT, 1, &descriptorSet, 0,
+                                    nullptr);
+            vkCmdPushConstants(cmdBuf, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(PushConstants), sizeof(DrawPushConstants),
+                               &submeshDrawConstants[i]);
+            for (const auto &[indexOffset, indexCount] : indexRuns)
+            {
+                vkCmdDrawIndexed(cmdBuf, indexCount, 1, submeshIndexBases[i] + indexOffset, submeshVertexOffsets[i], 0);
+            }
+        }
     }
 }
 
@@ -225,14 +656,18 @@ Mesh::~Mesh()
 {
     Renderer &renderer = Renderer::Get();
 
-    vmaDestroyBuffer(renderer.getAllocator(), Renderer::Get().get(vkVertexBuffer)->m_buffer,
-                     Renderer::Get().get(vkVertexBuffer)->m_allocation);
-    vmaDestroyBuffer(renderer.getAllocator(), Renderer::Get().get(vkIndexBuffer)->m_buffer,
-                     Renderer::Get().get(vkIndexBuffer)->m_allocation);
-    vkFreeDescriptorSets(renderer.getDevice(), renderer.getDescriptorPool(), matDescriptorSets.size(), matDescriptorSets.data());
-    vkDestroySampler(renderer.getDevice(), sampler, nullptr);
-    for (auto &kv : textures)
+    // uploads that haven't been scheduled yet are dropped instead of being issued for data that is going away, the
+    // textures settle their shared tickets on release
+    for (size_t i = 0; i < textureHashes.size(); i++)
+    {
+        renderer.releaseTexture(textureHashes[i], textureTickets[i]);
+    }
+    for (UploadTicket ticket : uploadTickets)
     {
-        renderer.destroy(kv.second);
+        renderer.cancelUpload(ticket);
     }
+    renderer.freeGeometry(vertexAllocation);
+    renderer.freeGeometry(indexAllocation);
+    renderer.freeDescriptorSets(matDescriptorSets);
+    vkDestroySampler(renderer.getDevice(), sampler, nullptr);
 }
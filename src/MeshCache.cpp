@@ -0,0 +1,436 @@
+#include "MeshCache.h"
+#include "LzCodec.h"
+#include "VertexPacking.h"
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t Magic = 0x4d435050; // "PPCM"
+    // at least a cache line, so every section can be read with aligned loads
+    constexpr size_t SectionAlignment = 64;
+
+    struct Header
+    {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        uint64_t sourceHash = 0;
+        uint32_t importFlags = 0;
+        uint32_t numSubmeshes = 0;
+        uint32_t numMaterials = 0;
+        uint32_t numTextures = 0;
+        uint32_t vertexFormat = 0;
+        // checked against the stride of vertexFormat, catches a packed layout changing without a version bump
+        uint32_t vertexStride = 0;
+        uint64_t numVertices = 0;
+        // in bytes, the vertex section is an LzCodec payload of numVertices * vertexStride bytes
+        uint64_t vertexSize = 0;
+        // in bytes, the indices of each submesh are in its own indexSize
+        uint64_t packedIndexSize = 0;
+        uint64_t numMeshlets = 0;
+        uint64_t numLods = 0;
+        uint64_t numNodes = 0;
+        uint64_t numNodeSubmeshes = 0;
+        uint64_t vertexOffset = 0;
+        uint64_t indexOffset = 0;
+        uint64_t submeshOffset = 0;
+        uint64_t meshletOffset = 0;
+        uint64_t lodOffset = 0;
+        uint64_t nodeOffset = 0;
+        uint64_t nodeSubmeshOffset = 0;
+        uint64_t materialOffset = 0;
+        uint64_t textureOffset = 0;
+    };
+
+    struct CookedTexture
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // an LzCodec payload of texelSize bytes, which always expands to width * height * 4 bytes of RGBA8
+        uint64_t texelOffset = 0;
+        uint64_t texelSize = 0;
+        uint64_t contentHash = 0;
+    };
+
+    [[nodiscard]] size_t alignUp(size_t offset)
+    {
+        return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+    }
+
+    [[nodiscard]] bool isInFile(const std::span<const uint8_t> &file, uint64_t offset, uint64_t count, size_t elemSize)
+    {
+        return offset % SectionAlignment == 0 && offset <= file.size() && count <= (file.size() - offset) / elemSize;
+    }
+
+    [[nodiscard]] uint64_t getTexelSize(uint32_t width, uint32_t height)
+    {
+        return static_cast<uint64_t>(width) * height * 4;
+    }
+
+    // the payloads are only expanded during the upload, so their headers are all that is checked here
+    [[nodiscard]] bool isPayloadOf(const std::span<const uint8_t> &payload, uint64_t uncompressedSize)
+    {
+        LzCodec::Header header;
+        return LzCodec::ReadHeader(payload, header) && header.uncompressedSize == uncompressedSize;
+    }
+
+    constexpr uint64_t Prime1 = 0x9e3779b185ebca87ull;
+    constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4full;
+    constexpr uint64_t Prime3 = 0x165667b19e3779f9ull;
+
+    [[nodiscard]] uint64_t hashRound(uint64_t acc, uint64_t input)
+    {
+        return std::rotl(acc + input * Prime2, 31) * Prime1;
+    }
+
+    [[nodiscard]] uint64_t readU64(const uint8_t *src)
+    {
+        uint64_t value;
+        std::memcpy(&value, src, sizeof(value));
+        return value;
+    }
+} // namespace
+
+uint64_t MeshCache::Hash(const std::span<const uint8_t> &data)
+{
+    // four independent lanes keep the multiplies pipelined, which hashes at close to memory bandwidth
+    std::array<uint64_t, 4> lanes = {Prime1 + Prime2, Prime2, 0, 0 - Prime1};
+    const uint8_t *src = data.data();
+    const uint8_t *end = src + data.size();
+    for (; end - src >= 32; src += 32)
+    {
+        for (size_t lane = 0; lane < lanes.size(); lane++)
+        {
+            lanes[lane] = hashRound(lanes[lane], readU64(src + lane * 8));
+        }
+    }
+
+    uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+    hash += data.size();
+    for (; end - src >= 8; src += 8)
+    {
+        hash = std::rotl(hash ^ hashRound(0, readU64(src)), 27) * Prime1 + Prime3;
+    }
+    for (; src < end; src++)
+    {
+        hash = std::rotl(hash ^ (*src * Prime3), 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string MeshCache::GetCachePath(const std::string &sourcePath)
+{
+    std::filesystem::path path(sourcePath);
+    if (const char *cacheDir = std::getenv("PACEM_MESH_CACHE_DIR"); cacheDir && *cacheDir)
+    {
+        // assets from different directories may share a file name, so the name is qualified by a hash of the full path
+        std::string absolutePath = std::filesystem::absolute(path).lexically_normal().string();
+        uint64_t pathHash = Hash(std::span(reinterpret_cast<const uint8_t *>(absolutePath.data()), absolutePath.size()));
+        char hashText[17];
+        snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(pathHash));
+        return (std::filesystem::path(cacheDir) / path.filename()).string() + "." + hashText + ".cooked";
+    }
+    return path.string() + ".cooked";
+}
+
+bool MeshCache::Load(const std::string &cachePath, const Key &key, MeshData &data)
+{
+    auto mapping = std::make_shared<const MappedFile>(cachePath);
+    if (!mapping->isOpen())
+    {
+        return false;
+    }
+
+    std::span<const uint8_t> file = mapping->data();
+    Header header;
+    if (file.size() < sizeof(Header))
+    {
+        std::cerr << "Mesh cache " << cachePath << " is truncated" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(Header));
+    if (header.magic != Magic || header.version != Version || header.sourceHash != key.sourceHash
+        || header.importFlags != key.importFlags || header.vertexFormat != key.vertexFormat)
+    {
+        std::cout << "Mesh cache " << cachePath << " is stale" << std::endl;
+        return false;
+    }
+
+    uint32_t vertexStride = VertexPacking::GetStride(key.vertexFormat);
+    if (header.vertexStride != vertexStride || !isInFile(file, header.vertexOffset, header.vertexSize, 1)
+        || !isPayloadOf(file.subspan(header.vertexOffset, header.vertexSize), header.numVertices * vertexStride)
+        || !isInFile(file, header.indexOffset, header.packedIndexSize, 1)
+        || !isInFile(file, header.submeshOffset, header.numSubmeshes, sizeof(MeshData::Submesh))
+        || !isInFile(file, header.meshletOffset, header.numMeshlets, sizeof(MeshData::Meshlet))
+        || !isInFile(file, header.lodOffset, header.numLods, sizeof(MeshData::Lod))
+        || !isInFile(file, header.nodeOffset, header.numNodes, sizeof(MeshData::Node))
+        || !isInFile(file, header.nodeSubmeshOffset, header.numNodeSubmeshes, sizeof(uint32_t))
+        || !isInFile(file, header.materialOffset, header.numMaterials, sizeof(MeshData::Material))
+        || !isInFile(file, header.textureOffset, header.numTextures, sizeof(CookedTexture)))
+    {
+        std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+        return false;
+    }
+
+    MeshData cooked;
+    cooked.vertexFormat = key.vertexFormat;
+    cooked.compressedVertices = file.subspan(header.vertexOffset, header.vertexSize);
+    cooked.packedIndices = file.subspan(header.indexOffset, header.packedIndexSize);
+    cooked.submeshes.resize(header.numSubmeshes);
+    std::memcpy(cooked.submeshes.data(), file.data() + header.submeshOffset, header.numSubmeshes * sizeof(MeshData::Submesh));
+    cooked.meshlets.resize(header.numMeshlets);
+    std::memcpy(cooked.meshlets.data(), file.data() + header.meshletOffset, header.numMeshlets * sizeof(MeshData::Meshlet));
+    cooked.lods.resize(header.numLods);
+    std::memcpy(cooked.lods.data(), file.data() + header.lodOffset, header.numLods * sizeof(MeshData::Lod));
+    cooked.nodes.resize(header.numNodes);
+    std::memcpy(cooked.nodes.data(), file.data() + header.nodeOffset, header.numNodes * sizeof(MeshData::Node));
+    cooked.nodeSubmeshes.resize(header.numNodeSubmeshes);
+    std::memcpy(cooked.nodeSubmeshes.data(), file.data() + header.nodeSubmeshOffset, header.numNodeSubmeshes * sizeof(uint32_t));
+    cooked.materials.resize(header.numMaterials);
+    std::memcpy(cooked.materials.data(), file.data() + header.materialOffset, header.numMaterials * sizeof(MeshData::Material));
+
+    const auto *cookedTextures = reinterpret_cast<const CookedTexture *>(file.data() + header.textureOffset);
+    cooked.textures.reserve(header.numTextures);
+    for (uint32_t i = 0; i < header.numTextures; i++)
+    {
+        const CookedTexture &texture = cookedTextures[i];
+        if (!isInFile(file, texture.texelOffset, texture.texelSize, 1)
+            || !isPayloadOf(file.subspan(texture.texelOffset, texture.texelSize), getTexelSize(texture.width, texture.height)))
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+        cooked.textures.push_back({
+            .encoded = file.subspan(texture.texelOffset, texture.texelSize),
+            .width = texture.width,
+            .height = texture.height,
+            .contentHash = texture.contentHash,
+        });
+    }
+
+    // the draws trust these, so a damaged file must not get past this point. That includes every index, which the
+    // draw offsets by the submesh's first vertex and which must stay within the vertices after it
+    auto isInIndices = [&](const MeshData::Submesh &submesh, uint32_t indexOffset, uint32_t indexCount)
+    {
+        if (indexCount % 3 != 0 || (static_cast<uint64_t>(indexOffset) + indexCount) * submesh.indexSize > header.packedIndexSize)
+        {
+            return false;
+        }
+        uint64_t numSubmeshVertices = header.numVertices - submesh.vertexOffset;
+        const uint8_t *indices = cooked.packedIndices.data() + static_cast<uint64_t>(indexOffset) * submesh.indexSize;
+        for (uint32_t i = 0; i < indexCount; i++)
+        {
+            uint32_t index = 0;
+            if (submesh.indexSize == sizeof(uint16_t))
+            {
+                uint16_t narrowIndex;
+                std::memcpy(&narrowIndex, indices + i * sizeof(uint16_t), sizeof(uint16_t));
+                index = narrowIndex;
+            }
+            else
+            {
+                std::memcpy(&index, indices + i * sizeof(uint32_t), sizeof(uint32_t));
+            }
+            if (index >= numSubmeshVertices)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    for (const MeshData::Submesh &submesh : cooked.submeshes)
+    {
+        if (submesh.vertexOffset > header.numVertices || (submesh.indexSize != sizeof(uint16_t) && submesh.indexSize != sizeof(uint32_t))
+            || !isInIndices(submesh, submesh.indexOffset, submesh.indexCount) || submesh.matIndex >= header.numMaterials
+            || static_cast<uint64_t>(submesh.meshletOffset) + submesh.meshletCount > header.numMeshlets
+            || static_cast<uint64_t>(submesh.lodOffset) + submesh.lodCount > header.numLods)
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+    for (const MeshData::Meshlet &meshlet : cooked.meshlets)
+    {
+        if (meshlet.submeshIndex >= header.numSubmeshes)
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+        const MeshData::Submesh &submesh = cooked.submeshes[meshlet.submeshIndex];
+        uint64_t submeshEnd = static_cast<uint64_t>(submesh.indexOffset) + submesh.indexCount;
+        if (meshlet.indexOffset < submesh.indexOffset || static_cast<uint64_t>(meshlet.indexOffset) + meshlet.indexCount > submeshEnd)
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+    for (const MeshData::Submesh &submesh : cooked.submeshes)
+    {
+        for (uint32_t lodIdx = submesh.lodOffset; lodIdx < submesh.lodOffset + submesh.lodCount; lodIdx++)
+        {
+            if (!isInIndices(submesh, cooked.lods[lodIdx].indexOffset, cooked.lods[lodIdx].indexCount))
+            {
+                std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+                return false;
+            }
+        }
+    }
+    // the world transforms are computed in one pass, which needs every parent before its children
+    for (size_t i = 0; i < cooked.nodes.size(); i++)
+    {
+        const MeshData::Node &node = cooked.nodes[i];
+        if ((node.parentIndex != MeshData::NoParent && node.parentIndex >= i)
+            || static_cast<uint64_t>(node.submeshOffset) + node.submeshCount > header.numNodeSubmeshes)
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+    for (uint32_t submeshIdx : cooked.nodeSubmeshes)
+    {
+        if (submeshIdx >= header.numSubmeshes)
+        {
+            std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+            return false;
+        }
+    }
+    for (const MeshData::Material &material : cooked.materials)
+    {
+        for (uint32_t textureIdx : material.textures)
+        {
+            if (textureIdx != MeshData::NoTexture && textureIdx >= header.numTextures)
+            {
+                std::cerr << "Mesh cache " << cachePath << " is corrupt" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    cooked.mapping = std::move(mapping);
+    data = std::move(cooked);
+    return true;
+}
+
+bool MeshCache::Store(const std::string &cachePath, const Key &key, const MeshData &data)
+{
+    // vertices and texels are the bulk of a mesh, compressing them means fewer bytes to read from disk and to send to the GPU
+    std::vector<uint8_t> compressedVertices = LzCodec::Compress(data.packedVertices);
+    Header header = {
+        .magic = Magic,
+        .version = Version,
+        .sourceHash = key.sourceHash,
+        .importFlags = key.importFlags,
+        .numSubmeshes = static_cast<uint32_t>(data.submeshes.size()),
+        .numMaterials = static_cast<uint32_t>(data.materials.size()),
+        .numTextures = static_cast<uint32_t>(data.textures.size()),
+        .vertexFormat = data.vertexFormat,
+        .vertexStride = VertexPacking::GetStride(data.vertexFormat),
+        .numVertices = data.packedVertices.size() / VertexPacking::GetStride(data.vertexFormat),
+        .vertexSize = compressedVertices.size(),
+        .packedIndexSize = data.packedIndices.size(),
+        .numMeshlets = data.meshlets.size(),
+        .numLods = data.lods.size(),
+        .numNodes = data.nodes.size(),
+        .numNodeSubmeshes = data.nodeSubmeshes.size(),
+    };
+
+    size_t offset = alignUp(sizeof(Header));
+    auto placeSection = [&](uint64_t &sectionOffset, size_t size)
+    {
+        sectionOffset = offset;
+        offset = alignUp(offset + size);
+    };
+    placeSection(header.vertexOffset, compressedVertices.size());
+    placeSection(header.indexOffset, data.packedIndices.size());
+    placeSection(header.submeshOffset, data.submeshes.size() * sizeof(MeshData::Submesh));
+    placeSection(header.meshletOffset, data.meshlets.size() * sizeof(MeshData::Meshlet));
+    placeSection(header.lodOffset, data.lods.size() * sizeof(MeshData::Lod));
+    placeSection(header.nodeOffset, data.nodes.size() * sizeof(MeshData::Node));
+    placeSection(header.nodeSubmeshOffset, data.nodeSubmeshes.size() * sizeof(uint32_t));
+    placeSection(header.materialOffset, data.materials.size() * sizeof(MeshData::Material));
+    placeSection(header.textureOffset, data.textures.size() * sizeof(CookedTexture));
+
+    std::vector<CookedTexture> cookedTextures;
+    std::vector<std::vector<uint8_t>> compressedTexels;
+    cookedTextures.reserve(data.textures.size());
+    compressedTexels.reserve(data.textures.size());
+    for (const MeshData::Texture &texture : data.textures)
+    {
+        if (!texture.encoded.empty() || texture.texels.size() != getTexelSize(texture.width, texture.height))
+        {
+            std::cerr << "Mesh cache can only store decoded textures" << std::endl;
+            return false;
+        }
+        const std::vector<uint8_t> &texels = compressedTexels.emplace_back(LzCodec::Compress(texture.texels));
+        cookedTextures.push_back({
+            .width = texture.width,
+            .height = texture.height,
+            .texelSize = texels.size(),
+            .contentHash = texture.contentHash,
+        });
+        placeSection(cookedTextures.back().texelOffset, texels.size());
+    }
+
+    std::string tempPath = cachePath + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open " << tempPath << " for writing" << std::endl;
+        return false;
+    }
+
+    size_t written = 0;
+    auto writeSection = [&](uint64_t sectionOffset, const void *src, size_t size)
+    {
+        static constexpr std::array<char, SectionAlignment> padding = {};
+        file.write(padding.data(), static_cast<std::streamsize>(sectionOffset - written));
+        file.write(static_cast<const char *>(src), static_cast<std::streamsize>(size));
+        written = sectionOffset + size;
+    };
+    writeSection(0, &header, sizeof(Header));
+    writeSection(header.vertexOffset, compressedVertices.data(), compressedVertices.size());
+    writeSection(header.indexOffset, data.packedIndices.data(), data.packedIndices.size());
+    writeSection(header.submeshOffset, data.submeshes.data(), data.submeshes.size() * sizeof(MeshData::Submesh));
+    writeSection(header.meshletOffset, data.meshlets.data(), data.meshlets.size() * sizeof(MeshData::Meshlet));
+    writeSection(header.lodOffset, data.lods.data(), data.lods.size() * sizeof(MeshData::Lod));
+    writeSection(header.nodeOffset, data.nodes.data(), data.nodes.size() * sizeof(MeshData::Node));
+    writeSection(header.nodeSubmeshOffset, data.nodeSubmeshes.data(), data.nodeSubmeshes.size() * sizeof(uint32_t));
+    writeSection(header.materialOffset, data.materials.data(), data.materials.size() * sizeof(MeshData::Material));
+    writeSection(header.textureOffset, cookedTextures.data(), cookedTextures.size() * sizeof(CookedTexture));
+    for (size_t i = 0; i < data.textures.size(); i++)
+    {
+        writeSection(cookedTextures[i].texelOffset, compressedTexels[i].data(), compressedTexels[i].size());
+    }
+    file.close();
+
+    if (!file)
+    {
+        std::cerr << "Failed to write " << tempPath << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        std::cerr << "Failed to move " << tempPath << " to " << cachePath << ": " << error.message() << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
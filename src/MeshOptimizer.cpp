@@ -0,0 +1,396 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t NoVertex = UINT32_MAX;
+    // a soft cluster ends once its miss ratio is within this factor of the hard cluster it is cut from, the paper's lambda
+    constexpr float SoftBoundaryThreshold = 1.05f;
+
+    // A vertex is cached if it was inserted less than CacheSize misses ago. Flushing only advances the clock, so it
+    // doesn't touch every vertex
+    class FifoCache
+    {
+      public:
+        explicit FifoCache(size_t numVertices)
+            : m_insertTimes(numVertices, 0)
+        {
+        }
+
+        // true on a miss
+        bool access(uint32_t vertex)
+        {
+            if (m_time - m_insertTimes[vertex] > MeshOptimizer::CacheSize)
+            {
+                m_insertTimes[vertex] = m_time++;
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] uint32_t getAge(uint32_t vertex) const
+        {
+            return m_time - m_insertTimes[vertex];
+        }
+
+        void flush()
+        {
+            m_time += MeshOptimizer::CacheSize + 1;
+        }
+
+      private:
+        std::vector<uint32_t> m_insertTimes;
+        uint32_t m_time = MeshOptimizer::CacheSize + 1;
+    };
+
+    struct SubmeshRange
+    {
+        uint32_t firstVertex = 0;
+        uint32_t numVertices = 0;
+        // indices relative to firstVertex
+        std::span<uint32_t> indices;
+    };
+
+    // Emits the triangles around a fanning vertex, then continues with the most recently used vertex that will stay in
+    // the cache until all of its triangles are emitted. When there is none it backtracks through recently used vertices,
+    // each such dead end starts a hard cluster
+    void tipsify(const std::span<const uint32_t> &indices, uint32_t numVertices, std::vector<uint32_t> &result,
+                 std::vector<uint32_t> &hardBoundaries)
+    {
+        size_t numTriangles = indices.size() / 3;
+        std::vector<uint32_t> liveTriangles(numVertices, 0);
+        for (uint32_t index : indices)
+        {
+            liveTriangles[index]++;
+        }
+        std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+        std::inclusive_scan(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin() + 1);
+        std::vector<uint32_t> adjacency(indices.size());
+        {
+            std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                adjacency[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        FifoCache cache(numVertices);
+        std::vector<bool> emitted(numTriangles, false);
+        std::vector<uint32_t> deadEnds;
+        std::vector<uint32_t> candidates;
+        uint32_t nextUnvisited = 0;
+        result.clear();
+        result.reserve(indices.size());
+        hardBoundaries.assign(1, 0);
+
+        auto skipDeadEnd = [&]()
+        {
+            while (!deadEnds.empty())
+            {
+                uint32_t vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[vertex] > 0)
+                {
+                    return vertex;
+                }
+            }
+            for (; nextUnvisited < numVertices; nextUnvisited++)
+            {
+                if (liveTriangles[nextUnvisited] > 0)
+                {
+                    return nextUnvisited;
+                }
+            }
+            return NoVertex;
+        };
+
+        uint32_t fanning = skipDeadEnd();
+        while (fanning != NoVertex)
+        {
+            candidates.clear();
+            for (uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++)
+            {
+                uint32_t triangle = adjacency[i];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                for (uint32_t vertex : indices.subspan(triangle * 3, 3))
+                {
+                    result.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    liveTriangles[vertex]--;
+                    cache.access(vertex);
+                }
+                emitted[triangle] = true;
+            }
+
+            fanning = NoVertex;
+            uint32_t bestPriority = 0;
+            for (uint32_t vertex : candidates)
+            {
+                // vertices that would be evicted before their remaining triangles are emitted aren't worth fanning around
+                if (liveTriangles[vertex] > 0 && cache.getAge(vertex) + 2 * liveTriangles[vertex] <= MeshOptimizer::CacheSize
+                    && cache.getAge(vertex) > bestPriority)
+                {
+                    fanning = vertex;
+                    bestPriority = cache.getAge(vertex);
+                }
+            }
+            if (fanning == NoVertex)
+            {
+                fanning = skipDeadEnd();
+                if (fanning != NoVertex && result.size() / 3 > hardBoundaries.back())
+                {
+                    hardBoundaries.push_back(static_cast<uint32_t>(result.size() / 3));
+                }
+            }
+        }
+    }
+
+    // Cuts every hard cluster into soft ones as soon as the running miss ratio is close to the hard cluster's, then
+    // sorts them by how far they face away from the submesh's centroid
+    void sortClusters(std::vector<uint32_t> &indices, const std::vector<uint32_t> &hardBoundaries, const std::span<const Vertex> &vertices)
+    {
+        uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+        FifoCache cache(vertices.size());
+        auto countMisses = [&](uint32_t triangle)
+        {
+            return cache.access(indices[triangle * 3]) + cache.access(indices[triangle * 3 + 1]) + cache.access(indices[triangle * 3 + 2]);
+        };
+
+        std::vector<uint32_t> boundaries;
+        for (size_t cluster = 0; cluster < hardBoundaries.size(); cluster++)
+        {
+            uint32_t begin = hardBoundaries[cluster];
+            uint32_t end = cluster + 1 < hardBoundaries.size() ? hardBoundaries[cluster + 1] : numTriangles;
+            uint32_t hardMisses = 0;
+            cache.flush();
+            for (uint32_t triangle = begin; triangle < end; triangle++)
+            {
+                hardMisses += countMisses(triangle);
+            }
+            float threshold = SoftBoundaryThreshold * hardMisses / (end - begin);
+
+            cache.flush();
+            boundaries.push_back(begin);
+            uint32_t softMisses = 0;
+            for (uint32_t triangle = begin; triangle < end; triangle++)
+            {
+                softMisses += countMisses(triangle);
+                if (triangle + 1 < end && softMisses <= threshold * (triangle + 1 - boundaries.back()))
+                {
+                    boundaries.push_back(triangle + 1);
+                    softMisses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        boundaries.push_back(numTriangles);
+
+        // area weighted centroid and normal of every cluster
+        size_t numClusters = boundaries.size() - 1;
+        std::vector<glm::vec3> centroids(numClusters, glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(numClusters, glm::vec3(0.0f));
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t cluster = 0; cluster < numClusters; cluster++)
+        {
+            float area = 0.0f;
+            for (uint32_t triangle = boundaries[cluster]; triangle < boundaries[cluster + 1]; triangle++)
+            {
+                const glm::vec3 &p0 = vertices[indices[triangle * 3]].position;
+                const glm::vec3 &p1 = vertices[indices[triangle * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[triangle * 3 + 2]].position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(normal);
+                centroids[cluster] += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normals[cluster] += normal;
+                area += triangleArea;
+            }
+            meshCentroid += centroids[cluster];
+            meshArea += area;
+            centroids[cluster] = area > 0.0f ? centroids[cluster] / area : vertices[indices[boundaries[cluster] * 3]].position;
+        }
+        meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : meshCentroid;
+
+        std::vector<float> sortKeys(numClusters);
+        for (size_t cluster = 0; cluster < numClusters; cluster++)
+        {
+            float normalLength = glm::length(normals[cluster]);
+            sortKeys[cluster] = normalLength > 0.0f ? glm::dot(centroids[cluster] - meshCentroid, normals[cluster]) / normalLength : 0.0f;
+        }
+        std::vector<uint32_t> order(numClusters);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&](uint32_t a, uint32_t b)
+                         {
+                             return sortKeys[a] > sortKeys[b];
+                         });
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(indices.size());
+        for (uint32_t cluster : order)
+        {
+            sorted.insert(sorted.end(), indices.begin() + boundaries[cluster] * 3, indices.begin() + boundaries[cluster + 1] * 3);
+        }
+        indices = std::move(sorted);
+    }
+
+    // renumbers vertices in order of first use, vertices no triangle uses end up at the back
+    void optimizeVertexFetch(const std::span<uint32_t> &indices, const std::span<Vertex> &vertices)
+    {
+        std::vector<uint32_t> remap(vertices.size(), NoVertex);
+        uint32_t numRemapped = 0;
+        for (uint32_t &index : indices)
+        {
+            if (remap[index] == NoVertex)
+            {
+                remap[index] = numRemapped++;
+            }
+            index = remap[index];
+        }
+        for (uint32_t &newIndex : remap)
+        {
+            newIndex = newIndex == NoVertex ? numRemapped++ : newIndex;
+        }
+
+        std::vector<Vertex> reordered(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            reordered[remap[i]] = vertices[i];
+        }
+        std::copy(reordered.begin(), reordered.end(), vertices.begin());
+    }
+
+    [[nodiscard]] std::span<const uint32_t> getIndices(const MeshData &data, const MeshData::Submesh &submesh)
+    {
+        return std::span(&data.faces.data()->x + submesh.indexOffset, submesh.indexCount);
+    }
+} // namespace
+
+double MeshOptimizer::Stats::getAcmr() const
+{
+    return numTriangles ? static_cast<double>(cacheMisses) / numTriangles : 0.0;
+}
+
+double MeshOptimizer::Stats::getAtvr() const
+{
+    return numVertices ? static_cast<double>(cacheMisses) / numVertices : 0.0;
+}
+
+MeshOptimizer::Stats MeshOptimizer::Analyze(const MeshData &data)
+{
+    Stats stats;
+    FifoCache cache(data.vertices.size());
+    std::vector<bool> referenced(data.vertices.size(), false);
+    for (const MeshData::Submesh &submesh : data.submeshes)
+    {
+        // every draw starts with a cold cache
+        cache.flush();
+        for (uint32_t index : getIndices(data, submesh))
+        {
+            uint32_t vertex = submesh.vertexOffset + index;
+            stats.cacheMisses += cache.access(vertex);
+            stats.numVertices += !referenced[vertex];
+            referenced[vertex] = true;
+        }
+        stats.numTriangles += submesh.indexCount / 3;
+    }
+    return stats;
+}
+
+void MeshOptimizer::Optimize(MeshData &data, ThreadPool &threadPool)
+{
+    // everything is reordered in place
+    if (data.vertices.data() != data.vertexStorage.data())
+    {
+        data.vertexStorage.assign(data.vertices.begin(), data.vertices.end());
+        data.vertices = data.vertexStorage;
+    }
+    if (data.faces.data() != data.faceStorage.data())
+    {
+        data.faceStorage.assign(data.faces.begin(), data.faces.end());
+        data.faces = data.faceStorage;
+    }
+
+    std::vector<SubmeshRange> ranges;
+    ranges.reserve(data.submeshes.size());
+    for (const MeshData::Submesh &submesh : data.submeshes)
+    {
+        std::span<const uint32_t> indices = getIndices(data, submesh);
+        uint32_t numVertices = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1;
+        ranges.push_back({
+            .firstVertex = submesh.vertexOffset,
+            .numVertices = numVertices,
+            .indices = std::span(&data.faceStorage.data()->x + submesh.indexOffset, submesh.indexCount),
+        });
+    }
+
+    // renumbering vertices another submesh also uses would break that submesh, so those only have their triangles
+    // reordered
+    std::vector<bool> sharesVertices(ranges.size(), false);
+    std::vector<size_t> order;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (ranges[i].numVertices > 0)
+        {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b)
+              {
+                  return ranges[a].firstVertex < ranges[b].firstVertex;
+              });
+    for (size_t first = 0; first < order.size();)
+    {
+        auto getRangeEnd = [&](size_t i)
+        {
+            return static_cast<uint64_t>(ranges[order[i]].firstVertex) + ranges[order[i]].numVertices;
+        };
+        uint64_t groupEnd = getRangeEnd(first);
+        size_t last = first + 1;
+        for (; last < order.size() && ranges[order[last]].firstVertex < groupEnd; last++)
+        {
+            groupEnd = std::max(groupEnd, getRangeEnd(last));
+        }
+        for (size_t i = first; last - first > 1 && i < last; i++)
+        {
+            sharesVertices[order[i]] = true;
+        }
+        first = last;
+    }
+
+    threadPool.parallelFor(ranges.size(),
+                           [&](size_t i)
+                           {
+                               const SubmeshRange &range = ranges[i];
+                               if (range.indices.empty())
+                               {
+                                   return;
+                               }
+                               std::span<Vertex> vertices = std::span(data.vertexStorage).subspan(range.firstVertex, range.numVertices);
+                               std::vector<uint32_t> indices;
+                               std::vector<uint32_t> hardBoundaries;
+                               tipsify(range.indices, range.numVertices, indices, hardBoundaries);
+                               sortClusters(indices, hardBoundaries, vertices);
+                               std::copy(indices.begin(), indices.end(), range.indices.begin());
+                               if (!sharesVertices[i])
+                               {
+                                   optimizeVertexFetch(range.indices, vertices);
+                               }
+                           });
+}
+
+void MeshOptimizer::OptimizeVertexCache(const std::span<uint32_t> &indices, uint32_t numVertices)
+{
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> hardBoundaries;
+    tipsify(indices, numVertices, result, hardBoundaries);
+    std::copy(result.begin(), result.end(), indices.begin());
+}
@@ -0,0 +1,154 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+namespace
+{
+    // cones wider than this are hardly ever fully backfacing, so they aren't worth testing
+    constexpr float MinConeDot = 0.1f;
+
+    void computeBounds(const std::span<const uint32_t> &indices, const std::span<const Vertex> &vertices, MeshData::Meshlet &meshlet)
+    {
+        glm::vec3 minPosition = vertices[indices[0]].position;
+        glm::vec3 maxPosition = minPosition;
+        for (uint32_t index : indices)
+        {
+            minPosition = glm::min(minPosition, vertices[index].position);
+            maxPosition = glm::max(maxPosition, vertices[index].position);
+        }
+        glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t index : indices)
+        {
+            radius = std::max(radius, glm::length(vertices[index].position - center));
+        }
+        meshlet.boundingSphere = glm::vec4(center, radius);
+
+        // the axis is the average triangle normal, the cone has to contain every triangle normal
+        struct TrianglePlane
+        {
+            glm::vec3 point;
+            glm::vec3 normal;
+        };
+        std::vector<TrianglePlane> planes;
+        planes.reserve(indices.size() / 3);
+        glm::vec3 axis(0.0f);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const glm::vec3 &p0 = vertices[indices[i]].position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - p0, vertices[indices[i + 2]].position - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                planes.push_back({p0, normal / length});
+                axis += planes.back().normal;
+            }
+        }
+        meshlet.coneApex = glm::vec4(center, 0.0f);
+        float axisLength = glm::length(axis);
+        if (axisLength == 0.0f)
+        {
+            return;
+        }
+        axis = axis / axisLength;
+
+        float minDot = 1.0f;
+        for (const TrianglePlane &plane : planes)
+        {
+            minDot = std::min(minDot, glm::dot(axis, plane.normal));
+        }
+        if (minDot <= MinConeDot)
+        {
+            return;
+        }
+
+        // The apex is moved back along the axis until it lies behind every triangle's plane, so that a camera in front
+        // of any triangle sees the apex at more than the cone's half angle from the axis
+        float maxOffset = 0.0f;
+        for (const TrianglePlane &plane : planes)
+        {
+            maxOffset = std::max(maxOffset, glm::dot(center - plane.point, plane.normal) / glm::dot(axis, plane.normal));
+        }
+        meshlet.coneApex = glm::vec4(center - axis * maxOffset, 0.0f);
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    [[nodiscard]] std::vector<MeshData::Meshlet> buildMeshlets(const MeshData &data, uint32_t submeshIdx)
+    {
+        const MeshData::Submesh &submesh = data.submeshes[submeshIdx];
+        std::span<const uint32_t> indices(&data.faces.data()->x + submesh.indexOffset, submesh.indexCount);
+        std::vector<MeshData::Meshlet> meshlets;
+        if (indices.empty())
+        {
+            return meshlets;
+        }
+        std::span<const Vertex> vertices = data.vertices.subspan(submesh.vertexOffset);
+
+        // the meshlet that last used every vertex, so membership needs no clearing between meshlets
+        std::vector<uint32_t> lastMeshlet(*std::max_element(indices.begin(), indices.end()) + 1, UINT32_MAX);
+        uint32_t numVertices = 0;
+        uint32_t begin = 0;
+        auto finishMeshlet = [&](uint32_t end)
+        {
+            MeshData::Meshlet &meshlet = meshlets.emplace_back();
+            meshlet.indexOffset = submesh.indexOffset + begin;
+            meshlet.indexCount = end - begin;
+            meshlet.submeshIndex = submeshIdx;
+            computeBounds(indices.subspan(begin, end - begin), vertices, meshlet);
+            begin = end;
+            numVertices = 0;
+        };
+
+        auto countNewVertices = [&](uint32_t triangle, uint32_t meshletIdx)
+        {
+            const uint32_t *corners = &indices[triangle];
+            uint32_t count = 0;
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                // a repeated index in a degenerate triangle only counts once
+                bool repeated = (i > 0 && corners[i] == corners[0]) || (i > 1 && corners[i] == corners[1]);
+                count += lastMeshlet[corners[i]] != meshletIdx && !repeated;
+            }
+            return count;
+        };
+
+        for (uint32_t triangle = 0; triangle < indices.size(); triangle += 3)
+        {
+            uint32_t meshletIdx = static_cast<uint32_t>(meshlets.size());
+            uint32_t newVertices = countNewVertices(triangle, meshletIdx);
+            if (numVertices + newVertices > MeshletBuilder::MaxVertices || (triangle - begin) / 3 == MeshletBuilder::MaxTriangles)
+            {
+                finishMeshlet(triangle);
+                newVertices = countNewVertices(triangle, ++meshletIdx);
+            }
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                lastMeshlet[indices[triangle + i]] = meshletIdx;
+            }
+            numVertices += newVertices;
+        }
+        finishMeshlet(static_cast<uint32_t>(indices.size()));
+        return meshlets;
+    }
+} // namespace
+
+void MeshletBuilder::Build(MeshData &data, ThreadPool &threadPool)
+{
+    std::vector<std::vector<MeshData::Meshlet>> submeshMeshlets(data.submeshes.size());
+    threadPool.parallelFor(data.submeshes.size(),
+                           [&](size_t i)
+                           {
+                               submeshMeshlets[i] = buildMeshlets(data, static_cast<uint32_t>(i));
+                           });
+
+    data.meshlets.clear();
+    for (size_t i = 0; i < data.submeshes.size(); i++)
+    {
+        data.submeshes[i].meshletOffset = static_cast<uint32_t>(data.meshlets.size());
+        data.submeshes[i].meshletCount = static_cast<uint32_t>(submeshMeshlets[i].size());
+        data.meshlets.insert(data.meshlets.end(), submeshMeshlets[i].begin(), submeshMeshlets[i].end());
+    }
+}
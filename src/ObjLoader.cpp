@@ -0,0 +1,624 @@
+#include "ObjLoader.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t NoIndex = UINT32_MAX;
+    // smaller chunks don't amortize handing them to a worker
+    constexpr size_t MinChunkSize = 1024 * 1024;
+    // what Assimp gives faces without a material
+    constexpr float DefaultGray = 0.6f;
+
+    struct Corner
+    {
+        uint32_t position = NoIndex;
+        uint32_t texCoord = NoIndex;
+        uint32_t normal = NoIndex;
+
+        bool operator==(const Corner &other) const = default;
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const Corner &corner) const
+        {
+            uint64_t hash = corner.position * 0x9e3779b97f4a7c15ull;
+            hash ^= (hash >> 29) + corner.texCoord * 0xbf58476d1ce4e5b9ull;
+            hash ^= (hash >> 31) + corner.normal * 0x94d049bb133111ebull;
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    // Triangles of a chunk from one usemtl up to the next. The first segment of every chunk continues whatever
+    // material the previous chunk ended with
+    struct Segment
+    {
+        size_t firstTriangle = 0;
+        std::string_view material = {};
+        bool inherited = false;
+
+        uint32_t matIndex = 0;
+        uint32_t firstVertex = 0;
+        uint32_t submeshVertexOffset = 0;
+    };
+
+    struct Chunk
+    {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+
+        size_t numPositions = 0;
+        size_t numTexCoords = 0;
+        size_t numNormals = 0;
+        size_t positionBase = 0;
+        size_t texCoordBase = 0;
+        size_t normalBase = 0;
+
+        std::vector<Corner> corners;
+        std::vector<Segment> segments;
+        std::string_view materialLibrary;
+        bool missingNormals = false;
+        bool valid = true;
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        size_t vertexBase = 0;
+        size_t triangleBase = 0;
+
+        [[nodiscard]] size_t numTriangles() const
+        {
+            return corners.size() / 3;
+        }
+
+        [[nodiscard]] size_t getSegmentEnd(size_t segment) const
+        {
+            return segment + 1 < segments.size() ? segments[segment + 1].firstTriangle : numTriangles();
+        }
+    };
+
+    [[nodiscard]] bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    [[nodiscard]] const char *skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+        {
+            p++;
+        }
+        return p;
+    }
+
+    [[nodiscard]] std::string_view readToken(const char *&p, const char *end)
+    {
+        p = skipSpaces(p, end);
+        const char *start = p;
+        while (p < end && !isSpace(*p))
+        {
+            p++;
+        }
+        return {start, static_cast<size_t>(p - start)};
+    }
+
+    // the rest of the line without surrounding whitespace, names may contain spaces
+    [[nodiscard]] std::string_view readRest(const char *p, const char *end)
+    {
+        p = skipSpaces(p, end);
+        while (end > p && isSpace(end[-1]))
+        {
+            end--;
+        }
+        return {p, static_cast<size_t>(end - p)};
+    }
+
+    // from_chars is locale independent and doesn't allocate, which is what makes the float heavy lines cheap
+    template <typename T>
+    [[nodiscard]] bool parseNumber(const char *&p, const char *end, T &value)
+    {
+        p = skipSpaces(p, end);
+        if (p < end && *p == '+')
+        {
+            p++;
+        }
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc())
+        {
+            return false;
+        }
+        p = result.ptr;
+        return true;
+    }
+
+    template <typename Function>
+    void forEachLine(const char *begin, const char *end, Function &&function)
+    {
+        for (const char *line = begin; line < end;)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', end - line));
+            lineEnd = lineEnd ? lineEnd : end;
+            function(skipSpaces(line, lineEnd), lineEnd);
+            line = lineEnd + 1;
+        }
+    }
+
+    [[nodiscard]] std::vector<Chunk> splitIntoChunks(const std::span<const uint8_t> &file, uint32_t numThreads)
+    {
+        const char *begin = reinterpret_cast<const char *>(file.data());
+        const char *end = begin + file.size();
+        // a few chunks per thread balance out chunks that hold mostly faces against ones that hold mostly positions
+        size_t numChunks = std::clamp<size_t>(file.size() / MinChunkSize, 1, numThreads * 4);
+
+        std::vector<Chunk> chunks(numChunks);
+        const char *chunkBegin = begin;
+        for (size_t i = 0; i < numChunks; i++)
+        {
+            const char *chunkEnd = i + 1 == numChunks ? end : begin + file.size() * (i + 1) / numChunks;
+            if (chunkEnd < chunkBegin)
+            {
+                chunkEnd = chunkBegin;
+            }
+            if (chunkEnd < end)
+            {
+                const char *newline = static_cast<const char *>(std::memchr(chunkEnd, '\n', end - chunkEnd));
+                chunkEnd = newline ? newline + 1 : end;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+        return chunks;
+    }
+
+    // must recognize exactly the keywords parseChunk does, the attributes are parsed into the slices counted here
+    void countAttributes(Chunk &chunk)
+    {
+        forEachLine(chunk.begin, chunk.end,
+                    [&](const char *line, const char *lineEnd)
+                    {
+                        if (line == lineEnd || *line != 'v')
+                        {
+                            return;
+                        }
+                        const char *p = line;
+                        std::string_view keyword = readToken(p, lineEnd);
+                        if (keyword == "v")
+                        {
+                            chunk.numPositions++;
+                        }
+                        else if (keyword == "vt")
+                        {
+                            chunk.numTexCoords++;
+                        }
+                        else if (keyword == "vn")
+                        {
+                            chunk.numNormals++;
+                        }
+                    });
+    }
+
+    // OBJ indices are 1 based, negative ones count back from the attributes parsed so far
+    [[nodiscard]] uint32_t resolveIndex(int64_t index, size_t numParsed, size_t total)
+    {
+        int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(numParsed) + index;
+        return index != 0 && resolved >= 0 && static_cast<size_t>(resolved) < total ? static_cast<uint32_t>(resolved) : NoIndex;
+    }
+
+    struct Attributes
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texCoords;
+        std::vector<glm::vec3> normals;
+    };
+
+    [[nodiscard]] bool parseCorner(const char *&p, const char *end, const Attributes &attributes, const std::array<size_t, 3> &numParsed,
+                                   Corner &corner)
+    {
+        int64_t index = 0;
+        if (!parseNumber(p, end, index))
+        {
+            return false;
+        }
+        corner.position = resolveIndex(index, numParsed[0], attributes.positions.size());
+        if (corner.position == NoIndex)
+        {
+            return false;
+        }
+        if (p == end || *p != '/')
+        {
+            return true;
+        }
+
+        p++;
+        if (p < end && *p != '/')
+        {
+            if (!parseNumber(p, end, index))
+            {
+                return false;
+            }
+            corner.texCoord = resolveIndex(index, numParsed[1], attributes.texCoords.size());
+            if (corner.texCoord == NoIndex)
+            {
+                return false;
+            }
+        }
+        if (p == end || *p != '/')
+        {
+            return true;
+        }
+
+        p++;
+        if (!parseNumber(p, end, index))
+        {
+            return false;
+        }
+        corner.normal = resolveIndex(index, numParsed[2], attributes.normals.size());
+        return corner.normal != NoIndex;
+    }
+
+    void parseChunk(Chunk &chunk, Attributes &attributes)
+    {
+        chunk.segments.push_back({.inherited = true});
+        size_t numPositions = 0;
+        size_t numTexCoords = 0;
+        size_t numNormals = 0;
+        std::vector<Corner> polygon;
+
+        forEachLine(
+            chunk.begin, chunk.end,
+            [&](const char *line, const char *lineEnd)
+            {
+                if (!chunk.valid || line == lineEnd || *line == '#')
+                {
+                    return;
+                }
+
+                const char *p = line;
+                std::string_view keyword = readToken(p, lineEnd);
+                // the counts of countAttributes bound the chunk's slices, a line it counted differently must not write
+                // past them
+                if (keyword == "v")
+                {
+                    if (numPositions == chunk.numPositions)
+                    {
+                        chunk.valid = false;
+                        return;
+                    }
+                    glm::vec3 &position = attributes.positions[chunk.positionBase + numPositions++];
+                    chunk.valid = parseNumber(p, lineEnd, position.x) && parseNumber(p, lineEnd, position.y)
+                                  && parseNumber(p, lineEnd, position.z);
+                }
+                else if (keyword == "vt")
+                {
+                    if (numTexCoords == chunk.numTexCoords)
+                    {
+                        chunk.valid = false;
+                        return;
+                    }
+                    glm::vec2 &texCoord = attributes.texCoords[chunk.texCoordBase + numTexCoords++];
+                    chunk.valid = parseNumber(p, lineEnd, texCoord.x);
+                    // v is optional, and flipped like the Assimp path does when converting to glm
+                    texCoord.y = 0.0f;
+                    if (parseNumber(p, lineEnd, texCoord.y))
+                    {
+                        texCoord.y = -texCoord.y;
+                    }
+                }
+                else if (keyword == "vn")
+                {
+                    if (numNormals == chunk.numNormals)
+                    {
+                        chunk.valid = false;
+                        return;
+                    }
+                    glm::vec3 &normal = attributes.normals[chunk.normalBase + numNormals++];
+                    chunk.valid = parseNumber(p, lineEnd, normal.x) && parseNumber(p, lineEnd, normal.y)
+                                  && parseNumber(p, lineEnd, normal.z);
+                }
+                else if (keyword == "f")
+                {
+                    std::array<size_t, 3> numParsed = {
+                        chunk.positionBase + numPositions,
+                        chunk.texCoordBase + numTexCoords,
+                        chunk.normalBase + numNormals,
+                    };
+                    polygon.clear();
+                    while (skipSpaces(p, lineEnd) < lineEnd)
+                    {
+                        if (!parseCorner(p, lineEnd, attributes, numParsed, polygon.emplace_back()))
+                        {
+                            chunk.valid = false;
+                            return;
+                        }
+                        chunk.missingNormals |= polygon.back().normal == NoIndex;
+                    }
+                    // polygons are triangulated as a fan, which is what Assimp does for convex faces
+                    for (size_t i = 2; i < polygon.size(); i++)
+                    {
+                        chunk.corners.push_back(polygon[0]);
+                        chunk.corners.push_back(polygon[i - 1]);
+                        chunk.corners.push_back(polygon[i]);
+                    }
+                }
+                else if (keyword == "usemtl")
+                {
+                    chunk.segments.push_back({.firstTriangle = chunk.numTriangles(), .material = readRest(p, lineEnd)});
+                }
+                else if (keyword == "mtllib" && chunk.materialLibrary.empty())
+                {
+                    chunk.materialLibrary = readRest(p, lineEnd);
+                }
+            });
+    }
+
+    // only the diffuse color is used, textures referenced by the library aren't embedded and so aren't loaded
+    void loadMaterialLibrary(const std::filesystem::path &path, std::unordered_map<std::string, uint32_t> &materialIndices,
+                             std::vector<glm::vec3> &colors)
+    {
+        MappedFile file(path.string());
+        if (!file.isOpen())
+        {
+            std::cout << "Could not open material library " << path << std::endl;
+            return;
+        }
+
+        const char *begin = reinterpret_cast<const char *>(file.data().data());
+        forEachLine(begin, begin + file.data().size(),
+                    [&](const char *line, const char *lineEnd)
+                    {
+                        const char *p = line;
+                        std::string_view keyword = readToken(p, lineEnd);
+                        if (keyword == "newmtl")
+                        {
+                            materialIndices.insert({std::string(readRest(p, lineEnd)), static_cast<uint32_t>(colors.size())});
+                            colors.emplace_back(DefaultGray);
+                        }
+                        else if (keyword == "Kd" && !colors.empty())
+                        {
+                            glm::vec3 color(DefaultGray);
+                            if (parseNumber(p, lineEnd, color.x) && parseNumber(p, lineEnd, color.y) && parseNumber(p, lineEnd, color.z))
+                            {
+                                colors.back() = color;
+                            }
+                        }
+                    });
+    }
+
+    // area weighted, so small sliver triangles barely move the normals of their corners
+    [[nodiscard]] std::vector<glm::vec3> generateNormals(const std::vector<Chunk> &chunks, const std::vector<glm::vec3> &positions)
+    {
+        std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f));
+        for (const Chunk &chunk : chunks)
+        {
+            for (size_t i = 0; i < chunk.corners.size(); i += 3)
+            {
+                const glm::vec3 &p0 = positions[chunk.corners[i].position];
+                const glm::vec3 &p1 = positions[chunk.corners[i + 1].position];
+                const glm::vec3 &p2 = positions[chunk.corners[i + 2].position];
+                glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+                for (size_t j = 0; j < 3; j++)
+                {
+                    normals[chunk.corners[i + j].position] += faceNormal;
+                }
+            }
+        }
+        for (glm::vec3 &normal : normals)
+        {
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        return normals;
+    }
+
+    // Vertices are shared between the triangles of a segment only, so each segment's vertices stay contiguous and
+    // segments can later be merged into submeshes without renumbering them
+    void buildVertices(Chunk &chunk, const Attributes &attributes, const std::vector<glm::vec3> &generatedNormals)
+    {
+        std::unordered_map<Corner, uint32_t, CornerHash> vertexIndices;
+        chunk.indices.reserve(chunk.corners.size());
+        for (size_t segmentIdx = 0; segmentIdx < chunk.segments.size(); segmentIdx++)
+        {
+            Segment &segment = chunk.segments[segmentIdx];
+            segment.firstVertex = static_cast<uint32_t>(chunk.vertices.size());
+            vertexIndices.clear();
+
+            size_t segmentEnd = chunk.getSegmentEnd(segmentIdx);
+            for (size_t corner = segment.firstTriangle * 3; corner < segmentEnd * 3; corner++)
+            {
+                const Corner &key = chunk.corners[corner];
+                auto [it, inserted] = vertexIndices.try_emplace(key, static_cast<uint32_t>(chunk.vertices.size()));
+                if (inserted)
+                {
+                    Vertex &vertex = chunk.vertices.emplace_back();
+                    vertex.position = attributes.positions[key.position];
+                    vertex.normal = key.normal != NoIndex ? attributes.normals[key.normal] : generatedNormals[key.position];
+                    if (key.texCoord != NoIndex)
+                    {
+                        vertex.textureCoordinate = attributes.texCoords[key.texCoord];
+                    }
+                }
+                chunk.indices.push_back(it->second);
+            }
+        }
+    }
+} // namespace
+
+bool ObjLoader::IsObj(const std::string &path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c)
+                   {
+                       return static_cast<char>(std::tolower(c));
+                   });
+    return extension == ".obj";
+}
+
+bool ObjLoader::Load(const std::string &path, const MappedFile &file, ThreadPool &threadPool, MeshData &data)
+{
+    if (!file.isOpen())
+    {
+        return false;
+    }
+
+    std::vector<Chunk> chunks = splitIntoChunks(file.data(), threadPool.numThreads() + 1);
+    threadPool.parallelFor(chunks.size(),
+                           [&](size_t i)
+                           {
+                               countAttributes(chunks[i]);
+                           });
+
+    Attributes attributes;
+    size_t numPositions = 0;
+    size_t numTexCoords = 0;
+    size_t numNormals = 0;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.positionBase = numPositions;
+        chunk.texCoordBase = numTexCoords;
+        chunk.normalBase = numNormals;
+        numPositions += chunk.numPositions;
+        numTexCoords += chunk.numTexCoords;
+        numNormals += chunk.numNormals;
+    }
+    attributes.positions.resize(numPositions);
+    attributes.texCoords.resize(numTexCoords);
+    attributes.normals.resize(numNormals);
+
+    threadPool.parallelFor(chunks.size(),
+                           [&](size_t i)
+                           {
+                               parseChunk(chunks[i], attributes);
+                           });
+
+    bool missingNormals = false;
+    for (const Chunk &chunk : chunks)
+    {
+        if (!chunk.valid)
+        {
+            std::cout << "Malformed obj file " << path << std::endl;
+            return false;
+        }
+        missingNormals |= chunk.missingNormals;
+    }
+
+    std::unordered_map<std::string, uint32_t> materialIndices;
+    std::vector<glm::vec3> colors;
+    auto libraryChunk = std::find_if(chunks.begin(), chunks.end(),
+                                     [](const Chunk &chunk)
+                                     {
+                                         return !chunk.materialLibrary.empty();
+                                     });
+    if (libraryChunk != chunks.end())
+    {
+        loadMaterialLibrary(std::filesystem::path(path).parent_path() / libraryChunk->materialLibrary, materialIndices, colors);
+    }
+
+    // faces before the first usemtl or with an unknown material get a default one, only added if it is used
+    uint32_t defaultMaterial = static_cast<uint32_t>(colors.size());
+    colors.emplace_back(DefaultGray);
+    uint32_t curMaterial = defaultMaterial;
+    bool usesDefaultMaterial = false;
+    for (Chunk &chunk : chunks)
+    {
+        for (size_t segmentIdx = 0; segmentIdx < chunk.segments.size(); segmentIdx++)
+        {
+            Segment &segment = chunk.segments[segmentIdx];
+            if (!segment.inherited)
+            {
+                auto material = materialIndices.find(std::string(segment.material));
+                curMaterial = material != materialIndices.end() ? material->second : defaultMaterial;
+            }
+            segment.matIndex = curMaterial;
+            usesDefaultMaterial |= curMaterial == defaultMaterial && chunk.getSegmentEnd(segmentIdx) > segment.firstTriangle;
+        }
+    }
+
+    std::vector<glm::vec3> generatedNormals;
+    if (missingNormals)
+    {
+        generatedNormals = generateNormals(chunks, attributes.positions);
+    }
+
+    threadPool.parallelFor(chunks.size(),
+                           [&](size_t i)
+                           {
+                               buildVertices(chunks[i], attributes, generatedNormals);
+                           });
+
+    // consecutive segments with the same material become one submesh, also across chunks
+    MeshData objData;
+    size_t numVertices = 0;
+    size_t numTriangles = 0;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.vertexBase = numVertices;
+        chunk.triangleBase = numTriangles;
+        for (size_t segmentIdx = 0; segmentIdx < chunk.segments.size(); segmentIdx++)
+        {
+            Segment &segment = chunk.segments[segmentIdx];
+            size_t segmentTriangles = chunk.getSegmentEnd(segmentIdx) - segment.firstTriangle;
+            if (segmentTriangles == 0)
+            {
+                continue;
+            }
+            if (objData.submeshes.empty() || objData.submeshes.back().matIndex != segment.matIndex)
+            {
+                objData.submeshes.push_back({
+                    .vertexOffset = static_cast<uint32_t>(chunk.vertexBase + segment.firstVertex),
+                    .indexOffset = static_cast<uint32_t>((chunk.triangleBase + segment.firstTriangle) * 3),
+                    .matIndex = segment.matIndex,
+                });
+            }
+            objData.submeshes.back().indexCount += static_cast<uint32_t>(segmentTriangles * 3);
+            segment.submeshVertexOffset = objData.submeshes.back().vertexOffset;
+        }
+        numVertices += chunk.vertices.size();
+        numTriangles += chunk.numTriangles();
+    }
+    if (numTriangles == 0)
+    {
+        return false;
+    }
+
+    objData.vertexStorage.resize(numVertices);
+    objData.faceStorage.resize(numTriangles);
+    threadPool.parallelFor(chunks.size(),
+                           [&](size_t i)
+                           {
+                               Chunk &chunk = chunks[i];
+                               std::copy(chunk.vertices.begin(), chunk.vertices.end(), objData.vertexStorage.begin() + chunk.vertexBase);
+                               for (size_t segmentIdx = 0; segmentIdx < chunk.segments.size(); segmentIdx++)
+                               {
+                                   const Segment &segment = chunk.segments[segmentIdx];
+                                   // indices are relative to the submesh's first vertex, which the draw offsets them by
+                                   uint32_t rebase = static_cast<uint32_t>(chunk.vertexBase) - segment.submeshVertexOffset;
+                                   for (size_t triangle = segment.firstTriangle; triangle < chunk.getSegmentEnd(segmentIdx); triangle++)
+                                   {
+                                       const uint32_t *indices = &chunk.indices[triangle * 3];
+                                       objData.faceStorage[chunk.triangleBase + triangle] =
+                                           glm::u32vec3(indices[0] + rebase, indices[1] + rebase, indices[2] + rebase);
+                                   }
+                               }
+                               chunk.vertices = {};
+                               chunk.indices = {};
+                           });
+
+    for (size_t i = 0; i < defaultMaterial + usesDefaultMaterial; i++)
+    {
+        objData.materials.push_back({.diffuseColor = glm::vec4(colors[i], 1.0f)});
+    }
+    objData.vertices = objData.vertexStorage;
+    objData.faces = objData.faceStorage;
+    data = std::move(objData);
+    return true;
+}
@@ -4,6 +4,7 @@
 #include "RenderPass.h"
 #include "Renderer.h"
 #include "Types.h"
+#include "VertexPacking.h"
 #include "VkInit.h"
 #include "glm/ext/matrix_transform.hpp"
 #include "glm/fwd.hpp"
@@ -19,6 +20,15 @@ void RenderPass::addMesh(Mesh *mesh)
     m_meshes.push_back(mesh);
 }
 
+void RenderPass::addMeshes(const std::span<const std::unique_ptr<Mesh>> &meshes)
+{
+    m_meshes.reserve(m_meshes.size() + meshes.size());
+    for (const std::unique_ptr<Mesh> &mesh : meshes)
+    {
+        m_meshes.push_back(mesh.get());
+    }
+}
+
 void RenderPass::fulfillRenderPassDependencies(VkCommandBuffer cmd, uint32_t frameIdx)
 {
     for (auto &dependency : m_dependencies)
@@ -101,19 +111,16 @@ DeferredRenderPass::DeferredRenderPass(const std::span<Shader *> &shaders, const
         }},
     });
 
+    // meshes are cooked in the same format, see Mesh.cpp
+    MeshData::VertexFormat vertexFormat = VertexPacking::GetSelectedFormat();
     m_pipeline = GraphicsPipeline({
         .VS = shaders[0],
         .FS = shaders[1],
         .vertexInputState{
             .vertexBindingDescs{{
-                {.binding = 0, .stride = sizeof(Vertex), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
-            }},
-            .vertexAttributeDescs{{
-                {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, position)},
-                {.location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, normal)},
-                {.location = 2, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, color)},
-                {.location = 3, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex, textureCoordinate)},
+                {.binding = 0, .stride = VertexPacking::GetStride(vertexFormat), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
             }},
+            .vertexAttributeDescs = VertexPacking::GetAttributeDescs(vertexFormat),
         },
         .colorBlendState = {
             .colorBlendAttachmentStates{{
@@ -136,7 +143,7 @@ DeferredRenderPass::DeferredRenderPass(const std::span<Shader *> &shaders, const
             .pushConstantRanges{{{
                 .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
                 .offset = 0,
-                .size = sizeof(PushConstants),
+                .size = sizeof(PushConstants) + sizeof(DrawPushConstants),
             }}},
         },
         .renderPass = renderPass,
@@ -163,17 +170,14 @@ void DeferredRenderPass::resize(uint32_t width, uint32_t height)
 
 void DeferredRenderPass::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex)
 {
-    static uint32_t frameCount = 0;
     Renderer &renderer = Renderer::Get();
 
-    glm::mat4 model = glm::rotate(glm::mat4{1.0f}, glm::radians(frameCount * 0.005f), glm::vec3(0, 1, 0))
-                    * glm::rotate(glm::mat4{1.0f}, glm::radians(90.0f), glm::vec3(1, 0, 0));
     glm::mat4 view = m_cameraRef.m_view;
     glm::mat4 projection = m_cameraRef.m_projection;
-    frameCount++;
 
+    // the model matrix is pushed by every mesh node, see Mesh::drawMesh
     PushConstants pushConstants = {};
-    pushConstants.M = model;
+    pushConstants.M = glm::mat4(1.0f);
     pushConstants.V = view;
     pushConstants.P = projection;
 
@@ -213,9 +217,14 @@ void DeferredRenderPass::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline.m_pipeline);
     vkCmdPushConstants(commandBuffer, m_pipeline.m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
 
+    // every mesh draws from the same geometry buffers, which are bound once for all of them
+    VkDeviceSize vertexBufferOffset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &renderer.get(renderer.getGeometryBuffer(GeometryBuffer::Vertex))->m_buffer,
+                           &vertexBufferOffset);
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
     for (Mesh *mesh : m_meshes)
     {
-        mesh->drawMesh(commandBuffer, m_pipeline.m_pipelineLayout);
+        mesh->drawMesh(commandBuffer, m_pipeline.m_pipelineLayout, view, projection, boundIndexType);
     }
 
     vkCmdEndRenderPass(commandBuffer);
@@ -1,7 +1,11 @@
 #include "backends/imgui_impl_glfw.h"
 #include "imgui.h"
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -14,9 +18,12 @@
 #include "GLFW/glfw3.h"
 
 #include "Common.h"
+#include "LzCodec.h"
 #include "RenderPass.h"
 #include "Renderer.h"
 #include "ResourcePool.h"
+#include "Shader.h"
+#include "TextureDecoder.h"
 #include "Types.h"
 
 [[nodiscard]] Renderer &Renderer::Get()
@@ -40,9 +47,9 @@
     return m_swapchainImages;
 }
 
-[[nodiscard]] VkDescriptorPool Renderer::getDescriptorPool()
+ThreadPool &Renderer::getThreadPool()
 {
-    return m_descriptorPools.back();
+    return m_threadPool;
 }
 
 [[nodiscard]] uint32_t Renderer::curFrame()
@@ -57,46 +64,61 @@
 
 [[nodiscard]] Handle<Buffer> Renderer::create(const Buffer::State &&state)
 {
-    return m_bufferPool.create(std::move(state));
+    // the Vulkan objects are created outside the lock, only taking a slot of the pool is serialized
+    Buffer buffer(std::move(state));
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
+    return m_bufferPool.create(buffer);
 }
 
 [[nodiscard]] Buffer *Renderer::get(Handle<Buffer> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_bufferPool.get(handle);
 }
 
 void Renderer::destroy(Handle<Buffer> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_bufferPool.destroy(handle);
 }
 
 [[nodiscard]] Handle<Framebuffer> Renderer::create(const Framebuffer::State &&state)
 {
-    return m_framebufferPool.create(std::move(state));
+    // the Vulkan objects are created outside the lock, only taking a slot of the pool is serialized
+    Framebuffer framebuffer(std::move(state));
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
+    return m_framebufferPool.create(framebuffer);
 }
 
 [[nodiscard]] Framebuffer *Renderer::get(Handle<Framebuffer> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_framebufferPool.get(handle);
 }
 
 void Renderer::destroy(Handle<Framebuffer> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_framebufferPool.destroy(handle);
 }
 
 [[nodiscard]] Handle<Image> Renderer::create(const Image::State &&state)
 {
-    return m_imagePool.create(std::move(state));
+    // the Vulkan objects are created outside the lock, only taking a slot of the pool is serialized
+    Image image(std::move(state));
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
+    return m_imagePool.create(image);
 }
 
 [[nodiscard]] Image *Renderer::get(Handle<Image> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_imagePool.get(handle);
 }
 
 void Renderer::destroy(Handle<Image> handle)
 {
+    std::lock_guard<std::mutex> lock(m_resourceMutex);
     return m_imagePool.destroy(handle);
 }
 
@@ -192,6 +214,19 @@ static VkDebugUtilsMessengerCreateInfoEXT getMessengerCreateInfo()
     return messengerCreateInfo;
 }
 
+// Vulkan 1.2 is used when both the loader and the device support it, otherwise the renderer stays on 1.0 and
+// falls back to fences and binary semaphores
+static uint32_t getInstanceApiVersion()
+{
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion)
+    {
+        VK_LOG_ERR(enumerateInstanceVersion(&apiVersion));
+    }
+    return apiVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : VK_API_VERSION_1_0;
+}
+
 VkInstance Renderer::createInstance()
 {
     VkInstanceCreateInfo instanceCreateInfo = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
@@ -221,7 +256,7 @@ VkInstance Renderer::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = getInstanceApiVersion();
 
     uint32_t requiredExtensionCount = 0;
     const char **requiredExtensions_cstr = glfwGetRequiredInstanceExtensions(&requiredExtensionCount);
@@ -404,6 +439,25 @@ const DeviceInfo Renderer::createDevice()
     deviceCreateInfo.enabledExtensionCount = requiredExtensions.size();
     deviceCreateInfo.ppEnabledExtensionNames = requiredExtensions.data();
     DeviceInfo deviceInfo = {};
+
+    // timeline semaphores are optional, PACEM_DISABLE_TIMELINE_SEMAPHORES forces the fence based path
+    VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan12Features enabledVulkan12Features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    if (getInstanceApiVersion() >= VK_API_VERSION_1_2 && m_physDeviceInfo.deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        deviceInfo.apiVersion = VK_API_VERSION_1_2;
+
+        VkPhysicalDeviceFeatures2 features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        features2.pNext = &supportedVulkan12Features;
+        vkGetPhysicalDeviceFeatures2(m_physDeviceInfo.device, &features2);
+
+        deviceInfo.timelineSemaphores = supportedVulkan12Features.timelineSemaphore && !std::getenv("PACEM_DISABLE_TIMELINE_SEMAPHORES");
+        enabledVulkan12Features.timelineSemaphore = deviceInfo.timelineSemaphores;
+        deviceInfo.hostQueryReset = supportedVulkan12Features.hostQueryReset;
+        enabledVulkan12Features.hostQueryReset = deviceInfo.hostQueryReset;
+        deviceCreateInfo.pNext = &enabledVulkan12Features;
+    }
+    std::cout << "Timeline semaphores " << (deviceInfo.timelineSemaphores ? "enabled" : "disabled") << std::endl;
     VK_LOG_ERR(vkCreateDevice(m_physDeviceInfo.device, &deviceCreateInfo, nullptr, &deviceInfo.device));
 
     deviceInfo.queues.resize(m_physDeviceInfo.queueProperties.size());
@@ -476,7 +530,8 @@ SwapchainInfo Renderer::createSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HA
     swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchainCreateInfo.imageArrayLayers = 1;
     swapchainCreateInfo.imageExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
-    swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT
+                                   | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     swapchainCreateInfo.minImageCount = numPreferredImages > m_windowInfo.surfaceCapabilities.maxImageCount
                                           ? m_windowInfo.surfaceCapabilities.maxImageCount
                                           : numPreferredImages;
@@ -502,6 +557,7 @@ SwapchainInfo Renderer::createSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HA
     swapchainInfo.numImages = swapchainCreateInfo.minImageCount;
     swapchainInfo.height = swapchainCreateInfo.imageExtent.height;
     swapchainInfo.width = swapchainCreateInfo.imageExtent.width;
+    swapchainInfo.format = swapchainCreateInfo.imageFormat;
     VK_LOG_ERR(vkCreateSwapchainKHR(m_deviceInfo.device, &swapchainCreateInfo, nullptr, &swapchainInfo.swapchain));
 
     return swapchainInfo;
@@ -551,7 +607,7 @@ const VmaAllocator Renderer::createVmaAllocator()
     vulkanFunctions.vkGetDeviceProcAddr = &vkGetDeviceProcAddr;
 
     VmaAllocatorCreateInfo allocatorCreateInfo = {};
-    allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_0;
+    allocatorCreateInfo.vulkanApiVersion = m_deviceInfo.apiVersion;
     allocatorCreateInfo.physicalDevice = m_physDeviceInfo.device;
     allocatorCreateInfo.device = m_deviceInfo.device;
     allocatorCreateInfo.instance = m_instance;
@@ -591,6 +647,8 @@ VkDescriptorPool Renderer::createDescriptorPool()
 
 VkDescriptorSet Renderer::allocateDescriptorSet(VkDescriptorSetLayout layout)
 {
+    // descriptor pools must be externally synchronized, and a full one is replaced for every thread at once
+    std::lock_guard<std::mutex> lock(m_descriptorMutex);
     VkDescriptorSetAllocateInfo descriptorSetLayoutCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         .descriptorPool = m_descriptorPools.back(),
@@ -605,6 +663,7 @@ VkDescriptorSet Renderer::allocateDescriptorSet(VkDescriptorSetLayout layout)
     switch (result)
     {
     case VK_SUCCESS:
+        m_descriptorSetPools[descriptorSet] = descriptorSetLayoutCreateInfo.descriptorPool;
         return descriptorSet;
     case VK_ERROR_FRAGMENTED_POOL:
     case VK_ERROR_OUT_OF_POOL_MEMORY:
@@ -621,16 +680,37 @@ VkDescriptorSet Renderer::allocateDescriptorSet(VkDescriptorSetLayout layout)
         m_descriptorPools.push_back(createDescriptorPool());
         descriptorSetLayoutCreateInfo.descriptorPool = m_descriptorPools.back();
         VK_LOG_ERR(vkAllocateDescriptorSets(m_deviceInfo.device, &descriptorSetLayoutCreateInfo, &descriptorSet);)
+        if (descriptorSet != VK_NULL_HANDLE)
+        {
+            m_descriptorSetPools[descriptorSet] = descriptorSetLayoutCreateInfo.descriptorPool;
+        }
     };
     return descriptorSet;
 }
 
+void Renderer::freeDescriptorSets(const std::span<const VkDescriptorSet> &descriptorSets)
+{
+    // every set goes back to the pool it was allocated from, which isn't necessarily the newest one
+    std::lock_guard<std::mutex> lock(m_descriptorMutex);
+    for (VkDescriptorSet descriptorSet : descriptorSets)
+    {
+        auto it = m_descriptorSetPools.find(descriptorSet);
+        if (it == m_descriptorSetPools.end())
+        {
+            continue;
+        }
+        VK_LOG_ERR(vkFreeDescriptorSets(m_deviceInfo.device, it->second, 1, &descriptorSet));
+        m_descriptorSetPools.erase(it);
+    }
+}
+
 void Renderer::destroyDescriptorPools()
 {
     for (VkDescriptorPool &descriptorPool : m_descriptorPools)
     {
         vkDestroyDescriptorPool(m_deviceInfo.device, descriptorPool, nullptr);
     }
+    m_descriptorSetPools.clear();
 }
 
 void Renderer::createSwapchainImages()
@@ -643,6 +723,11 @@ void Renderer::freeSwapchainImages()
     m_swapchainImages.destroy();
 }
 
+[[nodiscard]] static uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+{
+    return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+}
+
 static VkCommandPool createCommandPool(const VkDevice device, uint32_t queueFamilyIndex)
 {
     VkCommandPoolCreateInfo commandPoolCreateInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
@@ -666,6 +751,138 @@ static VkCommandBuffer createCommandBuffer(const DeviceInfo &deviceInfo, VkComma
     return commandBuffer;
 }
 
+static VkQueryPool createTimestampPool(VkDevice device, uint32_t queryCount)
+{
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = queryCount;
+
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    VK_LOG_ERR(vkCreateQueryPool(device, &queryPoolCreateInfo, nullptr, &queryPool));
+    return queryPool;
+}
+
+[[nodiscard]] static double getElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static VkSemaphore createTimelineSemaphore(VkDevice device)
+{
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCreateInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VK_LOG_ERR(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+    return semaphore;
+}
+
+// without host query resets uploads go untimed
+bool Renderer::hasTimestamps(QueueFamily family)
+{
+    return m_deviceInfo.hostQueryReset && m_deviceInfo.queues[getQueueFamilyIdx(family)].queueProperties.timestampValidBits > 0;
+}
+
+// expects the two timestamps to have been written by a submission that has completed
+double Renderer::getTimestampMs(VkQueryPool queryPool, uint32_t firstQuery, QueueFamily family)
+{
+    std::array<uint64_t, 2> timestamps = {};
+    VkResult result = vkGetQueryPoolResults(m_deviceInfo.device, queryPool, firstQuery, timestamps.size(), sizeof(timestamps),
+                                            timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return 0.0;
+    }
+
+    uint32_t validBits = m_deviceInfo.queues[getQueueFamilyIdx(family)].queueProperties.timestampValidBits;
+    uint64_t mask = validBits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << validBits) - 1;
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+    return ticks * static_cast<double>(m_physDeviceInfo.deviceProperties.limits.timestampPeriod) / 1e6;
+}
+
+uint32_t Renderer::beginTimestamp(VkCommandBuffer cmdBuf)
+{
+    std::unique_lock<std::mutex> lock(m_uploadStatsMutex);
+    if (m_transferQueue.freeTimestampQueries.empty())
+    {
+        return NoTimestampQuery;
+    }
+
+    uint32_t query = m_transferQueue.freeTimestampQueries.back();
+    m_transferQueue.freeTimestampQueries.pop_back();
+    lock.unlock();
+    // the query's previous submission has retired, so it is reset on the host
+    vkResetQueryPool(m_deviceInfo.device, m_transferQueue.timestampPool, query * 2, 2);
+    vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_transferQueue.timestampPool, query * 2);
+    return query;
+}
+
+void Renderer::endTimestamp(VkCommandBuffer cmdBuf, uint32_t query)
+{
+    if (query != NoTimestampQuery)
+    {
+        vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_transferQueue.timestampPool, query * 2 + 1);
+    }
+}
+
+void Renderer::retireTimestamp(uint32_t query, UploadCategory category)
+{
+    if (query != NoTimestampQuery)
+    {
+        double gpuMs = getTimestampMs(m_transferQueue.timestampPool, query * 2, QueueFamily::Transfer);
+        std::lock_guard<std::mutex> lock(m_uploadStatsMutex);
+        m_uploadStats.counters[static_cast<size_t>(category)].gpuMs += gpuMs;
+        m_transferQueue.freeTimestampQueries.push_back(query);
+    }
+}
+
+void Renderer::addUploadCounters(UploadCategory category, const UploadCounters &counters)
+{
+    std::lock_guard<std::mutex> lock(m_uploadStatsMutex);
+    UploadCounters &total = m_uploadStats.counters[static_cast<size_t>(category)];
+    total.submissions += counters.submissions;
+    total.bytes += counters.bytes;
+    total.memcpyMs += counters.memcpyMs;
+    total.decodeMs += counters.decodeMs;
+    total.waitMs += counters.waitMs;
+    total.gpuMs += counters.gpuMs;
+}
+
+UploadStats Renderer::getUploadStats()
+{
+    // uploads update their counters from whichever thread issues or waits on them
+    std::lock_guard<std::mutex> lock(m_uploadStatsMutex);
+    UploadStats stats = m_uploadStats;
+    stats.gpuTimestamps = m_transferQueue.timestampPool != VK_NULL_HANDLE;
+    return stats;
+}
+
+void Renderer::resetUploadStats()
+{
+    std::lock_guard<std::mutex> lock(m_uploadStatsMutex);
+    m_uploadStats = {};
+}
+
+uint64_t Renderer::getTimelineValue(VkSemaphore timeline)
+{
+    uint64_t value = 0;
+    VK_LOG_ERR(vkGetSemaphoreCounterValue(m_deviceInfo.device, timeline, &value));
+    return value;
+}
+
+void Renderer::waitTimeline(VkSemaphore timeline, uint64_t value)
+{
+    VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &value;
+    VK_LOG_ERR(vkWaitSemaphores(m_deviceInfo.device, &waitInfo, UINT64_MAX));
+}
+
 RenderContext Renderer::createRenderContext()
 {
     VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
@@ -679,6 +896,7 @@ RenderContext Renderer::createRenderContext()
     renderContext.imgAvailableSem.resize(m_swapchainInfo.numImages);
     renderContext.renderDoneSem.resize(m_swapchainInfo.numImages);
     renderContext.fences.resize(m_swapchainInfo.numImages);
+    renderContext.frameTimelineValues.resize(m_swapchainInfo.numImages, 0);
 
     for (uint32_t i = 0; i < m_swapchainInfo.numImages; i++)
     {
@@ -696,34 +914,21 @@ TransferQueue Renderer::createTransferQueue()
 {
     TransferQueue transferQueue = {};
 
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
-    commandPoolCreateInfo.queueFamilyIndex = m_deviceInfo.transferQueueFamily;
-    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-    VkCommandPool transferPool = createCommandPool(m_deviceInfo.device, m_deviceInfo.transferQueueFamily);
-    VkCommandPool graphicsPool = createCommandPool(m_deviceInfo.device, m_deviceInfo.graphicsQueueFamily);
-
-    VkCommandBufferAllocateInfo commandBufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    commandBufferAllocInfo.commandPool = transferPool;
-    commandBufferAllocInfo.commandBufferCount = 2;
-    commandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-
-    VkCommandBufferAllocateInfo graphicsCommandBufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    graphicsCommandBufferAllocInfo.commandPool = graphicsPool;
-    graphicsCommandBufferAllocInfo.commandBufferCount = 1;
-    graphicsCommandBufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-
-    VkCommandBuffer cmdBufs[2] = {};
-    VK_LOG_ERR(vkAllocateCommandBuffers(m_deviceInfo.device, &commandBufferAllocInfo, cmdBufs));
-
-    VkCommandBuffer graphicsCmdBuf;
-    VK_LOG_ERR(vkAllocateCommandBuffers(m_deviceInfo.device, &graphicsCommandBufferAllocInfo, &graphicsCmdBuf));
-
-    transferQueue.transferCommandPool = transferPool;
-    transferQueue.graphicsCommandPool = graphicsPool;
-    transferQueue.immCmdBuf = cmdBufs[0];
-    transferQueue.eofCmdBuf = cmdBufs[1];
-    transferQueue.graphicsCmdBuf = graphicsCmdBuf;
+    transferQueue.transferCommandPool = createCommandPool(m_deviceInfo.device, m_deviceInfo.transferQueueFamily);
+    transferQueue.graphicsCommandPool = createCommandPool(m_deviceInfo.device, m_deviceInfo.graphicsQueueFamily);
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        transferQueue.transferTimeline = createTimelineSemaphore(m_deviceInfo.device);
+        transferQueue.graphicsTimeline = createTimelineSemaphore(m_deviceInfo.device);
+    }
+    if (hasTimestamps(QueueFamily::Transfer))
+    {
+        transferQueue.timestampPool = createTimestampPool(m_deviceInfo.device, MaxTimedSubmissions * 2);
+        for (uint32_t i = 0; i < MaxTimedSubmissions; i++)
+        {
+            transferQueue.freeTimestampQueries.push_back(MaxTimedSubmissions - 1 - i);
+        }
+    }
     for (const auto &queueInfo : m_deviceInfo.queues)
     {
         if (m_deviceInfo.transferQueueFamily == queueInfo.queueFamilyIdx)
@@ -739,6 +944,108 @@ TransferQueue Renderer::createTransferQueue()
     return transferQueue;
 }
 
+StagingRing Renderer::createStagingRing()
+{
+    // the copies read the ring on the transfer queue, the decompression of compressed uploads on the graphics queue
+    auto queueFamilyIndices = std::to_array({m_deviceInfo.transferQueueFamily, m_deviceInfo.graphicsQueueFamily});
+    bool sameFamily = queueFamilyIndices[0] == queueFamilyIndices[1];
+    return StagingRing(m_vmaAllocator, StagingRingSize, std::span(queueFamilyIndices).first(sameFamily ? 1 : 2));
+}
+
+void Renderer::createGeometryBuffers()
+{
+    // Created on first use rather than by the constructor, since creating a buffer goes through Renderer::Get(), which
+    // must not be re-entered while the renderer is being constructed. Called with m_geometryMutex held
+    if (m_geometryBuffers.blocks[0] != VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // like createGpuBuffer, VMA picks host visible device local memory where there is some so meshes are written straight
+    // into the buffers, and otherwise falls back to device local memory filled through the staging ring
+    auto queueFamilies = std::to_array({QueueFamily::Graphics, QueueFamily::Transfer});
+    auto sizes = std::to_array({VertexBufferSize, IndexBufferSize});
+    auto usages = std::to_array<VkBufferUsageFlags>({VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_BUFFER_USAGE_INDEX_BUFFER_BIT});
+    for (size_t i = 0; i < m_geometryBuffers.buffers.size(); i++)
+    {
+        // compressed uploads are expanded into them by a compute shader
+        m_geometryBuffers.buffers[i] = create(Buffer::State{
+            .size = static_cast<uint32_t>(sizes[i]),
+            .usage = usages[i] | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .families = queueFamilies,
+            .vmaFlags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                        | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        });
+        VmaVirtualBlockCreateInfo blockCreateInfo = {.size = sizes[i]};
+        VK_LOG_ERR_FATAL(vmaCreateVirtualBlock(&blockCreateInfo, &m_geometryBuffers.blocks[i]));
+    }
+}
+
+void Renderer::destroyGeometryBuffers()
+{
+    for (size_t i = 0; i < m_geometryBuffers.buffers.size() && m_geometryBuffers.blocks[i] != VK_NULL_HANDLE; i++)
+    {
+        // meshes that outlive the renderer never free their ranges
+        vmaClearVirtualBlock(m_geometryBuffers.blocks[i]);
+        vmaDestroyVirtualBlock(m_geometryBuffers.blocks[i]);
+        destroy(m_geometryBuffers.buffers[i]);
+    }
+}
+
+bool Renderer::allocateGeometry(GeometryBuffer buffer, VkDeviceSize size, VkDeviceSize alignment, GeometryAllocation &allocation)
+{
+    allocation = {.buffer = buffer};
+    if (size == 0)
+    {
+        return true;
+    }
+
+    // VMA only aligns to powers of two, other alignments are reached by padding the range and rounding its offset up
+    bool isPowerOfTwo = std::has_single_bit(alignment);
+    VmaVirtualAllocationCreateInfo createInfo = {
+        .size = isPowerOfTwo ? size : size + alignment - 1,
+        .alignment = isPowerOfTwo ? alignment : 1,
+    };
+    VkDeviceSize offset = 0;
+    std::lock_guard<std::mutex> lock(m_geometryMutex);
+    createGeometryBuffers();
+    if (vmaVirtualAllocate(m_geometryBuffers.blocks[static_cast<size_t>(buffer)], &createInfo, &allocation.allocation, &offset)
+        != VK_SUCCESS)
+    {
+        allocation.allocation = VK_NULL_HANDLE;
+        return false;
+    }
+    allocation.offset = (offset + alignment - 1) / alignment * alignment;
+    return true;
+}
+
+void Renderer::freeGeometry(const GeometryAllocation &allocation)
+{
+    if (allocation.allocation == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_geometryMutex);
+    vmaVirtualFree(m_geometryBuffers.blocks[static_cast<size_t>(allocation.buffer)], allocation.allocation);
+}
+
+Handle<Buffer> Renderer::getGeometryBuffer(GeometryBuffer buffer)
+{
+    std::lock_guard<std::mutex> lock(m_geometryMutex);
+    createGeometryBuffers();
+    return m_geometryBuffers.buffers[static_cast<size_t>(buffer)];
+}
+
+std::unique_ptr<FrameCapture> Renderer::createFrameCapture()
+{
+    const char *captureDir = std::getenv("PACEM_CAPTURE_DIR");
+    if (!captureDir || !*captureDir)
+    {
+        return nullptr;
+    }
+    return std::make_unique<FrameCapture>(m_vmaAllocator, m_threadPool, captureDir);
+}
+
 bool Renderer::exitSignal()
 {
     return glfwWindowShouldClose(m_windowInfo.window);
@@ -747,8 +1054,21 @@ bool Renderer::exitSignal()
 VkResult Renderer::draw()
 {
     uint32_t frameIdx = (m_frameCount) % m_swapchainInfo.numImages;
-    VK_LOG_ERR(vkWaitForFences(m_deviceInfo.device, 1, &m_renderContext.fences[frameIdx], VK_TRUE, UINT64_MAX));
-    VK_LOG_ERR(vkResetFences(m_deviceInfo.device, 1, &m_renderContext.fences[frameIdx]));
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        waitTimeline(m_transferQueue.graphicsTimeline, m_renderContext.frameTimelineValues[frameIdx]);
+    }
+    else
+    {
+        VK_LOG_ERR(vkWaitForFences(m_deviceInfo.device, 1, &m_renderContext.fences[frameIdx], VK_TRUE, UINT64_MAX));
+        VK_LOG_ERR(vkResetFences(m_deviceInfo.device, 1, &m_renderContext.fences[frameIdx]));
+    }
+    if (m_frameCapture)
+    {
+        m_frameCapture->collect(frameIdx);
+    }
+    retireUploads();
+    processUploads();
 
     VkCommandBufferBeginInfo commandBufferBeginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
     VK_LOG_ERR(vkBeginCommandBuffer(m_renderContext.commandBuffers[frameIdx], &commandBufferBeginInfo));
@@ -758,6 +1078,11 @@ VkResult Renderer::draw()
         renderPass->fulfillRenderPassDependencies(m_renderContext.commandBuffers[frameIdx], frameIdx);
         renderPass->draw(m_renderContext.commandBuffers[frameIdx], frameIdx);
     }
+    if (m_frameCapture)
+    {
+        m_frameCapture->record(m_renderContext.commandBuffers[frameIdx], frameIdx, m_swapchainImages.curFrameData()->m_image,
+                               m_swapchainInfo.format, m_swapchainInfo.width, m_swapchainInfo.height);
+    }
 
     VK_LOG_ERR(vkEndCommandBuffer(m_renderContext.commandBuffers[frameIdx]));
 
@@ -774,8 +1099,27 @@ VkResult Renderer::draw()
     uint32_t imageIndex = 0;
     VK_LOG_ERR(vkAcquireNextImageKHR(m_deviceInfo.device, m_swapchainInfo.swapchain, UINT64_MAX, m_renderContext.imgAvailableSem[frameIdx],
                                      nullptr, &imageIndex));
-    VK_LOG_ERR(
-        vkQueueSubmit(m_deviceInfo.queues[m_deviceInfo.graphicsQueueFamily].queue, 1, &submitInfo, m_renderContext.fences[frameIdx]));
+    std::unique_lock<std::mutex> submitLock(m_queueSubmitMutex);
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        // the binary render done semaphore's value is ignored
+        std::array<VkSemaphore, 2> signalSemaphores = {m_renderContext.renderDoneSem[frameIdx], m_transferQueue.graphicsTimeline};
+        std::array<uint64_t, 2> signalValues = {0, ++m_transferQueue.graphicsSubmittedValue};
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+        timelineSubmitInfo.signalSemaphoreValueCount = signalValues.size();
+        timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.signalSemaphoreCount = signalSemaphores.size();
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        m_renderContext.frameTimelineValues[frameIdx] = signalValues[1];
+        VK_LOG_ERR(vkQueueSubmit(m_deviceInfo.queues[m_deviceInfo.graphicsQueueFamily].queue, 1, &submitInfo, VK_NULL_HANDLE));
+    }
+    else
+    {
+        VK_LOG_ERR(
+            vkQueueSubmit(m_deviceInfo.queues[m_deviceInfo.graphicsQueueFamily].queue, 1, &submitInfo, m_renderContext.fences[frameIdx]));
+    }
 
     VkPresentInfoKHR presentInfo = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
     presentInfo.waitSemaphoreCount = 1;
@@ -784,6 +1128,7 @@ VkResult Renderer::draw()
     presentInfo.pSwapchains = &m_swapchainInfo.swapchain;
     presentInfo.pImageIndices = &imageIndex;
     VkResult presentStatus = vkQueuePresentKHR(m_deviceInfo.queues[m_deviceInfo.presentQueueFamily].queue, &presentInfo);
+    submitLock.unlock();
     if (presentStatus == VK_ERROR_OUT_OF_DATE_KHR || presentStatus == VK_SUBOPTIMAL_KHR)
     {
         vkDeviceWaitIdle(m_deviceInfo.device);
@@ -803,11 +1148,47 @@ void Renderer::wait()
 
 void Renderer::destroyTransferQueue()
 {
-    vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.transferCommandPool, 1, &m_transferQueue.immCmdBuf);
-    vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.transferCommandPool, 1, &m_transferQueue.eofCmdBuf);
-    vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.graphicsCommandPool, 1, &m_transferQueue.graphicsCmdBuf);
+    // decode jobs of textures that were never uploaded may still own a staging buffer
+    m_threadPool.wait();
+    for (UploadableTexture &transfer : m_transferQueue.textureTransfers)
+    {
+        if (transfer.decodeJob)
+        {
+            const AllocatedBuffer &staging = transfer.decodeJob->staging.dedicated;
+            vmaDestroyBuffer(m_vmaAllocator, staging.buffer, staging.allocation);
+        }
+    }
+
+    // texture and compressed buffer uploads only complete with their graphics submission
+    VK_LOG_ERR(vkQueueWaitIdle(m_transferQueue.transferQueue));
+    VK_LOG_ERR(vkQueueWaitIdle(m_transferQueue.graphicsQueue));
+    retireUploads();
+    for (VkFence fence : m_transferQueue.freeFences)
+    {
+        vkDestroyFence(m_deviceInfo.device, fence, nullptr);
+    }
+    if (!m_transferQueue.freeCmdBufs.empty())
+    {
+        vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.transferCommandPool, m_transferQueue.freeCmdBufs.size(),
+                             m_transferQueue.freeCmdBufs.data());
+    }
+    if (!m_transferQueue.freeGraphicsCmdBufs.empty())
+    {
+        vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.graphicsCommandPool, m_transferQueue.freeGraphicsCmdBufs.size(),
+                             m_transferQueue.freeGraphicsCmdBufs.data());
+    }
+    for (ImmediateContext &context : m_transferQueue.immediateContexts)
+    {
+        vkFreeCommandBuffers(m_deviceInfo.device, context.commandPool, 1, &context.cmdBuf);
+        vkDestroyCommandPool(m_deviceInfo.device, context.commandPool, nullptr);
+        vkDestroyFence(m_deviceInfo.device, context.fence, nullptr);
+        vkDestroyQueryPool(m_deviceInfo.device, context.queryPool, nullptr);
+    }
     vkDestroyCommandPool(m_deviceInfo.device, m_transferQueue.transferCommandPool, nullptr);
     vkDestroyCommandPool(m_deviceInfo.device, m_transferQueue.graphicsCommandPool, nullptr);
+    vkDestroySemaphore(m_deviceInfo.device, m_transferQueue.transferTimeline, nullptr);
+    vkDestroySemaphore(m_deviceInfo.device, m_transferQueue.graphicsTimeline, nullptr);
+    vkDestroyQueryPool(m_deviceInfo.device, m_transferQueue.timestampPool, nullptr);
 }
 
 void Renderer::destroyRenderContext()
@@ -890,180 +1271,636 @@ Handle<Buffer> Renderer::uploadBufferToGpu(VkBuffer src, const Buffer::State &&d
     };
 
     Handle<Buffer> gpuBuf = create(std::move(dstState));
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    vkBeginCommandBuffer(m_transferQueue.immCmdBuf, &commandBufferBeginInfo);
-    vkCmdCopyBuffer(m_transferQueue.immCmdBuf, src, get(gpuBuf)->m_buffer, 1, &copyInfo);
-    vkEndCommandBuffer(m_transferQueue.immCmdBuf);
-
-    VkSubmitInfo submitInfo = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_transferQueue.immCmdBuf;
-
-    vkQueueSubmit(m_transferQueue.transferQueue, 1, &submitInfo, nullptr);
-    vkQueueWaitIdle(m_transferQueue.transferQueue);
+    addUploadCounters(UploadCategory::Buffer, {.bytes = copyInfo.size});
+    VkCommandBuffer cmdBuf = beginTransferCommands();
+    vkCmdCopyBuffer(cmdBuf, src, get(gpuBuf)->m_buffer, 1, &copyInfo);
+    waitForUpload(submitTransferCommands(cmdBuf, {}));
 
     return gpuBuf;
 }
 
-void Renderer::transferImageImmediate(UploadInfo &info)
+StagingAllocation Renderer::createStagingBuffer(VkDeviceSize size, VmaAllocationCreateFlags hostAccess)
 {
-    VkCommandBuffer transferCmdBuffer = createCommandBuffer(m_deviceInfo, m_transferQueue.transferCommandPool);
-    VkCommandBuffer graphicsCmdBuffer = createCommandBuffer(m_deviceInfo, m_transferQueue.graphicsCommandPool);
-
-    VkImageSubresourceLayers subResourceLayers = {};
-    subResourceLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subResourceLayers.mipLevel = 0;
-    subResourceLayers.baseArrayLayer = 0;
-    subResourceLayers.layerCount = 1;
-
-    VkBufferImageCopy bufferImageCopy;
-    bufferImageCopy.bufferOffset = 0;
-    bufferImageCopy.bufferRowLength = 0;
-    bufferImageCopy.bufferImageHeight = 0;
-    bufferImageCopy.imageSubresource = subResourceLayers;
-    bufferImageCopy.imageOffset = {0, 0, 0};
-    bufferImageCopy.imageExtent = {info.dst.m_width, info.dst.m_height, 1};
-
-    VkImageSubresourceRange subresourceRange = {};
-    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subresourceRange.baseArrayLayer = 0;
-    subresourceRange.baseMipLevel = 0;
-    subresourceRange.layerCount = 1;
-    subresourceRange.levelCount = 1;
-
-    VkImageMemoryBarrier imageToTransfer = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-    imageToTransfer.srcAccessMask = 0;
-    imageToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageToTransfer.srcQueueFamilyIndex = m_deviceInfo.transferQueueFamily;
-    imageToTransfer.dstQueueFamilyIndex = m_deviceInfo.transferQueueFamily;
-    imageToTransfer.image = info.dst.m_image;
-    imageToTransfer.subresourceRange = subresourceRange;
-
-    VkImageMemoryBarrier imageOwnershipTransferBarrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-    imageOwnershipTransferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageOwnershipTransferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageOwnershipTransferBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageOwnershipTransferBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageOwnershipTransferBarrier.srcQueueFamilyIndex = m_deviceInfo.transferQueueFamily;
-    imageOwnershipTransferBarrier.dstQueueFamilyIndex = m_deviceInfo.graphicsQueueFamily;
-    imageOwnershipTransferBarrier.image = info.dst.m_image;
-    imageOwnershipTransferBarrier.subresourceRange = subresourceRange;
-
-    VkImageMemoryBarrier imageToReadable = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-    imageToReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageToReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    imageToReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageToReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageToReadable.srcQueueFamilyIndex = m_deviceInfo.graphicsQueueFamily;
-    imageToReadable.dstQueueFamilyIndex = m_deviceInfo.graphicsQueueFamily;
-    imageToReadable.image = info.dst.m_image;
-    imageToReadable.subresourceRange = subresourceRange;
-
-    VkSemaphoreCreateInfo semCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-    VkSemaphore transferSem;
-    vkCreateSemaphore(m_deviceInfo.device, &semCreateInfo, nullptr, &transferSem);
-
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    vkBeginCommandBuffer(transferCmdBuffer, &commandBufferBeginInfo);
-    vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-                         &imageToTransfer);
-    vkCmdCopyBufferToImage(transferCmdBuffer, info.src, info.dst.m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferImageCopy);
-
-    vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
-                         &imageOwnershipTransferBarrier);
-    vkEndCommandBuffer(transferCmdBuffer);
-
-    VkSubmitInfo transferSubmission = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    transferSubmission.commandBufferCount = 1;
-    transferSubmission.pCommandBuffers = &transferCmdBuffer;
-    transferSubmission.signalSemaphoreCount = 1;
-    transferSubmission.pSignalSemaphores = &transferSem;
-
-    vkQueueSubmit(m_transferQueue.transferQueue, 1, &transferSubmission, nullptr);
-    vkBeginCommandBuffer(graphicsCmdBuffer, &commandBufferBeginInfo);
-    vkCmdPipelineBarrier(graphicsCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
-                         nullptr, 1, &imageToReadable);
-    vkEndCommandBuffer(graphicsCmdBuffer);
+    VkBufferCreateInfo stagingBufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    stagingBufferInfo.size = size;
+    stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    stagingBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    VkPipelineStageFlags waitStageFlags = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    auto queueFamilyIndices = std::to_array({m_deviceInfo.graphicsQueueFamily, m_deviceInfo.transferQueueFamily});
+    stagingBufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+    stagingBufferInfo.queueFamilyIndexCount = queueFamilyIndices.size();
 
-    VkSubmitInfo graphicsSubmission = {};
-    graphicsSubmission.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    graphicsSubmission.commandBufferCount = 1;
-    graphicsSubmission.pCommandBuffers = &graphicsCmdBuffer;
-    graphicsSubmission.pWaitDstStageMask = &waitStageFlags;
-    graphicsSubmission.pWaitSemaphores = &transferSem;
-    graphicsSubmission.waitSemaphoreCount = 1;
+    VmaAllocationCreateInfo vmaStagingBufAllocInfo = {};
+    vmaStagingBufAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    vmaStagingBufAllocInfo.flags = hostAccess | VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-    VkFenceCreateInfo fence_create_info = {};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    VkFence transferFence;
+    StagingAllocation staging = {};
+    VmaAllocationInfo stagingAllocInfo;
+    VK_LOG_ERR(vmaCreateBuffer(m_vmaAllocator, &stagingBufferInfo, &vmaStagingBufAllocInfo, &staging.dedicated.buffer,
+                               &staging.dedicated.allocation, &stagingAllocInfo));
+    staging.buffer = staging.dedicated.buffer;
+    staging.size = size;
+    staging.data = static_cast<uint8_t *>(stagingAllocInfo.pMappedData);
+    return staging;
+}
 
-    vkCreateFence(m_deviceInfo.device, &fence_create_info, nullptr, &transferFence);
-    vkQueueSubmit(m_transferQueue.graphicsQueue, 1, &graphicsSubmission, transferFence);
-    vkWaitForFences(m_deviceInfo.device, 1, &transferFence, VK_TRUE, UINT64_MAX);
+StagingAllocation Renderer::allocateStaging(VkDeviceSize size)
+{
+    StagingAllocation staging = {};
+    while (!m_stagingRing.allocate(size, StagingAlignment, staging))
+    {
+        if (m_transferQueue.inFlight.empty())
+        {
+            m_stagingRing.retire(m_transferQueue.completedValue);
+            if (m_stagingRing.allocate(size, StagingAlignment, staging))
+            {
+                break;
+            }
+
+            // Nothing in flight is left to hand regions back. Either the request is larger than the whole ring, or the
+            // ring is taken by regions no submission reads yet, the unsubmitted copies of the caller and the decodes
+            // that are still held
+            std::cout << "No room for an upload of " << size << " bytes in the staging ring, using a dedicated staging buffer"
+                      << std::endl;
+            return createStagingBuffer(size);
+        }
 
-    vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.transferCommandPool, 1, &transferCmdBuffer);
-    vkFreeCommandBuffers(m_deviceInfo.device, m_transferQueue.graphicsCommandPool, 1, &graphicsCmdBuffer);
-    vkDestroySemaphore(m_deviceInfo.device, transferSem, nullptr);
-    vkDestroyFence(m_deviceInfo.device, transferFence, nullptr);
+        // the ring is full, block until the oldest upload hands its regions back
+        waitForUpload({m_transferQueue.inFlight.front().value});
+    }
+    return staging;
 }
 
-Handle<Image> Renderer::uploadImageToGpu(VkBuffer src, const Image::State &&dstState)
+VkCommandBuffer Renderer::beginTransferCommands()
 {
-    VkImageSubresourceLayers subResourceLayers = {};
-    subResourceLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subResourceLayers.mipLevel = 0;
-    subResourceLayers.baseArrayLayer = 0;
-    subResourceLayers.layerCount = 1;
-
-    VkBufferImageCopy bufferImageCopy;
-    bufferImageCopy.bufferOffset = 0;
-    bufferImageCopy.bufferRowLength = 0;
-    bufferImageCopy.bufferImageHeight = 0;
-    bufferImageCopy.imageSubresource = subResourceLayers;
-    bufferImageCopy.imageOffset = {0, 0, 0};
-    bufferImageCopy.imageExtent = {dstState.width, dstState.height, 1};
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    if (!m_transferQueue.freeCmdBufs.empty())
+    {
+        cmdBuf = m_transferQueue.freeCmdBufs.back();
+        m_transferQueue.freeCmdBufs.pop_back();
+    }
+    else
+    {
+        cmdBuf = createCommandBuffer(m_deviceInfo, m_transferQueue.transferCommandPool);
+    }
 
-    Handle<Image> dst = create(std::move(dstState));
-    UploadInfo uploadInfo = {
-        .src = src,
-        .dst = *get(dst),
+    VkCommandBufferBeginInfo cmdBufBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
-    transferImageImmediate(uploadInfo);
-    return dst;
+    VK_LOG_ERR(vkBeginCommandBuffer(cmdBuf, &cmdBufBeginInfo));
+    m_transferQueue.recordingTimestampQuery = beginTimestamp(cmdBuf);
+    return cmdBuf;
 }
 
-void Renderer::updateDescriptor(const DescriptorUpdateState &descriptorUpdateState)
+UploadToken Renderer::submitTransferCommands(VkCommandBuffer cmdBuf, const AllocatedBuffer &staging)
 {
-    VkDescriptorImageInfo descriptorImageInfo = {
-        .sampler = descriptorUpdateState.imageSampler,
-        .imageView = descriptorUpdateState.imageView,
-        .imageLayout = descriptorUpdateState.imageLayout,
-    };
+    uint32_t timestampQuery = m_transferQueue.recordingTimestampQuery;
+    m_transferQueue.recordingTimestampQuery = NoTimestampQuery;
+    endTimestamp(cmdBuf, timestampQuery);
+    VK_LOG_ERR(vkEndCommandBuffer(cmdBuf));
+    addUploadCounters(UploadCategory::Buffer, {.submissions = 1});
 
-    VkWriteDescriptorSet writeDiffuseDescriptorSet = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    writeDiffuseDescriptorSet.dstSet = descriptorUpdateState.descriptorSet;
-    writeDiffuseDescriptorSet.dstBinding = descriptorUpdateState.binding;
-    writeDiffuseDescriptorSet.dstArrayElement = descriptorUpdateState.dstArrayElement;
-    writeDiffuseDescriptorSet.descriptorCount = 1;
-    writeDiffuseDescriptorSet.descriptorType = descriptorUpdateState.descriptorType;
-    writeDiffuseDescriptorSet.pImageInfo = &descriptorImageInfo;
+    VkFence fence = acquireUploadFence();
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdBuf,
+    };
+    std::unique_lock<std::mutex> submitLock(m_queueSubmitMutex);
+    uint64_t value = ++m_transferQueue.submittedValue;
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &value;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &m_transferQueue.transferTimeline;
+    }
+    VK_LOG_ERR(vkQueueSubmit(m_transferQueue.transferQueue, 1, &submitInfo, fence));
+    submitLock.unlock();
+
+    InFlightUpload &upload = m_transferQueue.inFlight.emplace_back();
+    upload.value = value;
+    upload.fence = fence;
+    upload.cmdBuf = cmdBuf;
+    upload.timestampQuery = timestampQuery;
+    if (staging.buffer != VK_NULL_HANDLE)
+    {
+        upload.staging.push_back(staging);
+    }
+    m_stagingRing.release(value);
+    return UploadToken{value};
+}
 
-    vkUpdateDescriptorSets(m_deviceInfo.device, 1, &writeDiffuseDescriptorSet, 0, nullptr);
+VkFence Renderer::acquireUploadFence()
+{
+    // with timeline semaphores a submission is tracked by its value on the timeline alone
+    VkFence fence = VK_NULL_HANDLE;
+    if (!m_deviceInfo.timelineSemaphores && !m_transferQueue.freeFences.empty())
+    {
+        fence = m_transferQueue.freeFences.back();
+        m_transferQueue.freeFences.pop_back();
+    }
+    else if (!m_deviceInfo.timelineSemaphores)
+    {
+        VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        VK_LOG_ERR(vkCreateFence(m_deviceInfo.device, &fenceCreateInfo, nullptr, &fence));
+    }
+    return fence;
 }
 
-void Renderer::writeDescriptor(const DescriptorWriteState &descriptorUpdateState)
+void Renderer::retireUploads()
 {
-    VkDescriptorImageInfo descriptorImageInfo = {
-        .sampler = descriptorUpdateState.imageSampler,
-        .imageView = descriptorUpdateState.imageView,
-        .imageLayout = descriptorUpdateState.imageLayout,
-    };
+    // a single counter read tells which submissions finished, instead of polling a fence per submission
+    uint64_t timelineValue = 0;
+    uint64_t graphicsTimelineValue = 0;
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        timelineValue = getTimelineValue(m_transferQueue.transferTimeline);
+        graphicsTimelineValue = getTimelineValue(m_transferQueue.graphicsTimeline);
+    }
 
-    VkWriteDescriptorSet writeDiffuseDescriptorSet = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    while (!m_transferQueue.inFlight.empty())
+    {
+        InFlightUpload &upload = m_transferQueue.inFlight.front();
+        if (m_deviceInfo.timelineSemaphores && (upload.value > timelineValue || upload.graphicsValue > graphicsTimelineValue))
+        {
+            break;
+        }
+        if (!m_deviceInfo.timelineSemaphores)
+        {
+            if (vkGetFenceStatus(m_deviceInfo.device, upload.fence) != VK_SUCCESS)
+            {
+                break;
+            }
+            VK_LOG_ERR(vkResetFences(m_deviceInfo.device, 1, &upload.fence));
+            m_transferQueue.freeFences.push_back(upload.fence);
+        }
+
+        m_transferQueue.freeCmdBufs.push_back(upload.cmdBuf);
+        if (upload.graphicsCmdBuf != VK_NULL_HANDLE)
+        {
+            m_transferQueue.freeGraphicsCmdBufs.push_back(upload.graphicsCmdBuf);
+        }
+        if (upload.semaphore != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(m_deviceInfo.device, upload.semaphore, nullptr);
+        }
+        retireTimestamp(upload.timestampQuery, upload.category);
+        for (const AllocatedBuffer &staging : upload.staging)
+        {
+            vmaDestroyBuffer(m_vmaAllocator, staging.buffer, staging.allocation);
+        }
+
+        m_transferQueue.completedValue = upload.value;
+        m_transferQueue.inFlight.pop_front();
+    }
+
+    // values signalled by immediate submissions on the transfer queue have no in flight entry. An upload whose
+    // copies have finished may still wait for its graphics submission though, which holds the completed value back.
+    uint64_t completedLimit = timelineValue;
+    if (!m_transferQueue.inFlight.empty())
+    {
+        completedLimit = std::min(completedLimit, m_transferQueue.inFlight.front().value - 1);
+    }
+    m_transferQueue.completedValue = std::max(m_transferQueue.completedValue, completedLimit);
+    m_stagingRing.retire(m_transferQueue.completedValue);
+}
+
+bool Renderer::isUploadComplete(UploadToken token)
+{
+    if (token.value <= m_transferQueue.completedValue)
+    {
+        return true;
+    }
+
+    retireUploads();
+    return token.value <= m_transferQueue.completedValue;
+}
+
+void Renderer::waitForUpload(UploadToken token)
+{
+    if (isUploadComplete(token))
+    {
+        return;
+    }
+
+    // texture and compressed buffer uploads finish on the graphics queue, which isn't ordered with the transfer queue,
+    // so the graphics submissions of every such upload up to the token are waited on as well
+    auto waitStart = std::chrono::steady_clock::now();
+    UploadCategory category = UploadCategory::Buffer;
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        uint64_t graphicsValue = 0;
+        for (const InFlightUpload &upload : m_transferQueue.inFlight)
+        {
+            if (upload.value > token.value)
+            {
+                break;
+            }
+            graphicsValue = std::max(graphicsValue, upload.graphicsValue);
+            category = upload.category;
+        }
+        waitTimeline(m_transferQueue.transferTimeline, token.value);
+        waitTimeline(m_transferQueue.graphicsTimeline, graphicsValue);
+    }
+    else
+    {
+        // a fence signal also covers every earlier submission on its queue, so besides the token's own fence only the
+        // fences of uploads finished on the graphics queue have to be waited on
+        for (const InFlightUpload &upload : m_transferQueue.inFlight)
+        {
+            if (upload.value >= token.value || upload.graphicsCmdBuf != VK_NULL_HANDLE)
+            {
+                VK_LOG_ERR(vkWaitForFences(m_deviceInfo.device, 1, &upload.fence, VK_TRUE, UINT64_MAX));
+            }
+            if (upload.value >= token.value)
+            {
+                category = upload.category;
+                break;
+            }
+        }
+    }
+    addUploadCounters(category, {.waitMs = getElapsedMs(waitStart)});
+    retireUploads();
+}
+
+uint8_t *Renderer::getHostPointer(const Buffer &buffer)
+{
+    VkMemoryPropertyFlags memoryProperties = 0;
+    vmaGetAllocationMemoryProperties(m_vmaAllocator, buffer.m_allocation, &memoryProperties);
+    if (!(memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    {
+        return nullptr;
+    }
+    return static_cast<uint8_t *>(buffer.m_allocationInfo.pMappedData);
+}
+
+UploadToken Renderer::uploadToBufferAsync(const std::span<const uint8_t> &buf, Handle<Buffer> dst, VkDeviceSize dstOffset)
+{
+    // device local memory that is also host visible (UMA, ReBAR, software devices) is written directly,
+    // skipping both the staging copy and the queue submission
+    UploadCounters counters = {.bytes = buf.size()};
+    Buffer *dstBuffer = get(dst);
+    if (uint8_t *hostPtr = getHostPointer(*dstBuffer))
+    {
+        auto memcpyStart = std::chrono::steady_clock::now();
+        memcpy(hostPtr + dstOffset, buf.data(), buf.size());
+        VK_LOG_ERR(vmaFlushAllocation(m_vmaAllocator, dstBuffer->m_allocation, dstOffset, buf.size()));
+        counters.memcpyMs += getElapsedMs(memcpyStart);
+        addUploadCounters(UploadCategory::Buffer, counters);
+        return UploadToken{};
+    }
+
+    StagingAllocation staging = allocateStaging(buf.size());
+    auto memcpyStart = std::chrono::steady_clock::now();
+    memcpy(staging.data, buf.data(), buf.size());
+    counters.memcpyMs += getElapsedMs(memcpyStart);
+    addUploadCounters(UploadCategory::Buffer, counters);
+    if (staging.dedicated.buffer == VK_NULL_HANDLE)
+    {
+        m_stagingRing.flush(staging);
+    }
+
+    VkBufferCopy copyInfo = {
+        .srcOffset = staging.offset,
+        .dstOffset = dstOffset,
+        .size = buf.size(),
+    };
+
+    VkCommandBuffer cmdBuf = beginTransferCommands();
+    vkCmdCopyBuffer(cmdBuf, staging.buffer, get(dst)->m_buffer, 1, &copyInfo);
+    return submitTransferCommands(cmdBuf, staging.dedicated);
+}
+
+Handle<Buffer> Renderer::createGpuBuffer(VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    auto queueFamilies = std::to_array({QueueFamily::Graphics, QueueFamily::Transfer});
+    // VMA picks host visible device local memory when there is some and otherwise falls back to plain device local
+    // memory, in which case the buffer isn't mapped and the upload goes through the staging ring
+    return create(Buffer::State{
+        .size = static_cast<uint32_t>(size),
+        .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .families = queueFamilies,
+        .vmaFlags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                    | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    });
+}
+
+Handle<Buffer> Renderer::uploadCpuBufferToGpuAsync(const std::span<uint8_t> &buf, VkBufferUsageFlags usage, UploadToken &token)
+{
+    Handle<Buffer> gpuBuffer = createGpuBuffer(buf.size(), usage);
+    token = uploadToBufferAsync(buf, gpuBuffer);
+    return gpuBuffer;
+}
+
+// Each level is blitted from the previous one, which is moved to transfer src for the blit and to shader read once it
+// has been consumed. Expects every level in transfer dst and leaves every level in shader read only.
+static void recordMipChain(VkCommandBuffer cmdBuf, const Renderer::UploadInfo &info)
+{
+    VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = info.dst;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.subresourceRange.levelCount = 1;
+
+    int32_t mipWidth = static_cast<int32_t>(info.width);
+    int32_t mipHeight = static_cast<int32_t>(info.height);
+    for (uint32_t level = 1; level < info.mipLevels; level++)
+    {
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        int32_t nextWidth = std::max(mipWidth / 2, 1);
+        int32_t nextHeight = std::max(mipHeight / 2, 1);
+        VkImageBlit blit = {};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        vkCmdBlitImage(cmdBuf, info.dst, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, info.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                       VK_FILTER_LINEAR);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    barrier.subresourceRange.baseMipLevel = info.mipLevels - 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+}
+
+UploadToken Renderer::submitImageTransfers(const std::span<UploadInfo> &infos, std::vector<AllocatedBuffer> &&staging)
+{
+    if (infos.empty())
+    {
+        return UploadToken{};
+    }
+
+    VkImageSubresourceLayers subResourceLayers = {};
+    subResourceLayers.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subResourceLayers.mipLevel = 0;
+    subResourceLayers.baseArrayLayer = 0;
+    subResourceLayers.layerCount = 1;
+
+    // With a single queue family there is no ownership to transfer. The release barrier is left out and the acquire
+    // barrier becomes a plain layout transition, ordered after the copies by the semaphore wait at the transfer stage
+    bool transferOwnership = m_deviceInfo.transferQueueFamily != m_deviceInfo.graphicsQueueFamily;
+    VkPipelineStageFlags waitStageFlags = transferOwnership ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    // every image goes through the same three barriers, so each stage is recorded as a single batch for the whole upload
+    std::vector<VkImageMemoryBarrier> toTransferBarriers(infos.size());
+    std::vector<VkImageMemoryBarrier> releaseBarriers(infos.size());
+    std::vector<VkImageMemoryBarrier> acquireBarriers(infos.size());
+    bool generateMips = false;
+    for (size_t i = 0; i < infos.size(); i++)
+    {
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.baseMipLevel = 0;
+        subresourceRange.layerCount = 1;
+        subresourceRange.levelCount = infos[i].mipLevels;
+
+        VkImageMemoryBarrier &imageToTransfer = toTransferBarriers[i];
+        imageToTransfer = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        imageToTransfer.srcAccessMask = 0;
+        imageToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageToTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageToTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageToTransfer.image = infos[i].dst;
+        imageToTransfer.subresourceRange = subresourceRange;
+
+        // the release and acquire halves of the ownership transfer must describe the same layout transition. Images
+        // with a mip chain stay in transfer dst since the blits generating the chain run on the graphics queue
+        bool hasMips = infos[i].mipLevels > 1;
+        generateMips |= hasMips;
+
+        VkImageMemoryBarrier &imageRelease = releaseBarriers[i];
+        imageRelease = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        imageRelease.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageRelease.dstAccessMask = 0;
+        imageRelease.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageRelease.newLayout = hasMips ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageRelease.srcQueueFamilyIndex = m_deviceInfo.transferQueueFamily;
+        imageRelease.dstQueueFamilyIndex = m_deviceInfo.graphicsQueueFamily;
+        imageRelease.image = infos[i].dst;
+        imageRelease.subresourceRange = subresourceRange;
+
+        VkImageMemoryBarrier &imageAcquire = acquireBarriers[i];
+        imageAcquire = imageRelease;
+        imageAcquire.srcAccessMask = 0;
+        imageAcquire.dstAccessMask = hasMips ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+        if (!transferOwnership)
+        {
+            imageAcquire.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageAcquire.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+    }
+
+    VkCommandBuffer transferCmdBuffer = beginTransferCommands();
+    vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                         toTransferBarriers.size(), toTransferBarriers.data());
+    for (const UploadInfo &info : infos)
+    {
+        VkBufferImageCopy bufferImageCopy;
+        bufferImageCopy.bufferOffset = info.srcOffset;
+        bufferImageCopy.bufferRowLength = 0;
+        bufferImageCopy.bufferImageHeight = 0;
+        bufferImageCopy.imageSubresource = subResourceLayers;
+        bufferImageCopy.imageOffset = {0, 0, 0};
+        bufferImageCopy.imageExtent = {info.width, info.height, 1};
+        vkCmdCopyBufferToImage(transferCmdBuffer, info.src, info.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferImageCopy);
+    }
+    if (transferOwnership)
+    {
+        vkCmdPipelineBarrier(transferCmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                             nullptr, releaseBarriers.size(), releaseBarriers.data());
+    }
+
+    return submitGraphicsHandoff(transferCmdBuffer, waitStageFlags, UploadCategory::Texture,
+                                 [&](VkCommandBuffer graphicsCmdBuffer)
+                                 {
+                                     VkPipelineStageFlags acquireStages =
+                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | (generateMips ? VK_PIPELINE_STAGE_TRANSFER_BIT : 0);
+                                     vkCmdPipelineBarrier(graphicsCmdBuffer, waitStageFlags, acquireStages, 0, 0, nullptr, 0, nullptr,
+                                                          acquireBarriers.size(), acquireBarriers.data());
+                                     for (const UploadInfo &info : infos)
+                                     {
+                                         if (info.mipLevels > 1)
+                                         {
+                                             recordMipChain(graphicsCmdBuffer, info);
+                                         }
+                                     }
+                                 },
+                                 std::move(staging));
+}
+
+// The transfer submission signals the transfer timeline, or a one off binary semaphore without timeline semaphores,
+// which the graphics submission waits on at waitStageFlags. The upload completes with the graphics submission, tracked
+// by its value on the graphics timeline or by a fence of its own
+UploadToken Renderer::submitGraphicsHandoff(VkCommandBuffer transferCmdBuf, VkPipelineStageFlags waitStageFlags, UploadCategory category,
+                                            FunctionRef<void(VkCommandBuffer cmd)> recordGraphics, std::vector<AllocatedBuffer> &&staging)
+{
+    uint32_t timestampQuery = m_transferQueue.recordingTimestampQuery;
+    m_transferQueue.recordingTimestampQuery = NoTimestampQuery;
+    endTimestamp(transferCmdBuf, timestampQuery);
+    VK_LOG_ERR(vkEndCommandBuffer(transferCmdBuf));
+
+    VkSemaphore transferSem = m_transferQueue.transferTimeline;
+    if (!m_deviceInfo.timelineSemaphores)
+    {
+        VkSemaphoreCreateInfo semCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        VK_LOG_ERR(vkCreateSemaphore(m_deviceInfo.device, &semCreateInfo, nullptr, &transferSem));
+    }
+
+    VkSubmitInfo transferSubmission = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    transferSubmission.commandBufferCount = 1;
+    transferSubmission.pCommandBuffers = &transferCmdBuf;
+    transferSubmission.signalSemaphoreCount = 1;
+    transferSubmission.pSignalSemaphores = &transferSem;
+    std::unique_lock<std::mutex> submitLock(m_queueSubmitMutex);
+    uint64_t transferValue = ++m_transferQueue.submittedValue;
+    VkTimelineSemaphoreSubmitInfo transferTimelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        transferTimelineInfo.signalSemaphoreValueCount = 1;
+        transferTimelineInfo.pSignalSemaphoreValues = &transferValue;
+        transferSubmission.pNext = &transferTimelineInfo;
+    }
+    VK_LOG_ERR(vkQueueSubmit(m_transferQueue.transferQueue, 1, &transferSubmission, nullptr));
+    submitLock.unlock();
+
+    VkCommandBuffer graphicsCmdBuffer = VK_NULL_HANDLE;
+    if (!m_transferQueue.freeGraphicsCmdBufs.empty())
+    {
+        graphicsCmdBuffer = m_transferQueue.freeGraphicsCmdBufs.back();
+        m_transferQueue.freeGraphicsCmdBufs.pop_back();
+    }
+    else
+    {
+        graphicsCmdBuffer = createCommandBuffer(m_deviceInfo, m_transferQueue.graphicsCommandPool);
+    }
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_LOG_ERR(vkBeginCommandBuffer(graphicsCmdBuffer, &commandBufferBeginInfo));
+    recordGraphics(graphicsCmdBuffer);
+    VK_LOG_ERR(vkEndCommandBuffer(graphicsCmdBuffer));
+
+    VkSubmitInfo graphicsSubmission = {};
+    graphicsSubmission.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    graphicsSubmission.commandBufferCount = 1;
+    graphicsSubmission.pCommandBuffers = &graphicsCmdBuffer;
+    graphicsSubmission.pWaitDstStageMask = &waitStageFlags;
+    graphicsSubmission.pWaitSemaphores = &transferSem;
+    graphicsSubmission.waitSemaphoreCount = 1;
+
+    addUploadCounters(category, {.submissions = 1});
+    VkFence fence = acquireUploadFence();
+    uint64_t graphicsValue = 0;
+    VkTimelineSemaphoreSubmitInfo graphicsTimelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    submitLock.lock();
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        graphicsValue = ++m_transferQueue.graphicsSubmittedValue;
+        graphicsTimelineInfo.waitSemaphoreValueCount = 1;
+        graphicsTimelineInfo.pWaitSemaphoreValues = &transferValue;
+        graphicsTimelineInfo.signalSemaphoreValueCount = 1;
+        graphicsTimelineInfo.pSignalSemaphoreValues = &graphicsValue;
+        graphicsSubmission.pNext = &graphicsTimelineInfo;
+        graphicsSubmission.signalSemaphoreCount = 1;
+        graphicsSubmission.pSignalSemaphores = &m_transferQueue.graphicsTimeline;
+    }
+    VK_LOG_ERR(vkQueueSubmit(m_transferQueue.graphicsQueue, 1, &graphicsSubmission, fence));
+    submitLock.unlock();
+
+    InFlightUpload &upload = m_transferQueue.inFlight.emplace_back();
+    upload.value = transferValue;
+    upload.fence = fence;
+    upload.cmdBuf = transferCmdBuf;
+    upload.staging = std::move(staging);
+    upload.timestampQuery = timestampQuery;
+    upload.category = category;
+    upload.graphicsCmdBuf = graphicsCmdBuffer;
+    upload.graphicsValue = graphicsValue;
+    upload.semaphore = m_deviceInfo.timelineSemaphores ? VK_NULL_HANDLE : transferSem;
+    m_stagingRing.release(transferValue);
+    return UploadToken{transferValue};
+}
+
+void Renderer::transferImagesImmediate(const std::span<UploadInfo> &infos)
+{
+    waitForUpload(submitImageTransfers(infos, {}));
+}
+
+Handle<Image> Renderer::uploadImageToGpu(VkBuffer src, const Image::State &&dstState, VkDeviceSize srcOffset)
+{
+    Handle<Image> dst = create(std::move(dstState));
+    Image *dstImage = get(dst);
+    UploadInfo uploadInfo = {
+        .src = src,
+        .dst = dstImage->m_image,
+        .width = dstImage->m_width,
+        .height = dstImage->m_height,
+        .mipLevels = dstImage->m_mipLevels,
+        .srcOffset = srcOffset,
+    };
+    transferImagesImmediate(std::span(&uploadInfo, 1));
+    return dst;
+}
+
+void Renderer::updateDescriptor(const DescriptorUpdateState &descriptorUpdateState)
+{
+    VkDescriptorImageInfo descriptorImageInfo = {
+        .sampler = descriptorUpdateState.imageSampler,
+        .imageView = descriptorUpdateState.imageView,
+        .imageLayout = descriptorUpdateState.imageLayout,
+    };
+
+    VkWriteDescriptorSet writeDiffuseDescriptorSet = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    writeDiffuseDescriptorSet.dstSet = descriptorUpdateState.descriptorSet;
+    writeDiffuseDescriptorSet.dstBinding = descriptorUpdateState.binding;
+    writeDiffuseDescriptorSet.dstArrayElement = descriptorUpdateState.dstArrayElement;
+    writeDiffuseDescriptorSet.descriptorCount = 1;
+    writeDiffuseDescriptorSet.descriptorType = descriptorUpdateState.descriptorType;
+    writeDiffuseDescriptorSet.pImageInfo = &descriptorImageInfo;
+
+    vkUpdateDescriptorSets(m_deviceInfo.device, 1, &writeDiffuseDescriptorSet, 0, nullptr);
+}
+
+void Renderer::writeDescriptor(const DescriptorWriteState &descriptorUpdateState)
+{
+    VkDescriptorImageInfo descriptorImageInfo = {
+        .sampler = descriptorUpdateState.imageSampler,
+        .imageView = descriptorUpdateState.imageView,
+        .imageLayout = descriptorUpdateState.imageLayout,
+    };
+
+    VkWriteDescriptorSet writeDiffuseDescriptorSet = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
     writeDiffuseDescriptorSet.dstSet = descriptorUpdateState.descriptorSet;
     writeDiffuseDescriptorSet.dstBinding = descriptorUpdateState.binding;
     writeDiffuseDescriptorSet.dstArrayElement = descriptorUpdateState.dstArrayElement;
@@ -1091,6 +1928,11 @@ void Renderer::addRenderPass(RenderPass *renderPass)
 
 void Renderer::handleResize()
 {
+    // frame indices restart from zero, hand off the readbacks still keyed by the old ones
+    if (m_frameCapture)
+    {
+        m_frameCapture->collectAll();
+    }
     m_frameCount = 0;
     freeSwapchainImages();
     VkSwapchainKHR oldSwapchain = m_swapchainInfo.swapchain;
@@ -1118,116 +1960,1040 @@ Renderer::Renderer()
     , m_descriptorPools({createDescriptorPool()})
     , m_renderContext(createRenderContext())
     , m_transferQueue(createTransferQueue())
+    , m_stagingRing(createStagingRing())
+    , m_frameCapture(createFrameCapture())
+{
+}
+
+VkQueue Renderer::getQueue(QueueFamily family)
+{
+    switch (family)
+    {
+    case QueueFamily::Transfer:
+        return m_transferQueue.transferQueue;
+    case QueueFamily::Graphics:
+        return m_transferQueue.graphicsQueue;
+    default:
+        assert(false && "Unsupported queue family!");
+        return VK_NULL_HANDLE;
+    }
+}
+
+VkSemaphore &Renderer::getTimeline(QueueFamily family)
+{
+    assert(family == QueueFamily::Transfer || family == QueueFamily::Graphics);
+    return family == QueueFamily::Transfer ? m_transferQueue.transferTimeline : m_transferQueue.graphicsTimeline;
+}
+
+ImmediateContext *Renderer::acquireImmediateContext(QueueFamily family)
 {
+    std::lock_guard<std::mutex> lock(m_immediateMutex);
+    std::vector<ImmediateContext *> &freeContexts = m_transferQueue.freeImmediateContexts[static_cast<size_t>(family)];
+    if (!freeContexts.empty())
+    {
+        ImmediateContext *context = freeContexts.back();
+        freeContexts.pop_back();
+        return context;
+    }
+
+    ImmediateContext context = {
+        .family = family,
+        .commandPool = createCommandPool(m_deviceInfo.device, getQueueFamilyIdx(family)),
+    };
+    context.cmdBuf = createCommandBuffer(m_deviceInfo, context.commandPool);
+    if (!m_deviceInfo.timelineSemaphores)
+    {
+        VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+        VK_LOG_ERR(vkCreateFence(m_deviceInfo.device, &fenceCreateInfo, nullptr, &context.fence));
+    }
+    if (hasTimestamps(family))
+    {
+        context.queryPool = createTimestampPool(m_deviceInfo.device, 2);
+    }
+    return &m_transferQueue.immediateContexts.emplace_back(context);
 }
 
-void Renderer::transferImmediate(std::function<void(VkCommandBuffer cmd)> &&function)
+ImmediateToken Renderer::submitImmediate(QueueFamily family, FunctionRef<void(VkCommandBuffer cmd)> function)
 {
+    ImmediateContext *context = acquireImmediateContext(family);
 
+    // the context is owned by this thread until it is returned in waitImmediate, so recording needs no lock
+    VK_LOG_ERR(vkResetCommandPool(m_deviceInfo.device, context->commandPool, 0));
     VkCommandBufferBeginInfo cmdBufBeginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
     };
-    vkBeginCommandBuffer(m_transferQueue.immCmdBuf, &cmdBufBeginInfo);
-    function(m_transferQueue.immCmdBuf);
-    vkEndCommandBuffer(m_transferQueue.immCmdBuf);
+    VK_LOG_ERR(vkBeginCommandBuffer(context->cmdBuf, &cmdBufBeginInfo));
+    if (context->queryPool != VK_NULL_HANDLE)
+    {
+        vkResetQueryPool(m_deviceInfo.device, context->queryPool, 0, 2);
+        vkCmdWriteTimestamp(context->cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, context->queryPool, 0);
+    }
+    function(context->cmdBuf);
+    if (context->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(context->cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, context->queryPool, 1);
+    }
+    VK_LOG_ERR(vkEndCommandBuffer(context->cmdBuf));
+
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .commandBufferCount = 1,
-        .pCommandBuffers = &m_transferQueue.immCmdBuf,
+        .pCommandBuffers = &context->cmdBuf,
     };
 
-    VkFenceCreateInfo fence_create_info = {};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    VkFence transferFence;
+    std::lock_guard<std::mutex> lock(m_queueSubmitMutex);
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        // the submission signals the next value of its queue's timeline instead of the context's fence
+        context->timelineValue = family == QueueFamily::Transfer ? ++m_transferQueue.submittedValue
+                                                                 : ++m_transferQueue.graphicsSubmittedValue;
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &context->timelineValue;
+        submitInfo.pNext = &timelineSubmitInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &getTimeline(family);
+    }
+    VK_LOG_ERR(vkQueueSubmit(getQueue(family), 1, &submitInfo, context->fence));
+    return ImmediateToken{context};
+}
 
-    vkCreateFence(m_deviceInfo.device, &fence_create_info, nullptr, &transferFence);
-    vkQueueSubmit(m_transferQueue.transferQueue, 1, &submitInfo, transferFence);
-    vkWaitForFences(m_deviceInfo.device, 1, &transferFence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(m_deviceInfo.device, transferFence, nullptr);
+bool Renderer::isImmediateComplete(ImmediateToken token)
+{
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        return getTimelineValue(getTimeline(token.context->family)) >= token.context->timelineValue;
+    }
+    return vkGetFenceStatus(m_deviceInfo.device, token.context->fence) == VK_SUCCESS;
 }
 
-void Renderer::graphicsImmediate(std::function<void(VkCommandBuffer cmd)> &&function)
+void Renderer::waitImmediate(ImmediateToken token)
 {
-    VkCommandBufferBeginInfo cmdBufBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    ImmediateContext *context = token.context;
+    auto waitStart = std::chrono::steady_clock::now();
+    if (m_deviceInfo.timelineSemaphores)
+    {
+        waitTimeline(getTimeline(context->family), context->timelineValue);
+    }
+    else
+    {
+        VK_LOG_ERR(vkWaitForFences(m_deviceInfo.device, 1, &context->fence, VK_TRUE, UINT64_MAX));
+        VK_LOG_ERR(vkResetFences(m_deviceInfo.device, 1, &context->fence));
+    }
+    double waitMs = getElapsedMs(waitStart);
+    double gpuMs = context->queryPool != VK_NULL_HANDLE ? getTimestampMs(context->queryPool, 0, context->family) : 0.0;
+
+    addUploadCounters(UploadCategory::Immediate, {.submissions = 1, .waitMs = waitMs, .gpuMs = gpuMs});
+    std::lock_guard<std::mutex> lock(m_immediateMutex);
+    m_transferQueue.freeImmediateContexts[static_cast<size_t>(context->family)].push_back(context);
+}
+
+void Renderer::transferImmediate(FunctionRef<void(VkCommandBuffer cmd)> function)
+{
+    waitImmediate(submitImmediate(QueueFamily::Transfer, function));
+}
+
+void Renderer::graphicsImmediate(FunctionRef<void(VkCommandBuffer cmd)> function)
+{
+    waitImmediate(submitImmediate(QueueFamily::Graphics, function));
+}
+
+Handle<Image> Renderer::uploadTextureToGpu(const std::span<uint8_t> &buf, uint32_t width, uint32_t height)
+{
+    TextureUpload texture = {
+        .data = buf,
+        .width = width,
+        .height = height,
     };
-    vkBeginCommandBuffer(m_transferQueue.graphicsCmdBuf, &cmdBufBeginInfo);
-    function(m_transferQueue.graphicsCmdBuf);
-    vkEndCommandBuffer(m_transferQueue.graphicsCmdBuf);
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &m_transferQueue.graphicsCmdBuf,
+    return uploadTexturesToGpu(std::span(&texture, 1)).front();
+}
+
+std::vector<Handle<Image>> Renderer::uploadTexturesToGpu(const std::span<TextureUpload> &textures)
+{
+    std::vector<Handle<Image>> gpuImages;
+    gpuImages.reserve(textures.size());
+    for (const TextureUpload &texture : textures)
+    {
+        gpuImages.push_back(createTexture(texture.width, texture.height));
+    }
+
+    waitForUpload(uploadTexturesToImages(textures, gpuImages));
+    return gpuImages;
+}
+
+Handle<Image> Renderer::createTexture(uint32_t width, uint32_t height)
+{
+    // the mip chain is built with linear blits, which not every format supports
+    VkFormatProperties formatProperties = {};
+    vkGetPhysicalDeviceFormatProperties(m_physDeviceInfo.device, TextureFormat, &formatProperties);
+    constexpr VkFormatFeatureFlags blitFeatures =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    bool blitMips = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+    auto texQueueFamilies = std::to_array({QueueFamily::Graphics, QueueFamily::Transfer});
+    return create(Image::State({
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .width = width,
+        .height = height,
+        .format = TextureFormat,
+        .families = texQueueFamilies,
+        .mipLevels = blitMips ? getMipLevelCount(width, height) : 1,
+    }));
+}
+
+UploadToken Renderer::uploadTexturesToImages(const std::span<TextureUpload> &textures, const std::span<Handle<Image>> &images)
+{
+    UploadToken token = {};
+    std::vector<UploadInfo> batch;
+    std::vector<StagingAllocation> batchStaging;
+    // compressed textures of the batch as (texture, batch) indices, decoded together right before the batch is submitted
+    std::vector<std::pair<size_t, size_t>> batchDecodes;
+    batch.reserve(textures.size());
+    batchStaging.reserve(textures.size());
+
+    UploadCounters counters = {};
+    auto decodeBatch = [&]()
+    {
+        std::vector<double> decodeMs(batchDecodes.size());
+        m_threadPool.parallelFor(batchDecodes.size(),
+                                 [&](size_t i)
+                                 {
+                                     auto decodeStart = std::chrono::steady_clock::now();
+                                     const auto [textureIdx, batchIdx] = batchDecodes[i];
+                                     const StagingAllocation &staging = batchStaging[batchIdx];
+                                     if (!TextureDecoder::DecodeRgba8(textures[textureIdx].encoded, std::span(staging.data, staging.size)))
+                                     {
+                                         memset(staging.data, 0xff, staging.size);
+                                     }
+                                     decodeMs[i] = getElapsedMs(decodeStart);
+                                 });
+        for (double ms : decodeMs)
+        {
+            counters.decodeMs += ms;
+        }
+        batchDecodes.clear();
+    };
+
+    // everything recorded so far is copied in one go, the staging it used is handed back once the copies completed
+    auto flushBatch = [&]()
+    {
+        decodeBatch();
+        std::vector<AllocatedBuffer> dedicatedStaging;
+        for (const StagingAllocation &staging : batchStaging)
+        {
+            if (staging.dedicated.buffer == VK_NULL_HANDLE)
+            {
+                m_stagingRing.flush(staging);
+            }
+            else
+            {
+                dedicatedStaging.push_back(staging.dedicated);
+            }
+        }
+        token = submitImageTransfers(batch, std::move(dedicatedStaging));
+        batch.clear();
+        batchStaging.clear();
     };
 
-    VkFenceCreateInfo fence_create_info = {};
-    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    VkFence transferFence;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        const TextureUpload &texture = textures[i];
+        VkDeviceSize stagingSize = getTextureStagingSize(texture);
+        StagingAllocation staging = texture.staging;
+        if (staging.buffer == VK_NULL_HANDLE && !m_stagingRing.allocate(stagingSize, StagingAlignment, staging))
+        {
+            // the ring can't be reclaimed while our own regions are still unsubmitted, so submit what we have first
+            if (!batch.empty())
+            {
+                flushBatch();
+            }
+            staging = allocateStaging(stagingSize);
+        }
+
+        // textures that went through a decode job are already in their staging memory, held regions of the ring are
+        // handed back with this batch
+        bool decoded = texture.staging.buffer != VK_NULL_HANDLE;
+        if (decoded && staging.dedicated.buffer == VK_NULL_HANDLE)
+        {
+            m_stagingRing.claim(staging);
+        }
+        if (!decoded && texture.encoded.empty())
+        {
+            auto memcpyStart = std::chrono::steady_clock::now();
+            memcpy(staging.data, texture.data.data(), texture.data.size());
+            counters.memcpyMs += getElapsedMs(memcpyStart);
+            counters.bytes += stagingSize;
+        }
+        else if (!decoded)
+        {
+            batchDecodes.push_back({i, batch.size()});
+            counters.bytes += stagingSize;
+        }
+
+        Image *gpuImage = get(images[i]);
+        batchStaging.push_back(staging);
+        batch.push_back({
+            .src = staging.buffer,
+            .dst = gpuImage->m_image,
+            .width = gpuImage->m_width,
+            .height = gpuImage->m_height,
+            .mipLevels = gpuImage->m_mipLevels,
+            .srcOffset = staging.offset,
+        });
+    }
 
-    vkCreateFence(m_deviceInfo.device, &fence_create_info, nullptr, &transferFence);
-    vkQueueSubmit(m_transferQueue.graphicsQueue, 1, &submitInfo, transferFence);
-    vkWaitForFences(m_deviceInfo.device, 1, &transferFence, VK_TRUE, UINT64_MAX);
-    vkDestroyFence(m_deviceInfo.device, transferFence, nullptr);
+    if (!batch.empty())
+    {
+        flushBatch();
+    }
+    addUploadCounters(UploadCategory::Texture, counters);
+    return token;
 }
 
-Handle<Image> Renderer::uploadTextureToGpu(const std::span<uint8_t> &buf, uint32_t width, uint32_t height)
+VkDeviceSize Renderer::getTextureStagingSize(const TextureUpload &texture)
+{
+    if (texture.staging.buffer != VK_NULL_HANDLE)
+    {
+        return texture.staging.size;
+    }
+    return texture.encoded.empty() ? texture.data.size() : TextureDecoder::GetDecodeSize(texture.width, texture.height);
+}
+
+void Renderer::startTextureDecodes()
+{
+    std::vector<UploadableTexture *> pendingDecodes;
+    for (UploadableTexture &transfer : m_transferQueue.textureTransfers)
+    {
+        if (!transfer.encoded.empty() && !transfer.decodeJob)
+        {
+            pendingDecodes.push_back(&transfer);
+        }
+    }
+    std::sort(pendingDecodes.begin(), pendingDecodes.end(),
+              [](const UploadableTexture *lhs, const UploadableTexture *rhs)
+              {
+                  return lhs->priority != rhs->priority ? lhs->priority < rhs->priority : lhs->ticket < rhs->ticket;
+              });
+
+    // decoded texels wait in their staging memory until the scheduler gets to them, which bounds how far ahead of
+    // the uploads decoding may run. An oversized texture is let through when nothing else is being decoded.
+    // Decodes go to the staging ring, which holds their regions until the upload reading them is submitted, and only
+    // get a buffer of their own when the ring has no room for them
+    for (UploadableTexture *transfer : pendingDecodes)
+    {
+        VkDeviceSize size = TextureDecoder::GetDecodeSize(transfer->width, transfer->height);
+        if (m_transferQueue.decodingBytes + size > MaxDecodingBytes && m_transferQueue.decodingBytes != 0)
+        {
+            break;
+        }
+
+        // png unfiltering reads back previous rows, so decode into cached memory like the ring's
+        auto job = std::make_shared<TextureDecodeJob>();
+        if (!m_stagingRing.allocateHeld(size, StagingAlignment, job->staging))
+        {
+            job->staging = createStagingBuffer(size, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+        }
+        m_transferQueue.decodingBytes += size;
+        transfer->decodeJob = job;
+        m_threadPool.submit(
+            [this, job, encoded = transfer->encoded]()
+            {
+                auto decodeStart = std::chrono::steady_clock::now();
+                StagingAllocation &staging = job->staging;
+                if (!TextureDecoder::DecodeRgba8(encoded, std::span(staging.data, staging.size)))
+                {
+                    memset(staging.data, 0xff, staging.size);
+                }
+                if (staging.dedicated.buffer == VK_NULL_HANDLE)
+                {
+                    m_stagingRing.flush(staging);
+                }
+                else
+                {
+                    VK_LOG_ERR(vmaFlushAllocation(m_vmaAllocator, staging.dedicated.allocation, 0, staging.size));
+                }
+                job->decodeMs = getElapsedMs(decodeStart);
+                job->done.store(true, std::memory_order_release);
+                job->done.notify_all();
+            });
+    }
+}
+
+Renderer::TextureUpload Renderer::takeDecodedTexture(UploadableTexture &transfer)
+{
+    TextureUpload texture = {
+        .data = transfer.data,
+        .encoded = transfer.encoded,
+        .width = transfer.width,
+        .height = transfer.height,
+    };
+    if (!transfer.decodeJob)
+    {
+        return texture;
+    }
+
+    TextureDecodeJob &job = *transfer.decodeJob;
+    job.done.wait(false, std::memory_order_acquire);
+    texture.encoded = {};
+    texture.staging = job.staging;
+
+    addUploadCounters(UploadCategory::Texture, {.bytes = job.staging.size, .decodeMs = job.decodeMs});
+    m_transferQueue.decodingBytes -= job.staging.size;
+    transfer.decodeJob.reset();
+    return texture;
+}
+
+UploadTicket Renderer::requestBufferUpload(const std::span<const uint8_t> &src, Handle<Buffer> dst, VkDeviceSize dstOffset, float priority)
 {
-    auto bufQueueFamilies = std::to_array({QueueFamily::Transfer});
-    Handle<Buffer> stagingBufferHandle = create({
-        .size = static_cast<uint32_t>(buf.size()),
-        .usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-        .families = bufQueueFamilies,
-        .vmaFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    std::lock_guard<std::mutex> lock(m_uploadRequestMutex);
+    UploadTicket ticket = {++m_transferQueue.lastTicket};
+    m_transferQueue.requestedTransfers.push_back({
+        .src = src,
+        .dst = dst,
+        .dstOffset = dstOffset,
+        .priority = priority,
+        .ticket = ticket.id,
     });
-    Buffer &stagingBuffer = *get(stagingBufferHandle);
-    memcpy(stagingBuffer.m_allocationInfo.pMappedData, buf.data(), buf.size());
+    return ticket;
+}
 
-    auto texQueueFamilies = std::to_array({QueueFamily::Graphics, QueueFamily::Transfer});
-    Handle<Image> gpuImage
-        = uploadImageToGpu(stagingBuffer.m_buffer, Image::State({
-                                                       .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-                                                       .width = width,
-                                                       .height = height,
-                                                       .format = VK_FORMAT_R8G8B8A8_UNORM,
-                                                       .families = texQueueFamilies,
-                                                   }));
+UploadTicket Renderer::requestCompressedBufferUpload(const std::span<const uint8_t> &compressed, Handle<Buffer> dst, VkDeviceSize dstOffset,
+                                                    float priority)
+{
+    std::lock_guard<std::mutex> lock(m_uploadRequestMutex);
+    UploadTicket ticket = {++m_transferQueue.lastTicket};
+    m_transferQueue.requestedTransfers.push_back({
+        .src = compressed,
+        .dst = dst,
+        .dstOffset = dstOffset,
+        .priority = priority,
+        .ticket = ticket.id,
+        .compressed = true,
+    });
+    return ticket;
+}
 
-    destroy(stagingBufferHandle);
-    return gpuImage;
+UploadTicket Renderer::requestTextureUpload(const TextureUpload &texture, Handle<Image> &dst, float priority)
+{
+    dst = createTexture(texture.width, texture.height);
+    std::lock_guard<std::mutex> lock(m_uploadRequestMutex);
+    UploadTicket ticket = {++m_transferQueue.lastTicket};
+    m_transferQueue.requestedTextureTransfers.push_back({
+        .data = texture.data,
+        .encoded = texture.encoded,
+        .width = texture.width,
+        .height = texture.height,
+        .dst = dst,
+        .priority = priority,
+        .ticket = ticket.id,
+    });
+    return ticket;
 }
 
-Handle<Buffer> Renderer::uploadCpuBufferToGpu(const std::span<uint8_t> &buf, VkBufferUsageFlags usage)
+UploadTicket Renderer::acquireTexture(uint64_t contentHash, const TextureUpload &texture, Handle<Image> &dst, float priority)
 {
-    VkBufferCreateInfo stagingBufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
-    stagingBufferInfo.size = buf.size();
-    stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    stagingBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    std::lock_guard<std::mutex> lock(m_textureCacheMutex);
+    CachedTexture &cached = m_textureCache[contentHash];
+    // the hash only covers the contents, a different size means a different image that happens to share it
+    if (cached.refCount > 0 && (cached.width != texture.width || cached.height != texture.height))
+    {
+        UploadTicket ticket = requestTextureUpload(texture, dst, priority);
+        m_privateTextures[ticket.id] = dst;
+        return ticket;
+    }
+    if (cached.refCount++ == 0)
+    {
+        cached.ticket = requestTextureUpload(texture, cached.image, priority);
+        cached.width = texture.width;
+        cached.height = texture.height;
+    }
+    dst = cached.image;
+    return cached.ticket;
+}
 
-    auto queueFamilyIndices = std::to_array({m_deviceInfo.graphicsQueueFamily, m_deviceInfo.transferQueueFamily});
-    stagingBufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
-    stagingBufferInfo.queueFamilyIndexCount = queueFamilyIndices.size();
+void Renderer::releaseTexture(uint64_t contentHash, UploadTicket ticket)
+{
+    std::lock_guard<std::mutex> lock(m_textureCacheMutex);
+    if (auto privateIt = m_privateTextures.find(ticket.id); privateIt != m_privateTextures.end())
+    {
+        cancelUpload(ticket);
+        destroy(privateIt->second);
+        m_privateTextures.erase(privateIt);
+        return;
+    }
+    auto it = m_textureCache.find(contentHash);
+    if (it == m_textureCache.end())
+    {
+        return;
+    }
 
-    VmaAllocationCreateInfo vmaStagingBufAllocInfo = {};
-    vmaStagingBufAllocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-    vmaStagingBufAllocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    // the pending upload may read from the source of the reference being released while others still use the image
+    CachedTexture &cached = it->second;
+    if (--cached.refCount > 0)
+    {
+        waitForUpload(cached.ticket);
+        return;
+    }
+    cancelUpload(cached.ticket);
+    destroy(cached.image);
+    m_textureCache.erase(it);
+}
 
-    VkBuffer stagingBuf;
-    VmaAllocation stagingAlloc;
-    VmaAllocationInfo stagingAllocInfo;
-    VK_LOG_ERR(vmaCreateBuffer(m_vmaAllocator, &stagingBufferInfo, &vmaStagingBufAllocInfo, &stagingBuf, &stagingAlloc, &stagingAllocInfo));
-    memcpy(stagingAllocInfo.pMappedData, buf.data(), stagingBufferInfo.size);
+void Renderer::takeRequestedUploads()
+{
+    std::lock_guard<std::mutex> lock(m_uploadRequestMutex);
+    for (UploadableBuffer &transfer : m_transferQueue.requestedTransfers)
+    {
+        m_transferQueue.ticketTokens[transfer.ticket] = PendingUploadToken;
+        m_transferQueue.transfers.push_back(std::move(transfer));
+    }
+    for (UploadableTexture &transfer : m_transferQueue.requestedTextureTransfers)
+    {
+        m_transferQueue.ticketTokens[transfer.ticket] = PendingUploadToken;
+        m_transferQueue.textureTransfers.push_back(std::move(transfer));
+    }
+    m_transferQueue.requestedTransfers.clear();
+    m_transferQueue.requestedTextureTransfers.clear();
+}
 
-    auto queueFamilies = std::to_array({QueueFamily::Graphics, QueueFamily::Transfer});
-    usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    Handle<Buffer> gpuBuffer = uploadBufferToGpu(stagingBuf, Buffer::State{
-                                                                 .size = static_cast<uint32_t>(stagingBufferInfo.size),
-                                                                 .usage = usage,
-                                                                 .families = queueFamilies,
-                                                             });
-
-    vmaDestroyBuffer(m_vmaAllocator, stagingBuf, stagingAlloc);
+void Renderer::setUploadPriority(UploadTicket ticket, float priority)
+{
+    takeRequestedUploads();
+    for (UploadableBuffer &transfer : m_transferQueue.transfers)
+    {
+        if (transfer.ticket == ticket.id)
+        {
+            transfer.priority = priority;
+            return;
+        }
+    }
+    for (UploadableTexture &transfer : m_transferQueue.textureTransfers)
+    {
+        if (transfer.ticket == ticket.id)
+        {
+            transfer.priority = priority;
+            return;
+        }
+    }
+}
+
+void Renderer::setUploadBudget(const UploadBudget &budget)
+{
+    m_uploadBudget = budget;
+}
+
+bool Renderer::isUploadComplete(UploadTicket ticket)
+{
+    takeRequestedUploads();
+    auto it = m_transferQueue.ticketTokens.find(ticket.id);
+    if (it == m_transferQueue.ticketTokens.end())
+    {
+        return true;
+    }
+    if (it->second.value == PendingUploadToken.value || !isUploadComplete(it->second))
+    {
+        return false;
+    }
+
+    m_transferQueue.ticketTokens.erase(it);
+    return true;
+}
+
+void Renderer::waitForUpload(UploadTicket ticket)
+{
+    takeRequestedUploads();
+    auto it = m_transferQueue.ticketTokens.find(ticket.id);
+    if (it == m_transferQueue.ticketTokens.end())
+    {
+        return;
+    }
+
+    // requests that haven't been scheduled yet skip the queue and go out right away, ignoring the budget
+    if (it->second.value == PendingUploadToken.value)
+    {
+        std::vector<UploadableBuffer> &transfers = m_transferQueue.transfers;
+        auto bufferIt = std::find_if(transfers.begin(), transfers.end(),
+                                     [&](const UploadableBuffer &transfer)
+                                     {
+                                         return transfer.ticket == ticket.id;
+                                     });
+        if (bufferIt != transfers.end() && bufferIt->compressed)
+        {
+            // not worth a decompression dispatch of its own
+            it->second = expandToBufferAsync(bufferIt->src, bufferIt->dst, bufferIt->dstOffset);
+            transfers.erase(bufferIt);
+        }
+        else if (bufferIt != transfers.end())
+        {
+            it->second =
+                uploadToBufferAsync(bufferIt->src.subspan(bufferIt->uploaded), bufferIt->dst, bufferIt->dstOffset + bufferIt->uploaded);
+            transfers.erase(bufferIt);
+        }
+
+        std::vector<UploadableTexture> &textureTransfers = m_transferQueue.textureTransfers;
+        auto textureIt = std::find_if(textureTransfers.begin(), textureTransfers.end(),
+                                      [&](const UploadableTexture &transfer)
+                                      {
+                                          return transfer.ticket == ticket.id;
+                                      });
+        if (textureIt != textureTransfers.end())
+        {
+            TextureUpload texture = takeDecodedTexture(*textureIt);
+            it->second = uploadTexturesToImages(std::span(&texture, 1), std::span(&textureIt->dst, 1));
+            textureTransfers.erase(textureIt);
+        }
+    }
+
+    waitForUpload(it->second);
+    m_transferQueue.ticketTokens.erase(it);
+}
+
+void Renderer::cancelUpload(UploadTicket ticket)
+{
+    takeRequestedUploads();
+    auto it = m_transferQueue.ticketTokens.find(ticket.id);
+    if (it == m_transferQueue.ticketTokens.end())
+    {
+        return;
+    }
+
+    // submitted copies still write to the destination, so they have to finish before it can be destroyed
+    UploadToken token = it->second;
+    m_transferQueue.ticketTokens.erase(it);
+    if (token.value != PendingUploadToken.value)
+    {
+        waitForUpload(token);
+        return;
+    }
+
+    std::vector<UploadableBuffer> &transfers = m_transferQueue.transfers;
+    auto bufferIt = std::find_if(transfers.begin(), transfers.end(),
+                                 [&](const UploadableBuffer &transfer)
+                                 {
+                                     return transfer.ticket == ticket.id;
+                                 });
+    if (bufferIt != transfers.end())
+    {
+        // the chunks a buffer spread over several frames has uploaded so far aren't tracked by a token of their own
+        if (bufferIt->uploaded > 0 && !m_transferQueue.inFlight.empty())
+        {
+            waitForUpload(UploadToken{m_transferQueue.inFlight.back().value});
+        }
+        transfers.erase(bufferIt);
+    }
+
+    std::vector<UploadableTexture> &textureTransfers = m_transferQueue.textureTransfers;
+    auto textureIt = std::find_if(textureTransfers.begin(), textureTransfers.end(),
+                                  [&](const UploadableTexture &transfer)
+                                  {
+                                      return transfer.ticket == ticket.id;
+                                  });
+    if (textureIt != textureTransfers.end())
+    {
+        // a running decode writes to its staging memory until it's done
+        if (textureIt->decodeJob)
+        {
+            TextureUpload texture = takeDecodedTexture(*textureIt);
+            if (texture.staging.dedicated.buffer == VK_NULL_HANDLE)
+            {
+                m_stagingRing.claim(texture.staging);
+            }
+            else
+            {
+                vmaDestroyBuffer(m_vmaAllocator, texture.staging.dedicated.buffer, texture.staging.dedicated.allocation);
+            }
+        }
+        textureTransfers.erase(textureIt);
+    }
+}
+
+void Renderer::createDecompressPipeline()
+{
+    Shader decompressShader(CONCAT(SHADER_PATH, "lzDecompress.comp.spv"), Shader::Stage::Compute);
+    m_decompressPipeline = ComputePipeline({
+        .pipelineLayoutState{
+            .descSetLayouts = {{
+                VkInit::CreateEmptyVkDescriptorSetLayout(),
+                VkInit::CreateVkDescriptorSetLayout({{
+                    VkInit::CreateVkDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+                    VkInit::CreateVkDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+                }}),
+                VkInit::CreateEmptyVkDescriptorSetLayout(),
+                VkInit::CreateEmptyVkDescriptorSetLayout(),
+            }},
+            .pushConstantRanges = {{
+                {.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(DecompressPushConstants)},
+            }},
+        },
+        .CS = decompressShader,
+    });
+}
+
+// VK_NULL_HANDLE unless dst is one of the geometry buffers and the device can bind it and the staging ring whole
+VkDescriptorSet Renderer::getDecompressDescriptorSet(VkBuffer dst)
+{
+    VkDeviceSize maxRange = m_physDeviceInfo.deviceProperties.limits.maxStorageBufferRange;
+    std::lock_guard<std::mutex> lock(m_geometryMutex);
+    for (size_t i = 0; i < m_geometryBuffers.buffers.size(); i++)
+    {
+        Buffer *geometryBuffer = m_geometryBuffers.blocks[i] != VK_NULL_HANDLE ? get(m_geometryBuffers.buffers[i]) : nullptr;
+        if (!geometryBuffer || geometryBuffer->m_buffer != dst || geometryBuffer->m_size > maxRange || StagingRingSize > maxRange)
+        {
+            continue;
+        }
+
+        if (m_decompressDescriptorSets[i] == VK_NULL_HANDLE)
+        {
+            if (m_decompressPipeline.m_pipeline == VK_NULL_HANDLE)
+            {
+                createDecompressPipeline();
+            }
+            m_decompressDescriptorSets[i] = allocateDescriptorSet(m_decompressPipeline.m_descriptorSetLayouts[DSL_FREQ_PER_PASS]);
+
+            auto bufferInfos = std::to_array<VkDescriptorBufferInfo>({
+                {.buffer = m_stagingRing.buffer(), .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = dst, .offset = 0, .range = VK_WHOLE_SIZE},
+            });
+            VkWriteDescriptorSet descriptorWrite = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            descriptorWrite.dstSet = m_decompressDescriptorSets[i];
+            descriptorWrite.dstBinding = 0;
+            descriptorWrite.descriptorCount = static_cast<uint32_t>(bufferInfos.size());
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.pBufferInfo = bufferInfos.data();
+            vkUpdateDescriptorSets(m_deviceInfo.device, 1, &descriptorWrite, 0, nullptr);
+        }
+        return m_decompressDescriptorSets[i];
+    }
+    return VK_NULL_HANDLE;
+}
+
+// Compressed payloads are staged whole. The ones expanded on the GPU are added to dispatches, the others are expanded on
+// the CPU, into host visible destinations directly or into staging copied from with cmdBuf. False if the staging ring
+// has no room left for the payload
+bool Renderer::stageCompressedUpload(const UploadableBuffer &transfer, VkCommandBuffer &cmdBuf, std::vector<DecompressDispatch> &dispatches,
+                                     UploadCounters &counters)
+{
+    // a payload that doesn't expand leaves the destination as it is, like a texture that fails to decode
+    LzCodec::Header header;
+    if (!LzCodec::ReadHeader(transfer.src, header) || header.uncompressedSize == 0)
+    {
+        return true;
+    }
+
+    Buffer *dstBuffer = get(transfer.dst);
+    auto memcpyStart = std::chrono::steady_clock::now();
+    if (uint8_t *hostPtr = getHostPointer(*dstBuffer))
+    {
+        if (LzCodec::Decompress(transfer.src, std::span(hostPtr + transfer.dstOffset, header.uncompressedSize)))
+        {
+            VK_LOG_ERR(vmaFlushAllocation(m_vmaAllocator, dstBuffer->m_allocation, transfer.dstOffset, header.uncompressedSize));
+        }
+        counters.memcpyMs += getElapsedMs(memcpyStart);
+        counters.bytes += header.uncompressedSize;
+        return true;
+    }
+
+    // the shader writes whole words, which only stays within the destination range from a word aligned offset
+    VkDescriptorSet descriptorSet = transfer.dstOffset % 4 == 0 ? getDecompressDescriptorSet(dstBuffer->m_buffer) : VK_NULL_HANDLE;
+    StagingAllocation staging = {};
+    VkDeviceSize stagingSize = descriptorSet != VK_NULL_HANDLE ? transfer.src.size() : header.uncompressedSize;
+    if (!m_stagingRing.allocate(stagingSize, StagingAlignment, staging))
+    {
+        return false;
+    }
+
+    if (descriptorSet != VK_NULL_HANDLE)
+    {
+        memcpy(staging.data, transfer.src.data(), transfer.src.size());
+        dispatches.push_back({
+            .descriptorSet = descriptorSet,
+            .pushConstants{
+                .numBlocks = header.numBlocks,
+                .blockSize = header.blockSize,
+                .uncompressedSize = header.uncompressedSize,
+                .blockDataOffset = static_cast<uint32_t>(LzCodec::GetBlockDataOffset(header)),
+                .srcOffset = static_cast<uint32_t>(staging.offset),
+                .dstOffset = static_cast<uint32_t>(transfer.dstOffset),
+            },
+        });
+    }
+    else if (LzCodec::Decompress(transfer.src, std::span(staging.data, staging.size)))
+    {
+        if (cmdBuf == VK_NULL_HANDLE)
+        {
+            cmdBuf = beginTransferCommands();
+        }
+        VkBufferCopy copyInfo = {
+            .srcOffset = staging.offset,
+            .dstOffset = transfer.dstOffset,
+            .size = staging.size,
+        };
+        vkCmdCopyBuffer(cmdBuf, staging.buffer, dstBuffer->m_buffer, 1, &copyInfo);
+    }
+    m_stagingRing.flush(staging);
+    counters.memcpyMs += getElapsedMs(memcpyStart);
+    counters.bytes += staging.size;
+    return true;
+}
+
+// The payloads were written to the staging ring by the host, so the transfer submission only carries the frame's buffer
+// copies. The graphics submission expands the payloads into the geometry buffers
+UploadToken Renderer::submitDecompression(VkCommandBuffer cmdBuf, const std::span<const DecompressDispatch> &dispatches)
+{
+    return submitGraphicsHandoff(
+        cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, UploadCategory::Buffer,
+        [&](VkCommandBuffer graphicsCmdBuf)
+        {
+            vkCmdBindPipeline(graphicsCmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_decompressPipeline.m_pipeline);
+            for (const DecompressDispatch &dispatch : dispatches)
+            {
+                vkCmdBindDescriptorSets(graphicsCmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_decompressPipeline.m_pipelineLayout,
+                                        DSL_FREQ_PER_PASS, 1, &dispatch.descriptorSet, 0, nullptr);
+                vkCmdPushConstants(graphicsCmdBuf, m_decompressPipeline.m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   sizeof(DecompressPushConstants), &dispatch.pushConstants);
+                // matches the local size of the shader
+                vkCmdDispatch(graphicsCmdBuf, (dispatch.pushConstants.numBlocks + 63) / 64, 1, 1);
+            }
+
+            // the draws of later frames read the expanded vertices and indices
+            VkMemoryBarrier memoryBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+            memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            vkCmdPipelineBarrier(graphicsCmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1,
+                                 &memoryBarrier, 0, nullptr, 0, nullptr);
+        },
+        {});
+}
+
+// Expanded on the CPU and uploaded like any buffer, for the compressed payloads that can't wait for the compute path
+UploadToken Renderer::expandToBufferAsync(const std::span<const uint8_t> &compressed, Handle<Buffer> dst, VkDeviceSize dstOffset)
+{
+    LzCodec::Header header;
+    std::vector<uint8_t> expanded;
+    if (LzCodec::ReadHeader(compressed, header))
+    {
+        expanded.resize(header.uncompressedSize);
+    }
+    if (expanded.empty() || !LzCodec::Decompress(compressed, expanded))
+    {
+        return UploadToken{};
+    }
+    return uploadToBufferAsync(expanded, dst, dstOffset);
+}
+
+void Renderer::processUploads()
+{
+    takeRequestedUploads();
+    std::vector<UploadableBuffer> &transfers = m_transferQueue.transfers;
+    std::vector<UploadableTexture> &textureTransfers = m_transferQueue.textureTransfers;
+    if (transfers.empty() && textureTransfers.empty())
+    {
+        return;
+    }
+
+    // decoding runs on the thread pool and isn't part of the frame's budget
+    startTextureDecodes();
+
+    auto start = std::chrono::steady_clock::now();
+    auto withinTimeBudget = [&]()
+    {
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() < m_uploadBudget.maxMillisecondsPerFrame;
+    };
+
+    // lower priority values go first, requests of equal priority in the order they were made
+    struct PendingUpload
+    {
+        float priority;
+        uint64_t ticket;
+        bool isTexture;
+        size_t idx;
+    };
+    std::vector<PendingUpload> pendingUploads;
+    pendingUploads.reserve(transfers.size() + textureTransfers.size());
+    for (size_t i = 0; i < transfers.size(); i++)
+    {
+        pendingUploads.push_back({transfers[i].priority, transfers[i].ticket, false, i});
+    }
+    for (size_t i = 0; i < textureTransfers.size(); i++)
+    {
+        pendingUploads.push_back({textureTransfers[i].priority, textureTransfers[i].ticket, true, i});
+    }
+    std::sort(pendingUploads.begin(), pendingUploads.end(),
+              [](const PendingUpload &lhs, const PendingUpload &rhs)
+              {
+                  return lhs.priority != rhs.priority ? lhs.priority < rhs.priority : lhs.ticket < rhs.ticket;
+              });
+
+    VkDeviceSize bytesLeft = m_uploadBudget.maxBytesPerFrame;
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    std::vector<uint64_t> finishedBufferTickets;
+    std::vector<TextureUpload> textureBatch;
+    std::vector<Handle<Image>> textureBatchImages;
+    std::vector<uint64_t> textureBatchTickets;
+    std::vector<DecompressDispatch> decompressDispatches;
+    bool stagingFull = false;
+    UploadCounters bufferCounters = {};
+
+    for (const PendingUpload &pending : pendingUploads)
+    {
+        if (bytesLeft == 0 || stagingFull || !withinTimeBudget())
+        {
+            break;
+        }
+
+        if (pending.isTexture)
+        {
+            // compressed textures are picked up as their decode finishes, regardless of the order they were requested in
+            UploadableTexture &transfer = textureTransfers[pending.idx];
+            bool decoded = transfer.decodeJob && transfer.decodeJob->done.load(std::memory_order_acquire);
+            if (!transfer.encoded.empty() && !decoded)
+            {
+                continue;
+            }
+
+            // textures aren't split across frames, an oversized one is still let through on a frame that hasn't
+            // uploaded anything yet so it can't stall the queue forever
+            VkDeviceSize size = decoded ? transfer.decodeJob->staging.size : transfer.data.size();
+            if (size > bytesLeft && bytesLeft != m_uploadBudget.maxBytesPerFrame)
+            {
+                break;
+            }
+
+            TextureUpload texture = takeDecodedTexture(transfer);
+            bytesLeft -= std::min(size, bytesLeft);
+            transfer.scheduled = true;
+            textureBatch.push_back(texture);
+            textureBatchImages.push_back(transfer.dst);
+            textureBatchTickets.push_back(transfer.ticket);
+            continue;
+        }
+
+        UploadableBuffer &transfer = transfers[pending.idx];
+        if (transfer.compressed)
+        {
+            // compressed payloads go whole, like textures an oversized one only on a frame that hasn't uploaded anything yet
+            if (transfer.src.size() > bytesLeft && bytesLeft != m_uploadBudget.maxBytesPerFrame)
+            {
+                break;
+            }
+            // one the staging ring can't hold compressed or expanded would never be staged, it gets a staging buffer of
+            // its own instead
+            LzCodec::Header header;
+            if (LzCodec::ReadHeader(transfer.src, header)
+                && std::max<VkDeviceSize>(transfer.src.size(), header.uncompressedSize) > StagingRingSize)
+            {
+                m_transferQueue.ticketTokens[transfer.ticket] = expandToBufferAsync(transfer.src, transfer.dst, transfer.dstOffset);
+                bytesLeft -= std::min<VkDeviceSize>(transfer.src.size(), bytesLeft);
+                transfer.uploaded = transfer.src.size();
+                continue;
+            }
+            if (!stageCompressedUpload(transfer, cmdBuf, decompressDispatches, bufferCounters))
+            {
+                stagingFull = true;
+                break;
+            }
+            bytesLeft -= std::min<VkDeviceSize>(transfer.src.size(), bytesLeft);
+            transfer.uploaded = transfer.src.size();
+            finishedBufferTickets.push_back(transfer.ticket);
+            continue;
+        }
+
+        // buffers are uploaded in chunks so that a large one can be spread over several frames
+        Buffer *dstBuffer = get(transfer.dst);
+        uint8_t *hostPtr = getHostPointer(*dstBuffer);
+        while (transfer.uploaded < transfer.src.size() && bytesLeft > 0)
+        {
+            VkDeviceSize remaining = transfer.src.size() - transfer.uploaded;
+            VkDeviceSize chunkSize = std::min({remaining, bytesLeft, MaxUploadChunkSize});
+            VkDeviceSize dstOffset = transfer.dstOffset + transfer.uploaded;
+            auto memcpyStart = std::chrono::steady_clock::now();
+            if (hostPtr)
+            {
+                memcpy(hostPtr + dstOffset, transfer.src.data() + transfer.uploaded, chunkSize);
+                VK_LOG_ERR(vmaFlushAllocation(m_vmaAllocator, dstBuffer->m_allocation, dstOffset, chunkSize));
+                bufferCounters.memcpyMs += getElapsedMs(memcpyStart);
+            }
+            else
+            {
+                StagingAllocation staging = {};
+                if (!m_stagingRing.allocate(chunkSize, StagingAlignment, staging))
+                {
+                    stagingFull = true;
+                    break;
+                }
+                memcpy(staging.data, transfer.src.data() + transfer.uploaded, chunkSize);
+                m_stagingRing.flush(staging);
+                bufferCounters.memcpyMs += getElapsedMs(memcpyStart);
+
+                if (cmdBuf == VK_NULL_HANDLE)
+                {
+                    cmdBuf = beginTransferCommands();
+                }
+                VkBufferCopy copyInfo = {
+                    .srcOffset = staging.offset,
+                    .dstOffset = dstOffset,
+                    .size = chunkSize,
+                };
+                vkCmdCopyBuffer(cmdBuf, staging.buffer, dstBuffer->m_buffer, 1, &copyInfo);
+            }
+
+            transfer.uploaded += chunkSize;
+            bytesLeft -= chunkSize;
+            bufferCounters.bytes += chunkSize;
+        }
+
+        if (transfer.uploaded == transfer.src.size())
+        {
+            finishedBufferTickets.push_back(transfer.ticket);
+        }
+    }
+
+    addUploadCounters(UploadCategory::Buffer, bufferCounters);
+
+    // buffer copies have to be submitted before the texture batch, which hands back every staging region allocated so far
+    UploadToken bufferToken = {};
+    if (!decompressDispatches.empty())
+    {
+        bufferToken = submitDecompression(cmdBuf != VK_NULL_HANDLE ? cmdBuf : beginTransferCommands(), decompressDispatches);
+    }
+    else if (cmdBuf != VK_NULL_HANDLE)
+    {
+        bufferToken = submitTransferCommands(cmdBuf, {});
+    }
+    for (uint64_t ticket : finishedBufferTickets)
+    {
+        m_transferQueue.ticketTokens[ticket] = bufferToken;
+    }
+
+    // the texture batch is only submitted here, its copies and mip chains complete frames later like the buffers
+    if (!textureBatch.empty())
+    {
+        UploadToken textureToken = uploadTexturesToImages(textureBatch, textureBatchImages);
+        for (uint64_t ticket : textureBatchTickets)
+        {
+            m_transferQueue.ticketTokens[ticket] = textureToken;
+        }
+    }
+
+    std::erase_if(transfers,
+                  [](const UploadableBuffer &transfer)
+                  {
+                      return transfer.uploaded == transfer.src.size();
+                  });
+    std::erase_if(textureTransfers,
+                  [](const UploadableTexture &transfer)
+                  {
+                      return transfer.scheduled;
+                  });
+}
+
+Handle<Buffer> Renderer::uploadCpuBufferToGpu(const std::span<uint8_t> &buf, VkBufferUsageFlags usage)
+{
+    UploadToken token;
+    Handle<Buffer> gpuBuffer = uploadCpuBufferToGpuAsync(buf, usage, token);
+    waitForUpload(token);
     return gpuBuffer;
 }
 
@@ -1241,7 +3007,19 @@ Renderer::~Renderer()
         vkDestroyDescriptorPool(getDevice(), m_imguiDescriptorPool, nullptr);
     }
 
+    if (m_frameCapture)
+    {
+        wait();
+        m_frameCapture->collectAll();
+        m_frameCapture.reset();
+    }
+    if (m_decompressPipeline.m_pipeline != VK_NULL_HANDLE)
+    {
+        m_decompressPipeline.freeResources();
+    }
     destroyTransferQueue();
+    destroyGeometryBuffers();
+    m_stagingRing.destroy();
     destroyRenderContext();
     destroyDescriptorPools();
     freeSwapchainImages();
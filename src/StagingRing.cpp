@@ -0,0 +1,145 @@
+#include "StagingRing.h"
+#include "Common.h"
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    [[nodiscard]] inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+} // namespace
+
+StagingRing::StagingRing(VmaAllocator allocator, VkDeviceSize capacity, const std::span<const uint32_t> &queueFamilyIndices)
+    : m_allocator(allocator)
+    , m_capacity(capacity)
+{
+    VkBufferCreateInfo bufferCreateInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferCreateInfo.size = capacity;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    bufferCreateInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    bufferCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+    bufferCreateInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+
+    VmaAllocationCreateInfo allocationCreateInfo = {};
+    allocationCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    // textures are decoded in place and the png unfilter reads back previous rows, which is very slow from
+    // write combined memory, so ask for cached memory instead
+    allocationCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocationInfo = {};
+    VK_LOG_ERR_FATAL(vmaCreateBuffer(m_allocator, &bufferCreateInfo, &allocationCreateInfo, &m_buffer, &m_allocation, &allocationInfo));
+    m_mappedData = static_cast<uint8_t *>(allocationInfo.pMappedData);
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation &allocation)
+{
+    if (size > m_capacity)
+    {
+        return false;
+    }
+
+    uint64_t begin = alignUp(m_head, alignment);
+    // regions never wrap around the end of the buffer, skip ahead to the start instead
+    if (begin % m_capacity + size > m_capacity)
+    {
+        begin = alignUp(begin, m_capacity);
+    }
+    if (begin + size - m_tail > m_capacity)
+    {
+        return false;
+    }
+
+    m_head = begin + size;
+    allocation = {
+        .buffer = m_buffer,
+        .offset = begin % m_capacity,
+        .size = size,
+        .data = m_mappedData + begin % m_capacity,
+    };
+    return true;
+}
+
+bool StagingRing::allocateHeld(VkDeviceSize size, VkDeviceSize alignment, StagingAllocation &allocation)
+{
+    uint64_t head = m_head;
+    if (!allocate(size, alignment, allocation))
+    {
+        return false;
+    }
+
+    // the regions allocated before still go with the next release
+    if (m_releasedHead != head)
+    {
+        m_regions.push_back({Unreleased, head});
+    }
+    m_regions.push_back({Held, m_head});
+    m_releasedHead = m_head;
+    return true;
+}
+
+void StagingRing::claim(const StagingAllocation &allocation)
+{
+    for (Region &region : m_regions)
+    {
+        if (region.submissionValue == Held && (region.end - allocation.size) % m_capacity == allocation.offset)
+        {
+            region.submissionValue = Unreleased;
+            return;
+        }
+    }
+    assert(false && "Claiming an allocation that isn't held!");
+}
+
+void StagingRing::flush(const StagingAllocation &allocation)
+{
+    assert(allocation.buffer == m_buffer && "Flushing an allocation that doesn't belong to the staging ring!");
+    VK_LOG_ERR(vmaFlushAllocation(m_allocator, m_allocation, allocation.offset, allocation.size));
+}
+
+void StagingRing::release(uint64_t submissionValue)
+{
+    for (Region &region : m_regions)
+    {
+        if (region.submissionValue == Unreleased)
+        {
+            region.submissionValue = submissionValue;
+        }
+    }
+    if (m_releasedHead == m_head)
+    {
+        return;
+    }
+
+    m_regions.push_back({submissionValue, m_head});
+    m_releasedHead = m_head;
+}
+
+void StagingRing::retire(uint64_t completedValue)
+{
+    while (!m_regions.empty() && m_regions.front().submissionValue <= completedValue)
+    {
+        m_tail = m_regions.front().end;
+        m_regions.pop_front();
+    }
+}
+
+VkDeviceSize StagingRing::capacity()
+{
+    return m_capacity;
+}
+
+VkBuffer StagingRing::buffer()
+{
+    return m_buffer;
+}
+
+void StagingRing::destroy()
+{
+    if (m_buffer != VK_NULL_HANDLE)
+    {
+        vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+        m_buffer = VK_NULL_HANDLE;
+    }
+}
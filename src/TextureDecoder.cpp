@@ -0,0 +1,137 @@
+#include "TextureDecoder.h"
+#include "LzCodec.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // The memory the next output sized allocation of the current decode is served from. stb_image only ever
+    // allocates its output buffer with malloc, so the allocator hooks below hand out the caller's memory for the
+    // first request matching the decoded image size instead of the heap.
+    struct DecodeTarget
+    {
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        size_t outputSize = 0;
+        bool inUse = false;
+    };
+    thread_local DecodeTarget t_decodeTarget;
+
+    [[nodiscard]] bool isTarget(void *ptr)
+    {
+        return ptr != nullptr && ptr == t_decodeTarget.data;
+    }
+
+    void *decoderMalloc(size_t size)
+    {
+        DecodeTarget &target = t_decodeTarget;
+        if (target.data && !target.inUse && (size == target.outputSize || size == target.outputSize + 1) && size <= target.size)
+        {
+            target.inUse = true;
+            return target.data;
+        }
+        return malloc(size);
+    }
+
+    void decoderFree(void *ptr)
+    {
+        if (isTarget(ptr))
+        {
+            t_decodeTarget.inUse = false;
+            return;
+        }
+        free(ptr);
+    }
+
+    void *decoderRealloc(void *ptr, size_t oldSize, size_t newSize)
+    {
+        if (!isTarget(ptr))
+        {
+            return realloc(ptr, newSize);
+        }
+
+        if (newSize <= t_decodeTarget.size)
+        {
+            return ptr;
+        }
+
+        // only intermediate buffers grow, move it off the target so that the output can still land there
+        void *grown = malloc(newSize);
+        if (grown)
+        {
+            memcpy(grown, ptr, oldSize);
+            t_decodeTarget.inUse = false;
+        }
+        return grown;
+    }
+} // namespace
+
+#define STBI_MALLOC(sz) decoderMalloc(sz)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) decoderRealloc(p, oldsz, newsz)
+#define STBI_FREE(p) decoderFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+bool TextureDecoder::ReadInfo(const std::span<const uint8_t> &encoded, uint32_t &width, uint32_t &height)
+{
+    int x = 0;
+    int y = 0;
+    int numComponents = 0;
+    if (!stbi_info_from_memory(encoded.data(), encoded.size(), &x, &y, &numComponents))
+    {
+        std::cerr << "Failed to read image header: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    width = static_cast<uint32_t>(x);
+    height = static_cast<uint32_t>(y);
+    return true;
+}
+
+size_t TextureDecoder::GetDecodeSize(uint32_t width, uint32_t height)
+{
+    return static_cast<size_t>(width) * height * NumComponents + 1;
+}
+
+bool TextureDecoder::DecodeRgba8(const std::span<const uint8_t> &encoded, const std::span<uint8_t> &dst)
+{
+    // texels cooked by the mesh cache are already RGBA8, only compressed
+    if (LzCodec::IsCompressed(encoded))
+    {
+        return LzCodec::Decompress(encoded, dst);
+    }
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    if (!ReadInfo(encoded, width, height) || dst.size() < GetDecodeSize(width, height))
+    {
+        return false;
+    }
+
+    t_decodeTarget = {
+        .data = dst.data(),
+        .size = dst.size(),
+        .outputSize = static_cast<size_t>(width) * height * NumComponents,
+    };
+
+    int x = 0;
+    int y = 0;
+    int numComponents = 0;
+    stbi_uc *decoded = stbi_load_from_memory(encoded.data(), encoded.size(), &x, &y, &numComponents, NumComponents);
+    t_decodeTarget = {};
+
+    if (!decoded)
+    {
+        std::cerr << "Failed to decode image: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    // formats that go through a conversion (16 bit, palettes, ...) end up in a heap buffer, copy those over
+    if (decoded != dst.data())
+    {
+        memcpy(dst.data(), decoded, static_cast<size_t>(width) * height * NumComponents);
+        free(decoded);
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool()
+    : ThreadPool(std::max(2u, std::thread::hardware_concurrency()) - 1)
+{
+}
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+    m_workers.reserve(numThreads);
+    for (uint32_t i = 0; i < numThreads; i++)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobAvailable.notify_all();
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobsDone.wait(lock,
+                    [&]()
+                    {
+                        return m_jobs.empty() && m_activeJobs == 0;
+                    });
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &function)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Indices are handed out dynamically since items can take very different amounts of time. Helpers that only get
+    // to run after every item is taken find nothing left to do, so the state they touch is shared rather than on the
+    // stack and the caller only waits for the items themselves, not for queued helpers to start.
+    struct State
+    {
+        std::atomic<size_t> nextIdx = 0;
+        std::atomic<size_t> numDone = 0;
+        size_t count = 0;
+        const std::function<void(size_t)> *function = nullptr;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->function = &function;
+
+    auto runItems = [state]()
+    {
+        for (size_t idx = state->nextIdx++; idx < state->count; idx = state->nextIdx++)
+        {
+            (*state->function)(idx);
+            if (++state->numDone == state->count)
+            {
+                state->numDone.notify_all();
+            }
+        }
+    };
+
+    size_t numHelpers = std::min<size_t>(count - 1, m_workers.size());
+    for (size_t i = 0; i < numHelpers; i++)
+    {
+        submit(runItems);
+    }
+    runItems();
+
+    for (size_t numDone = state->numDone; numDone != count; numDone = state->numDone)
+    {
+        state->numDone.wait(numDone);
+    }
+}
+
+uint32_t ThreadPool::numThreads()
+{
+    return m_workers.size();
+}
+
+void ThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_jobAvailable.wait(lock,
+                            [&]()
+                            {
+                                return m_stopping || !m_jobs.empty();
+                            });
+        // pending jobs are still drained on shutdown
+        if (m_jobs.empty())
+        {
+            return;
+        }
+
+        std::function<void()> job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_activeJobs++;
+        lock.unlock();
+
+        job();
+
+        lock.lock();
+        m_activeJobs--;
+        if (m_jobs.empty() && m_activeJobs == 0)
+        {
+            m_jobsDone.notify_all();
+        }
+    }
+}
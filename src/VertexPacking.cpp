@@ -0,0 +1,224 @@
+#include "VertexPacking.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+#include <numeric>
+#include <string_view>
+
+namespace
+{
+    struct FloatVertex
+    {
+        glm::vec3 position;
+        glm::vec2 normal;
+        glm::vec2 textureCoordinate;
+    };
+
+    // shared by the half and snorm16 formats, which only differ in how position is encoded. position has a fourth
+    // component since three component 16 bit formats aren't required to be supported for vertex buffers
+    struct CompactVertex
+    {
+        std::array<uint16_t, 4> position;
+        std::array<uint16_t, 2> normal;
+        std::array<uint16_t, 2> textureCoordinate;
+    };
+
+    constexpr std::array<VertexInputAttributeDescription, 3> FloatAttributeDescs = {{
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(FloatVertex, position)},
+        {.location = 1, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(FloatVertex, normal)},
+        {.location = 2, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(FloatVertex, textureCoordinate)},
+    }};
+
+    constexpr std::array<VertexInputAttributeDescription, 3> HalfAttributeDescs = {{
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R16G16B16A16_SFLOAT, .offset = offsetof(CompactVertex, position)},
+        {.location = 1, .binding = 0, .format = VK_FORMAT_R16G16_SNORM, .offset = offsetof(CompactVertex, normal)},
+        {.location = 2, .binding = 0, .format = VK_FORMAT_R16G16_SFLOAT, .offset = offsetof(CompactVertex, textureCoordinate)},
+    }};
+
+    constexpr std::array<VertexInputAttributeDescription, 3> Snorm16AttributeDescs = {{
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R16G16B16A16_SNORM, .offset = offsetof(CompactVertex, position)},
+        {.location = 1, .binding = 0, .format = VK_FORMAT_R16G16_SNORM, .offset = offsetof(CompactVertex, normal)},
+        {.location = 2, .binding = 0, .format = VK_FORMAT_R16G16_SFLOAT, .offset = offsetof(CompactVertex, textureCoordinate)},
+    }};
+
+    struct Layout
+    {
+        std::string_view name;
+        uint32_t stride;
+        std::span<const VertexInputAttributeDescription> attributeDescs;
+    };
+
+    constexpr std::array<Layout, MeshData::VERTEX_FORMAT_COUNT> Layouts = {{
+        {"float", sizeof(FloatVertex), FloatAttributeDescs},
+        {"half", sizeof(CompactVertex), HalfAttributeDescs},
+        {"snorm16", sizeof(CompactVertex), Snorm16AttributeDescs},
+    }};
+
+    constexpr MeshData::VertexFormat DefaultFormat = MeshData::VERTEX_FORMAT_SNORM16;
+    // keeps the dequantization of flat or single vertex submeshes finite
+    constexpr float MinHalfExtent = 1e-6f;
+
+    // the vertices a submesh's indices reach, [begin, end)
+    struct VertexRange
+    {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    [[nodiscard]] VertexRange getVertexRange(const MeshData &data, const MeshData::Submesh &submesh)
+    {
+        const uint32_t *indices = &data.faces.data()->x + submesh.indexOffset;
+        uint32_t numVertices = 0;
+        for (uint32_t i = 0; i < submesh.indexCount; i++)
+        {
+            numVertices = std::max(numVertices, indices[i] + 1);
+        }
+        size_t begin = std::min<size_t>(submesh.vertexOffset, data.vertices.size());
+        size_t end = std::min<size_t>(begin + numVertices, data.vertices.size());
+        return {static_cast<uint32_t>(begin), static_cast<uint32_t>(end)};
+    }
+
+    // maps the unit sphere onto the [-1, 1] square, decodeOctahedral in mainPass.vert is the inverse
+    [[nodiscard]] glm::vec2 encodeOctahedral(const glm::vec3 &normal)
+    {
+        float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (sum == 0.0f)
+        {
+            return glm::vec2(0.0f);
+        }
+        glm::vec2 encoded = glm::vec2(normal.x, normal.y) / sum;
+        if (normal.z < 0.0f)
+        {
+            glm::vec2 folded(1.0f - std::abs(encoded.y), 1.0f - std::abs(encoded.x));
+            encoded = glm::vec2(encoded.x >= 0.0f ? folded.x : -folded.x, encoded.y >= 0.0f ? folded.y : -folded.y);
+        }
+        return encoded;
+    }
+
+    void packVertices(MeshData::VertexFormat format, const std::span<const Vertex> &vertices, const glm::vec3 &positionScale,
+                      const glm::vec3 &positionOffset, uint8_t *dst)
+    {
+        glm::vec3 invScale = 1.0f / positionScale;
+        for (const Vertex &vertex : vertices)
+        {
+            glm::vec3 position = (vertex.position - positionOffset) * invScale;
+            glm::vec2 normal = encodeOctahedral(vertex.normal);
+            if (format == MeshData::VERTEX_FORMAT_FLOAT)
+            {
+                FloatVertex packed = {position, normal, vertex.textureCoordinate};
+                std::memcpy(dst, &packed, sizeof(packed));
+                dst += sizeof(packed);
+                continue;
+            }
+
+            CompactVertex packed = {};
+            for (int i = 0; i < 3; i++)
+            {
+                bool isHalf = format == MeshData::VERTEX_FORMAT_HALF;
+                packed.position[i] = isHalf ? glm::packHalf1x16(position[i]) : glm::packSnorm1x16(position[i]);
+            }
+            packed.normal = {glm::packSnorm1x16(normal.x), glm::packSnorm1x16(normal.y)};
+            packed.textureCoordinate = {glm::packHalf1x16(vertex.textureCoordinate.x), glm::packHalf1x16(vertex.textureCoordinate.y)};
+            std::memcpy(dst, &packed, sizeof(packed));
+            dst += sizeof(packed);
+        }
+    }
+} // namespace
+
+MeshData::VertexFormat VertexPacking::GetSelectedFormat()
+{
+    static const MeshData::VertexFormat format = []()
+    {
+        const char *name = std::getenv("PACEM_VERTEX_FORMAT");
+        if (!name || !*name)
+        {
+            return DefaultFormat;
+        }
+        for (uint32_t i = 0; i < Layouts.size(); i++)
+        {
+            if (Layouts[i].name == name)
+            {
+                return static_cast<MeshData::VertexFormat>(i);
+            }
+        }
+        std::cerr << "Unknown PACEM_VERTEX_FORMAT " << name << ", using " << Layouts[DefaultFormat].name << std::endl;
+        return DefaultFormat;
+    }();
+    return format;
+}
+
+uint32_t VertexPacking::GetStride(MeshData::VertexFormat format)
+{
+    return Layouts[format].stride;
+}
+
+std::span<const VertexInputAttributeDescription> VertexPacking::GetAttributeDescs(MeshData::VertexFormat format)
+{
+    return Layouts[format].attributeDescs;
+}
+
+void VertexPacking::Pack(MeshData::VertexFormat format, MeshData &data)
+{
+    std::vector<VertexRange> ranges;
+    ranges.reserve(data.submeshes.size());
+    for (const MeshData::Submesh &submesh : data.submeshes)
+    {
+        ranges.push_back(getVertexRange(data, submesh));
+    }
+    std::vector<size_t> order(data.submeshes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b)
+              {
+                  return ranges[a].begin < ranges[b].begin;
+              });
+
+    // Submeshes whose vertex ranges overlap share a transform, so the vertices they share are packed once. Vertices no
+    // submesh reaches are never drawn and stay zeroed
+    uint32_t stride = GetStride(format);
+    data.packedVertexStorage.assign(data.vertices.size() * stride, 0);
+    for (size_t first = 0; first < order.size();)
+    {
+        VertexRange group = ranges[order[first]];
+        size_t last = first + 1;
+        for (; last < order.size() && ranges[order[last]].begin < group.end; last++)
+        {
+            group.end = std::max(group.end, ranges[order[last]].end);
+        }
+
+        std::span<const Vertex> vertices = data.vertices.subspan(group.begin, group.end - group.begin);
+        glm::vec3 positionScale(1.0f);
+        glm::vec3 positionOffset(0.0f);
+        if (format != MeshData::VERTEX_FORMAT_FLOAT && !vertices.empty())
+        {
+            glm::vec3 minPosition = vertices[0].position;
+            glm::vec3 maxPosition = vertices[0].position;
+            for (const Vertex &vertex : vertices)
+            {
+                minPosition = glm::min(minPosition, vertex.position);
+                maxPosition = glm::max(maxPosition, vertex.position);
+            }
+            positionOffset = (minPosition + maxPosition) * 0.5f;
+            positionScale = glm::max((maxPosition - minPosition) * 0.5f, glm::vec3(MinHalfExtent));
+        }
+        uint8_t *dst = data.packedVertexStorage.data() + static_cast<size_t>(group.begin) * stride;
+        packVertices(format, vertices, positionScale, positionOffset, dst);
+
+        for (; first < last; first++)
+        {
+            MeshData::Submesh &submesh = data.submeshes[order[first]];
+            submesh.positionScale = positionScale;
+            submesh.positionOffset = positionOffset;
+        }
+    }
+
+    data.vertexFormat = format;
+    data.packedVertices = data.packedVertexStorage;
+    data.vertices = {};
+    data.vertexStorage = {};
+}